@@ -0,0 +1,1105 @@
+/**
+ * libBMP ܲ
+ *
+ *   bmp_bench [--quick] [--sizes vga,hd,...] [--json out.json]
+ *             [--compare base.json] [--threshold 10] [--filter name]
+ *
+ * 24/32λϳͼ, ʱCAPI, MP/sbytes/sÿεõڴ.
+ * --compare 뱣Ļ׼JSONԱ, ½ֵ(ٷֱ)ʱ1.
+ * ʱǰȷԼ, ʧʱ1.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+//ͳƿڵڴ, Դֱӱļ
+static size_t bench_alloc_count = 0, bench_alloc_bytes = 0;
+
+static void *bench_malloc(size_t size)
+{
+    bench_alloc_count++;
+    bench_alloc_bytes += size;
+    return malloc(size);
+}
+
+static void *bench_calloc(size_t count, size_t size)
+{
+    bench_alloc_count++;
+    bench_alloc_bytes += count * size;
+    return calloc(count, size);
+}
+
+//reallocµĴС
+static void *bench_realloc(void *ptr, size_t size)
+{
+    bench_alloc_count++;
+    bench_alloc_bytes += size;
+    return realloc(ptr, size);
+}
+
+#define malloc(size) bench_malloc(size)
+#define calloc(count, size) bench_calloc(count, size)
+#define realloc(ptr, size) bench_realloc(ptr, size)
+
+#ifndef _WIN32
+//O_DIRECTĶ뻺
+static int bench_posix_memalign(void **ptr, size_t align, size_t size)
+{
+    bench_alloc_count++;
+    bench_alloc_bytes += size;
+    return posix_memalign(ptr, align, size);
+}
+
+#define posix_memalign(ptr, align, size) bench_posix_memalign(ptr, align, size)
+#endif
+
+#include "../libBMP.c"
+
+#undef malloc
+#undef calloc
+#undef realloc
+#ifndef _WIN32
+#undef posix_memalign
+#endif
+
+typedef struct BenchSize
+{
+    const char *name;
+    int width, height;
+}BenchSize;
+
+//ڸв
+static const BenchSize bench_sizes[] = {
+    {"vga",    640,   480},
+    {"hd_odd", 1281,  721},
+    {"fhd_odd", 1921, 1081},
+    {"12mp",   4000,  3000},
+    {"100mp",  10000, 10000},
+};
+
+#define BENCH_SIZE_COUNT (int)(sizeof(bench_sizes) / sizeof(bench_sizes[0]))
+
+typedef struct BenchCtx
+{
+    BMP *src;           //ԭʼͼ, ޸
+    BMP *work;          //ÿμʱǰ¸
+    BMP *tpl;           //ģ
+    BMPTemplateSet *tplset; //64ģ
+    unsigned char *mem; //ͼ
+    size_t memlen;
+    const char *file;
+    double kern_data[9], *kern[3];
+    BMPKernel *sobel;
+    BMPDirty *dirty;    //״õʱ
+    BMP *blur;
+    BMPHistCache *histcache;
+    int *hist;          //bmp_create_histogram
+    BMPSearchCache *searchcache;
+    unsigned char *planebuf;    //ɫռתƽ, ״õʱȫߴƽ
+}BenchCtx;
+
+typedef struct BenchCase
+{
+    const char *name;
+    void (*run)(BenchCtx *ctx);
+    double max_mp;      //()ʱ
+    int bits;           //0ʱֻλ
+}BenchCase;
+
+typedef struct BenchResult
+{
+    char name[64], size[32];
+    int width, height, bits, iters;
+    double best_ms, mean_ms, mpps, bps, allocs, alloc_bytes;
+}BenchResult;
+
+/** ʱ() **/
+static double bench_now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1000.0 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
+
+/** ɺϳͼ:  +  **/
+static BMP *bench_image(int width, int height, int alpha)
+{
+    BMP *bmp = NULL;
+    int w = 0, h = 0, speed = 0, bytepix = 0, perline = 0;
+    unsigned int seed = 12345;
+
+    if ((bmp = (BMP *)malloc(sizeof(BMP))) == NULL) return NULL;
+    bmp->width = width;
+    bmp->height = height;
+    bmp->alpha = alpha;
+    bmp->size = (size_t)BMP_PERLINE_REALSIZE(bmp) * height;
+    if ((bmp->data = (unsigned char *)malloc(bmp->size)) == NULL) {
+        free(bmp);
+        return NULL;
+    }
+    memset(bmp->data, 0, bmp->size);
+
+    perline = BMP_PERLINE_SUP(bmp);
+    bytepix = alpha == 1 ? 4 : 3;
+    BMP_LOOP_START(bmp, w, h);
+
+    seed = seed * 1103515245 + 12345;
+    bmp->data[speed] = (unsigned char)(w * 255 / width + (seed >> 24) % 16);
+    bmp->data[speed + 1] = (unsigned char)(h * 255 / height + (seed >> 16) % 16);
+    bmp->data[speed + 2] = (unsigned char)((w + h) + (seed >> 8) % 16);
+    if (alpha == 1)
+        bmp->data[speed + 3] = 0xff;
+
+    BMP_LOOP_STOP(bmp, speed);
+    return bmp;
+}
+
+/** ͼоȽȡcount24x24ģģ弯 **/
+static BMPTemplateSet *bench_tplset(BMP *bmp, int count)
+{
+    BMPTemplateSet *set = NULL;
+    BMP *tpl = NULL;
+    int i = 0, x = 0, y = 0;
+
+    if ((set = bmp_tplset_create()) == NULL) return NULL;
+    for (i = 0; i < count; i++) {
+        x = (int)((long long)(bmp->width - 24) * i / count);
+        y = (int)((long long)(bmp->height - 24) * ((i * 37) % count) / count);
+        if ((tpl = bmp_copy_rect(bmp, x, y, x + 24, y + 24)) == NULL) continue;
+        bmp_tplset_add(set, tpl);
+        bmp_destroy(&tpl);
+    }
+    bmp_tplset_compile(set);
+    return set;
+}
+
+// +---------------------------------------------------------
+// | ʱǰȷԼ, һʧʱ1
+// +---------------------------------------------------------
+
+/** ǶԳơɷĺ(Եظ)Ա **/
+static int check_convolve(void)
+{
+    static const float taps[9] = {0.25f, 0, 0, 0, 0.25f, 0, 0.25f, 0, 0.25f};
+    BMPBGR clr = {0, 0, 0};
+    BMPKernel *kernel = NULL;
+    BMP *src = NULL, *dst = NULL;
+    int x = 0, y = 0, c = 0, i = 0, j = 0, xx = 0, yy = 0, bad = 0;
+    double sum = 0;
+
+    src = bench_image(37, 29, 0);
+    dst = bmp_copy(src);
+    kernel = bmp_kernel_create(taps, 3, 3);
+    if (src == NULL || dst == NULL || kernel == NULL) bad = 1;
+    else {
+        bmp_convolve(dst, kernel, BMP_BORDER_REPLICATE, clr);
+        for (y = 0; y < src->height; y++) for (x = 0; x < src->width; x++) for (c = 0; c < 3; c++) {
+            sum = 0;
+            for (i = 0; i < 3; i++) for (j = 0; j < 3; j++) {
+                yy = y + i - 1 < 0 ? 0 : (y + i - 1 >= src->height ? src->height - 1 : y + i - 1);
+                xx = x + j - 1 < 0 ? 0 : (x + j - 1 >= src->width ? src->width - 1 : x + j - 1);
+                sum += taps[i * 3 + j] * src->data[(size_t)yy * BMP_PERLINE_REALSIZE(src) + xx * 3 + c];
+            }
+            if (abs(dst->data[(size_t)y * BMP_PERLINE_REALSIZE(dst) + x * 3 + c] - (int)(sum + 0.5)) > 1)
+                bad++;
+        }
+    }
+    bmp_kernel_destroy(&kernel);
+    bmp_destroy(&src);
+    bmp_destroy(&dst);
+    return bad;
+}
+
+/** Ļͼͼ: ɫ, ׵ϵϸʻ() **/
+static BMP *bench_blocky(int width, int height, int strokes)
+{
+    BMP *bmp = NULL;
+    unsigned int seed = 99;
+    int i = 0, x = 0, y = 0, l = 0, t = 0, r = 0, b = 0;
+    unsigned char *p = NULL;
+
+    if ((bmp = bench_image(width, height, 0)) == NULL) return NULL;
+    memset(bmp->data, 0xf0, bmp->size);
+    for (i = 0; i < (strokes ? 600 : 200); i++) {
+        seed = seed * 1103515245 + 12345;
+        l = (seed >> 8) % width;
+        t = (seed >> 16) % height;
+        seed = seed * 1103515245 + 12345;
+        r = l + (strokes ? 1 + (seed >> 8) % 6 : 2 + (seed >> 8) % 40);
+        b = t + (strokes ? 1 + (seed >> 16) % 3 : 2 + (seed >> 16) % 20);
+        for (y = t; y < b && y < height; y++) for (x = l; x < r && x < width; x++) {
+            p = bmp->data + (size_t)y * BMP_PERLINE_REALSIZE(bmp) + x * 3;
+            p[0] = (unsigned char)(strokes ? (seed & 1 ? 0 : 90) : seed >> 3);
+            p[1] = (unsigned char)(strokes ? p[0] : seed >> 11);
+            p[2] = (unsigned char)(strokes ? p[0] : seed >> 19);
+        }
+    }
+    return bmp;
+}
+
+/** ͼ()ƫƽȡģ, Ӧҵһȫƥλ **/
+static int check_search_pyramid(void)
+{
+    BMP *src = NULL, *tpl = NULL;
+    int img = 0, i = 0, x = 0, y = 0, bad = 0;
+
+    for (img = 0; img < 3; img++) {
+        src = img ? bench_blocky(320, 200, img == 2) : bench_image(320, 200, 0);
+        for (i = 0; i < 60 && src; i++) {
+            x = 3 + i * 37 % 250;
+            y = 1 + i * 23 % 150;
+            if ((tpl = bmp_copy_rect(src, x, y, x + 40, y + 24)) == NULL) continue;
+            if (!bmp_search_pyramid(src, tpl, 4, 0, 16, &x, &y) || !bmp_search_verify(src, tpl, x, y, 0))
+                bad++;
+            bmp_destroy(&tpl);
+        }
+        bmp_destroy(&src);
+    }
+    return bad;
+}
+
+/** ݹ˹ı߽Ӧȼܲ㹻ظԵ **/
+static int check_gauss_iir(void)
+{
+    static const double sigmas[3] = {0.3, 8, 20};
+    BMP *src = NULL, *dst = NULL, *pad = NULL;
+    int s = 0, pw = 0, x = 0, y = 0, xx = 0, yy = 0, c = 0, bad = 0;
+
+    for (s = 0; s < 3; s++) {
+        pw = (int)(12 * sigmas[s]) + 4;
+        src = bench_blocky(90, 70, 0);
+        dst = bmp_copy(src);
+        pad = bench_image(90 + pw * 2, 70 + pw * 2, 0);
+        if (src == NULL || dst == NULL || pad == NULL) bad++;
+        else {
+            for (y = 0; y < pad->height; y++) for (x = 0; x < pad->width; x++) {
+                yy = y - pw < 0 ? 0 : (y - pw >= src->height ? src->height - 1 : y - pw);
+                xx = x - pw < 0 ? 0 : (x - pw >= src->width ? src->width - 1 : x - pw);
+                memcpy(pad->data + (size_t)y * BMP_PERLINE_REALSIZE(pad) + x * 3,
+                    src->data + (size_t)yy * BMP_PERLINE_REALSIZE(src) + xx * 3, 3);
+            }
+            bmp_gaussblur_iir(dst, sigmas[s]);
+            bmp_gaussblur_iir(pad, sigmas[s]);
+            for (y = 0; y < dst->height; y++) for (x = 0; x < dst->width; x++) for (c = 0; c < 3; c++)
+                if (abs(dst->data[(size_t)y * BMP_PERLINE_REALSIZE(dst) + x * 3 + c] -
+                    pad->data[(size_t)(y + pw) * BMP_PERLINE_REALSIZE(pad) + (x + pw) * 3 + c]) > 1)
+                    bad++;
+        }
+        bmp_destroy(&src);
+        bmp_destroy(&dst);
+        bmp_destroy(&pad);
+    }
+    return bad;
+}
+
+/** ͬСͼ(β)Ƿͬ **/
+static int bench_same(const BMP *a, const BMP *b)
+{
+    int y = 0, bytes = a->width * (a->alpha == 1 ? 4 : 3);
+
+    for (y = 0; y < a->height; y++)
+        if (memcmp(a->data + (size_t)y * BMP_PERLINE_REALSIZE(a), b->data + (size_t)y * BMP_PERLINE_REALSIZE(b), bytes) != 0)
+            return 0;
+    return 1;
+}
+
+/** ÿ֡д(ɫģ), ֡bmp_dirty_mark, ż֡bmp_dirty_diffҳ, Ӧͬ **/
+static int check_dirty_update(void)
+{
+    BMP *prev = NULL, *cur = NULL, *tpl = NULL, *blur = NULL, *ref = NULL;
+    BMPHistCache *histcache = NULL;
+    BMPSearchCache *searchcache = NULL;
+    BMPDirty *dirty = NULL;
+    BMPRect rect;
+    unsigned int seed = 7;
+    const int *his = NULL;
+    int *full = NULL;
+    int frame = 0, i = 0, n = 0, y = 0, x1 = 0, y1 = 0, x2 = 0, y2 = 0, r1 = 0, r2 = 0, bad = 0;
+
+    prev = bench_blocky(160, 120, 0);
+    tpl = prev ? bmp_copy_rect(prev, 40, 30, 64, 46) : NULL;
+    blur = prev ? bmp_copy(prev) : NULL;
+    if (blur) bmp_gaussblur_filter(blur, 1.0);
+    histcache = prev ? bmp_histcache_create(prev, 1) : NULL;
+    searchcache = prev && tpl ? bmp_searchcache_create(prev, tpl) : NULL;
+    dirty = bmp_dirty_create(160, 120);
+    if (tpl == NULL || blur == NULL || histcache == NULL || searchcache == NULL || dirty == NULL) bad++;
+
+    for (frame = 0; frame < 16 && !bad; frame++) {
+        if ((cur = bmp_copy(prev)) == NULL) {
+            bad++;
+            break;
+        }
+        bmp_dirty_clear(dirty);
+        n = 1 + frame % 3;
+        for (i = 0; i < n; i++) {
+            seed = seed * 1103515245 + 12345;
+            rect.left = (seed >> 8) % (160 - tpl->width);
+            rect.top = (seed >> 16) % (120 - tpl->height);
+            rect.right = rect.left + tpl->width;
+            rect.bottom = rect.top + tpl->height;
+            for (y = rect.top; y < rect.bottom; y++) {
+                if (seed & 0x10000000)
+                    memcpy(cur->data + (size_t)y * BMP_PERLINE_REALSIZE(cur) + rect.left * 3,
+                        tpl->data + (size_t)(y - rect.top) * BMP_PERLINE_REALSIZE(tpl), tpl->width * 3);
+                else
+                    memset(cur->data + (size_t)y * BMP_PERLINE_REALSIZE(cur) + rect.left * 3, (int)(seed >> 24), tpl->width * 3);
+            }
+            if (frame & 1)
+                bmp_dirty_mark(dirty, &rect);
+        }
+        if (!(frame & 1) && bmp_dirty_diff(dirty, prev, cur) < 0) bad++;
+
+        ref = bmp_copy(cur);
+        if (ref) bmp_gaussblur_filter(ref, 1.0);
+        if (ref == NULL || !bmp_gaussblur_update(cur, blur, 1.0, dirty) || !bench_same(blur, ref)) bad++;
+
+        his = bmp_histcache_update(histcache, cur, dirty);
+        full = bmp_histogram(cur, 1);
+        if (his == NULL || full == NULL || memcmp(his, full, sizeof(int) * 256) != 0) bad++;
+
+        x1 = y1 = x2 = y2 = -1;
+        r1 = bmp_searchcache_update(searchcache, cur, dirty, &x1, &y1);
+        r2 = bmp_search(cur, tpl, &x2, &y2);
+        if (r1 != r2 || x1 != x2 || y1 != y2) bad++;
+
+        free(full);
+        bmp_destroy(&ref);
+        bmp_destroy(&prev);
+        prev = cur;
+        cur = NULL;
+    }
+    bmp_dirty_destroy(&dirty);
+    bmp_searchcache_destroy(&searchcache);
+    bmp_histcache_destroy(&histcache);
+    bmp_destroy(&blur);
+    bmp_destroy(&tpl);
+    bmp_destroy(&prev);
+    return bad;
+}
+
+/** 󴰿[x-left, x+right] x [y-up, y+down]ڵС/ֵ, ͼĲֺ **/
+static void bench_morph_pass(BMP *bmp, int dilate, int left, int right, int up, int down)
+{
+    BMP *src = bmp_copy(bmp);
+    int x = 0, y = 0, c = 0, i = 0, j = 0, v = 0, e = 0, bytepix = bmp->alpha == 1 ? 4 : 3;
+
+    if (src == NULL) return;
+    for (y = 0; y < bmp->height; y++) for (x = 0; x < bmp->width; x++) for (c = 0; c < 3; c++) {
+        e = dilate ? 0 : 255;
+        for (i = y - up; i <= y + down; i++) for (j = x - left; j <= x + right; j++) {
+            if (i < 0 || i >= bmp->height || j < 0 || j >= bmp->width) continue;
+            v = src->data[(size_t)i * BMP_PERLINE_REALSIZE(src) + j * bytepix + c];
+            e = dilate ? (v > e ? v : e) : (v < e ? v : e);
+        }
+        bmp->data[(size_t)y * BMP_PERLINE_REALSIZE(bmp) + x * bytepix + c] = (unsigned char)e;
+    }
+    bmp_destroy(&src);
+}
+
+/** ̬ѧصС/ֵԱ: Ҷڰ(λ)ͼ, żС볬ͼĽṹԪ, Լ **/
+static int check_morphology(void)
+{
+    static const BMPMorphStep steps[8] = {
+        {BMP_MORPH_ERODE, 5, 3}, {BMP_MORPH_DILATE, 4, 6}, {BMP_MORPH_OPEN, 7, 7}, {BMP_MORPH_CLOSE, 2, 9},
+        {BMP_MORPH_DILATE, 200, 1}, {BMP_MORPH_ERODE, 1, 60}, {BMP_MORPH_OPEN, 3, 3}, {BMP_MORPH_CLOSE, 6, 4},
+    };
+    BMP *a = NULL, *b = NULL;
+    int img = 0, i = 0, k = 0, l = 0, r = 0, u = 0, d = 0, bad = 0;
+
+    for (img = 0; img < 4; img++) for (i = 0; i < 7; i++) {
+        //һΪһ
+        a = img < 2 ? bench_image(150, 47, img) : bench_blocky(150, 47, img == 2);
+        if (a && img == 3) bmp_binaryzation(a, 128);
+        b = a ? bmp_copy(a) : NULL;
+        if (b == NULL || !bmp_morphology_chain(a, steps + i, i < 6 ? 1 : 2)) {
+            bmp_destroy(&a);
+            bmp_destroy(&b);
+            bad++;
+            continue;
+        }
+        for (k = i; k < (i < 6 ? i + 1 : 8); k++) {
+            l = (steps[k].width - 1) / 2;
+            r = steps[k].width - 1 - l;
+            u = (steps[k].height - 1) / 2;
+            d = steps[k].height - 1 - u;
+            if (steps[k].op == BMP_MORPH_ERODE || steps[k].op == BMP_MORPH_OPEN)
+                bench_morph_pass(b, 0, l, r, u, d);
+            if (steps[k].op != BMP_MORPH_ERODE)
+                bench_morph_pass(b, 1, r, l, d, u);
+            if (steps[k].op == BMP_MORPH_CLOSE)
+                bench_morph_pass(b, 0, l, r, u, d);
+        }
+        if (!bench_same(a, b))
+            bad++;
+        bmp_destroy(&a);
+        bmp_destroy(&b);
+    }
+    return bad;
+}
+
+#ifdef __AVX2__
+/** ɫռתAVX2··Ա: ε8һ, صֻ߱β **/
+static int check_csc_simd(void)
+{
+    static BMPCsc job;
+    unsigned char buf[8], vec[3][BMP_CSC_BLOCK], ref[3][BMP_CSC_BLOCK];
+    int b[BMP_CSC_BLOCK], g[BMP_CSC_BLOCK], r[BMP_CSC_BLOCK];
+    int sum[3][BMP_CSC_BLOCK];  //4:2:02x2֮
+    unsigned int seed = 3;
+    BMPPlanes planes;
+    BMP *bmp = NULL;
+    int round = 0, i = 0, c = 0, bad = 0;
+
+    bmp = bench_image(8, 1, 0);
+    for (i = 0; i < 3; i++) {
+        planes.data[i] = buf;
+        planes.stride[i] = 8;
+    }
+    if (bmp == NULL || !bmp_csc_init(&job, bmp, BMP_COLOR_HSV, &planes, 0)) {
+        bmp_destroy(&bmp);
+        return 1;
+    }
+
+    for (round = 0; round < 64; round++) {
+        //ǰüֵȷǱͺHSVĸ
+        for (i = 0; i < BMP_CSC_BLOCK; i++) {
+            seed = seed * 1103515245 + 12345;
+            b[i] = round < 4 ? (i & 1) * 255 : (int)(seed >> 8) & 0xff;
+            g[i] = round < 4 ? (i >> 1 & 1) * 255 : (round & 1 ? b[i] : (int)(seed >> 16) & 0xff);
+            r[i] = round < 4 ? (i >> 2 & 1) * 255 : (int)(seed >> 24);
+            sum[0][i] = b[i] * 4 - (b[i] ? (int)(seed & 3) : 0);
+            sum[1][i] = g[i] * 4 - (g[i] ? (int)(seed >> 2 & 3) : 0);
+            sum[2][i] = r[i] * 4 - (r[i] ? (int)(seed >> 4 & 3) : 0);
+        }
+
+        for (c = 0; c < 3; c++) {
+            bmp_ycc_component(b, g, r, BMP_CSC_BLOCK, c, 0, vec[0]);
+            bmp_ycc_component(sum[0], sum[1], sum[2], BMP_CSC_BLOCK, c, 2, vec[1]);
+            for (i = 0; i < BMP_CSC_BLOCK; i++) {
+                bmp_ycc_component(b + i, g + i, r + i, 1, c, 0, ref[0] + i);
+                bmp_ycc_component(sum[0] + i, sum[1] + i, sum[2] + i, 1, c, 2, ref[1] + i);
+            }
+            if (memcmp(vec, ref, BMP_CSC_BLOCK * 2) != 0) bad++;
+        }
+
+        bmp_hsv_block(&job, b, g, r, BMP_CSC_BLOCK, vec[0], vec[1], vec[2]);
+        for (i = 0; i < BMP_CSC_BLOCK; i++)
+            bmp_hsv_block(&job, b + i, g + i, r + i, 1, ref[0] + i, ref[1] + i, ref[2] + i);
+        if (memcmp(vec, ref, sizeof(vec)) != 0) bad++;
+
+        //任: YΪ0..255, Cb/CrѼȥ128
+        for (i = 0; i < BMP_CSC_BLOCK; i++) {
+            g[i] -= 128;
+            r[i] -= 128;
+        }
+        bmp_ycc_inverse(b, g, r, BMP_CSC_BLOCK, vec[0], vec[1], vec[2]);
+        for (i = 0; i < BMP_CSC_BLOCK; i++)
+            bmp_ycc_inverse(b + i, g + i, r + i, 1, ref[0] + i, ref[1] + i, ref[2] + i);
+        if (memcmp(vec, ref, sizeof(vec)) != 0) bad++;
+    }
+    bmp_destroy(&bmp);
+    return bad;
+}
+#endif
+
+#ifdef BMP_USE_CXX_KERNELS
+/** ֻȽɫͨ(Cֵ˲дalpha) **/
+static int bench_same_color(const BMP *a, const BMP *b)
+{
+    int x = 0, y = 0, bytepix = a->alpha == 1 ? 4 : 3;
+
+    for (y = 0; y < a->height; y++) for (x = 0; x < a->width; x++)
+        if (memcmp(a->data + (size_t)y * BMP_PERLINE_REALSIZE(a) + x * bytepix,
+            b->data + (size_t)y * BMP_PERLINE_REALSIZE(b) + x * bytepix, 3) != 0)
+            return 0;
+    return 1;
+}
+
+/** C++ģںCʵ(ƹת, ֱӵڲ)ֽڶԱ, 24/32λһ **/
+static int check_cxx_kernels(void)
+{
+    static const int boxes[4] = {1, 2, 5, 130};
+    BMPLut lut;
+    BMP *a = NULL, *b = NULL;
+    unsigned char *tmp = NULL, t = 0;
+    size_t left = 0, right = 0;
+    int alpha = 0, op = 0, w = 0, h = 0, c = 0, bytepix = 0, bad = 0;
+
+    for (alpha = 0; alpha < 2; alpha++) for (op = 0; op < 9; op++) {
+        a = bench_image(37 + op * 6, 29, alpha);
+        b = a ? bmp_copy(a) : NULL;
+        tmp = b ? (unsigned char *)malloc(b->size) : NULL;
+        if (tmp == NULL) {
+            bmp_destroy(&a);
+            bmp_destroy(&b);
+            bad++;
+            continue;
+        }
+        memcpy(tmp, b->data, b->size);
+        bytepix = alpha ? 4 : 3;
+
+        if (op == 0) {
+            bmp_cxx_convert_gray(a);
+            bmp_lut_init(&lut, BMP_LUT_GRAY);
+            bmp_apply_lut(b, &lut);
+        } else if (op == 1) {
+            bmp_cxx_binaryzation(a, 100);
+            bmp_lut_init(&lut, BMP_LUT_AVERAGE);
+            bmp_lut_threshold(&lut, 100);
+            bmp_apply_lut(b, &lut);
+        } else if (op == 2) {
+            bmp_cxx_horizontal_flip(a);
+            for (h = 0; h < b->height; h++) for (w = 0; w < b->width / 2; w++) for (c = 0; c < 3; c++) {
+                left = (size_t)h * BMP_PERLINE_REALSIZE(b) + w * bytepix + c;
+                right = (size_t)h * BMP_PERLINE_REALSIZE(b) + (b->width - 1 - w) * bytepix + c;
+                t = b->data[left];
+                b->data[left] = b->data[right];
+                b->data[right] = t;
+            }
+        } else if (op < 7) {
+            bmp_cxx_box_filter(a, boxes[op - 3]);
+            bmp_box_sum_filter(b, boxes[op - 3], tmp);
+            memcpy(b->data, tmp, b->size);
+        } else {
+            bmp_cxx_middle_filter(a, op - 6);
+            for (h = 0; h < b->height; h++) for (w = 0; w < b->width; w++) for (c = 0; c < 3; c++)
+                tmp[(size_t)h * BMP_PERLINE_REALSIZE(b) + w * bytepix + c] = (unsigned char)bmp_middle_filter_calc(b, w, h, c, op - 6);
+            memcpy(b->data, tmp, b->size);
+        }
+        if (op < 7 ? !bench_same(a, b) : !bench_same_color(a, b))
+            bad++;
+        free(tmp);
+        bmp_destroy(&a);
+        bmp_destroy(&b);
+    }
+    return bad;
+}
+#endif
+
+typedef struct BenchCheck
+{
+    const char *name;
+    int (*run)(void);           //س
+}BenchCheck;
+
+static const BenchCheck bench_checks[] = {
+    {"convolve",        check_convolve},
+    {"search_pyramid",  check_search_pyramid},
+    {"gauss_iir",       check_gauss_iir},
+    {"dirty_update",    check_dirty_update},
+    {"morphology",      check_morphology},
+#ifdef __AVX2__
+    {"csc_simd",        check_csc_simd},
+#endif
+#ifdef BMP_USE_CXX_KERNELS
+    {"cxx_kernels",     check_cxx_kernels},
+#endif
+};
+
+static int bench_check(void)
+{
+    int i = 0, bad = 0, failed = 0;
+
+    for (i = 0; i < (int)(sizeof(bench_checks) / sizeof(bench_checks[0])); i++) {
+        if ((bad = bench_checks[i].run()) != 0) {
+            fprintf(stderr, "check %s failed: %d\n", bench_checks[i].name, bad);
+            failed = 1;
+        }
+    }
+    return failed;
+}
+
+//淵ֵ, ֹñŻ
+static volatile int bench_sink = 0;
+
+static void run_load(BenchCtx *ctx)            { BMP *b = bmp_load(ctx->file); bmp_destroy(&b); }
+static void run_save(BenchCtx *ctx)            { bmp_save(ctx->work, ctx->file); }
+static void run_load_mem(BenchCtx *ctx)        { BMP *b = bmp_load_mem(ctx->mem, ctx->memlen); bmp_destroy(&b); }
+static void run_save_mem(BenchCtx *ctx)        { bmp_save_mem_to(ctx->work, ctx->mem, ctx->memlen); }
+static void run_copy(BenchCtx *ctx)            { BMP *b = bmp_copy(ctx->work); bmp_destroy(&b); }
+static void run_copy_rect(BenchCtx *ctx)       { BMP *b = bmp_copy_rect(ctx->work, 1, 1, ctx->work->width - 1, ctx->work->height - 1); bmp_destroy(&b); }
+static void run_add_alpha(BenchCtx *ctx)       { bmp_add_alpha(ctx->work); }
+static void run_reverse(BenchCtx *ctx)         { bmp_reverse(ctx->work); }
+static void run_horizontal_flip(BenchCtx *ctx) { bmp_horizontal_flip(ctx->work); }
+static void run_rotate(BenchCtx *ctx)          { BMPBGR clr = {0, 0, 0}; bmp_rotate(ctx->work, 30.0, 0, clr); }
+static void run_resize_by_clr(BenchCtx *ctx)   { BMPBGR clr = {0, 0, 0}; bmp_resize_by_clr(ctx->work, clr); }
+static void run_histogram(BenchCtx *ctx)       { int *his = bmp_histogram(ctx->work, 1); bench_sink = his[0]; free(his); }
+
+/** ֱͼƳͼ, ֻbmp_create_histogram **/
+static void run_create_histogram(BenchCtx *ctx)
+{
+    BMPBGR clr = {0, 0, 255};
+    BMP *hist = NULL;
+
+    if (ctx->hist == NULL)
+        ctx->hist = bmp_histogram(ctx->src, 1);
+    hist = bmp_create_histogram(ctx->hist, clr);
+    bench_sink = hist ? hist->width : 0;
+    bmp_destroy(&hist);
+}
+
+/** ֿѱļ, ڴԤ16MB **/
+static void run_tiled_histogram(BenchCtx *ctx)
+{
+    BMPTiled *tiled = bmp_tiled_open(ctx->file, 0, 16 << 20);
+    unsigned long long *his = bmp_tiled_histogram(tiled, 1);
+
+    bench_sink = his ? (int)his[0] : 0;
+    free(his);
+    bmp_tiled_close(&tiled);
+}
+
+static void run_grayhistogram(BenchCtx *ctx)   { int *his = bmp_grayhistogram(ctx->work); bench_sink = his[0]; free(his); }
+static void run_convert_gray(BenchCtx *ctx)    { bmp_convert_gray(ctx->work); }
+static void run_binaryzation(BenchCtx *ctx)    { bmp_binaryzation(ctx->work, 128); }
+
+/** gamma + Աȶ + ɫ, ͨͬһű **/
+static void run_apply_lut(BenchCtx *ctx)
+{
+    BMPLut lut;
+
+    bmp_lut_init(&lut, BMP_LUT_COLOR);
+    bmp_lut_gamma(&lut, 2.2);
+    bmp_lut_contrast(&lut, 1.2);
+    bmp_lut_levels(&lut, 16, 235, 0, 255);
+    bmp_apply_lut(ctx->work, &lut);
+}
+
+/** ֻɫͨ, űͬ **/
+static void run_apply_lut_rgb(BenchCtx *ctx)
+{
+    unsigned char table[256];
+    BMPLut lut;
+    int i = 0;
+
+    for (i = 0; i < 256; i++)
+        table[i] = (unsigned char)(255 - i);
+    bmp_lut_init(&lut, BMP_LUT_COLOR);
+    bmp_lut_map(&lut, 2, table);
+    bmp_apply_lut(ctx->work, &lut);
+}
+
+static void run_equalize_hist(BenchCtx *ctx)   { bmp_equalize_hist(ctx->work, 0); }
+static void run_clahe(BenchCtx *ctx)           { bmp_clahe(ctx->work, 8, 8, 2.0, 0); }
+static void run_clahe_gray(BenchCtx *ctx)      { bmp_clahe(ctx->work, 8, 8, 2.0, 1); }
+static void run_otsu(BenchCtx *ctx)            { bench_sink = bmp_otsu(ctx->work); }
+static void run_sauvola(BenchCtx *ctx)        { bmp_threshold_sauvola(ctx->work, 31, 0.3); }
+static void run_average_filter(BenchCtx *ctx)  { bmp_average_filter(ctx->work); }
+static void run_box_filter(BenchCtx *ctx)      { bmp_box_filter(ctx->work, 2); }
+static void run_middle_filter(BenchCtx *ctx)   { bmp_middle_filter(ctx->work, 1); }
+/** ȫߴƽһ, ɫռ乲, ʼַ϶; ʱԭͼ4:2:0ƽ **/
+static void bench_planes(BenchCtx *ctx, int space, BMPPlanes *planes)
+{
+    size_t base = 0;
+    int fill = 0;
+
+    if (ctx->planebuf == NULL) {
+        ctx->planebuf = (unsigned char *)malloc(bmp_planes_size(BMP_COLOR_YCBCR, ctx->work->width, ctx->work->height) + BMP_PLANE_ALIGN);
+        fill = ctx->planebuf != NULL;
+    }
+    base = ((size_t)ctx->planebuf + BMP_PLANE_ALIGN - 1) / BMP_PLANE_ALIGN * BMP_PLANE_ALIGN;
+    if (fill) {
+        bmp_planes_init(planes, BMP_COLOR_YCBCR420, ctx->work->width, ctx->work->height, (unsigned char *)base);
+        bmp_to_planes(ctx->src, BMP_COLOR_YCBCR420, planes);
+    }
+    bmp_planes_init(planes, space, ctx->work->width, ctx->work->height, (unsigned char *)base);
+}
+
+static void run_to_ycbcr420(BenchCtx *ctx)     { BMPPlanes pl; bench_planes(ctx, BMP_COLOR_YCBCR420, &pl); bench_sink = bmp_to_planes(ctx->work, BMP_COLOR_YCBCR420, &pl); }
+static void run_to_hsv(BenchCtx *ctx)          { BMPPlanes pl; bench_planes(ctx, BMP_COLOR_HSV, &pl); bench_sink = bmp_to_planes(ctx->work, BMP_COLOR_HSV, &pl); }
+static void run_to_lab(BenchCtx *ctx)          { BMPPlanes pl; bench_planes(ctx, BMP_COLOR_LAB, &pl); bench_sink = bmp_to_planes(ctx->work, BMP_COLOR_LAB, &pl); }
+
+/** ֻ任, ƽΪbench_planesʱԭͼ4:2:0 **/
+static void run_from_ycbcr420(BenchCtx *ctx)   { BMPPlanes pl; bench_planes(ctx, BMP_COLOR_YCBCR420, &pl); bench_sink = bmp_from_planes(ctx->work, BMP_COLOR_YCBCR420, &pl); }
+
+static void run_morph_erode(BenchCtx *ctx)     { bmp_morphology(ctx->work, BMP_MORPH_ERODE, 31, 31); }
+
+/** ֵ󿪱, λ **/
+static void run_morph_binary(BenchCtx *ctx)
+{
+    BMPMorphStep steps[2] = {{BMP_MORPH_OPEN, 31, 31}, {BMP_MORPH_CLOSE, 31, 31}};
+
+    bmp_binaryzation(ctx->work, 128);
+    bmp_morphology_chain(ctx->work, steps, 2);
+}
+static void run_gaussblur(BenchCtx *ctx)       { bmp_gaussblur_filter(ctx->work, 1.0); }
+static void run_gaussblur_iir(BenchCtx *ctx)   { bmp_gaussblur_iir(ctx->work, 20.0); }
+static void run_convolution(BenchCtx *ctx)     { bmp_convolution_filter(ctx->work, ctx->kern, 3); }
+static void run_convolve_sobel(BenchCtx *ctx)  { BMPBGR clr = {0, 0, 0}; bmp_convolve(ctx->work, ctx->sobel, BMP_BORDER_MIRROR, clr); }
+static void run_contrast(BenchCtx *ctx)        { bench_sink = bmp_contrast(ctx->work, ctx->src); }
+static void run_hash(BenchCtx *ctx)            { bench_sink = (int)bmp_hash(ctx->work); }
+static void run_phash(BenchCtx *ctx)           { bench_sink = (int)bmp_phash(ctx->work); }
+static void run_search(BenchCtx *ctx)          { int x, y; bench_sink = bmp_search(ctx->work, ctx->tpl, &x, &y); }
+static void run_search_pyramid(BenchCtx *ctx)  { int x, y; bench_sink = bmp_search_pyramid(ctx->work, ctx->tpl, 4, 0, 16, &x, &y); }
+static void run_tplset_search(BenchCtx *ctx)   { bench_sink = bmp_tplset_search(ctx->tplset, ctx->work, NULL, NULL); }
+
+/** ģһ֡: 64x64ɫΪ **/
+static void bench_touch(BenchCtx *ctx, int mark)
+{
+    BMPRect rect;
+    int x = 0, y = 0, bytepix = ctx->work->alpha == 1 ? 4 : 3;
+
+    if (ctx->dirty == NULL)
+        ctx->dirty = bmp_dirty_create(ctx->work->width, ctx->work->height);
+    rect.left = (ctx->work->width - 64) / 2;
+    rect.top = (ctx->work->height - 64) / 2;
+    rect.right = rect.left + 64;
+    rect.bottom = rect.top + 64;
+    for (y = rect.top; y < rect.bottom; y++) for (x = rect.left * bytepix; x < rect.right * bytepix; x++)
+        ctx->work->data[(size_t)y * BMP_PERLINE_REALSIZE(ctx->work) + x] ^= 0xff;
+    bmp_dirty_clear(ctx->dirty);
+    if (mark) bmp_dirty_mark(ctx->dirty, &rect);
+}
+
+static void run_diff(BenchCtx *ctx)
+{
+    BMPDiff *diff = NULL;
+
+    bench_touch(ctx, 0);
+    diff = bmp_diff(ctx->src, ctx->work, 32, 0, BMP_DIFF_COUNT);
+    bench_sink = diff ? diff->rectcount : 0;
+    bmp_diff_destroy(&diff);
+}
+
+static void run_diff_parallel(BenchCtx *ctx)
+{
+    BMPDiff *diff = NULL;
+
+    bench_touch(ctx, 0);
+    diff = bmp_diff(ctx->src, ctx->work, 32, 0, BMP_DIFF_COUNT | BMP_DIFF_PARALLEL);
+    bench_sink = diff ? diff->rectcount : 0;
+    bmp_diff_destroy(&diff);
+}
+
+static void run_dirty_diff(BenchCtx *ctx)      { bench_touch(ctx, 0); bench_sink = bmp_dirty_diff(ctx->dirty, ctx->src, ctx->work); }
+
+static void run_gaussblur_update(BenchCtx *ctx)
+{
+    if (ctx->blur == NULL) {
+        ctx->blur = bmp_copy(ctx->src);
+        bmp_gaussblur_filter(ctx->blur, 1.0);
+    }
+    bench_touch(ctx, 1);
+    bench_sink = bmp_gaussblur_update(ctx->work, ctx->blur, 1.0, ctx->dirty);
+}
+
+static void run_histcache_update(BenchCtx *ctx)
+{
+    if (ctx->histcache == NULL)
+        ctx->histcache = bmp_histcache_create(ctx->src, 1);
+    bench_touch(ctx, 1);
+    bench_sink = bmp_histcache_update(ctx->histcache, ctx->work, ctx->dirty)[0];
+}
+
+/** 첽, ŶȴĿ **/
+static void run_async_roundtrip(BenchCtx *ctx)
+{
+    BMPAsync *req = NULL;
+    BMP *bmp = NULL;
+
+    req = bmp_save_async(ctx->work, ctx->file, NULL, NULL);
+    bench_sink = bmp_async_wait(req, NULL);
+    bmp_async_destroy(&req);
+    req = bmp_load_async(ctx->file, NULL, NULL);
+    bench_sink = bmp_async_wait(req, &bmp);
+    bmp_async_destroy(&req);
+    bmp_destroy(&bmp);
+}
+
+static void run_searchcache_update(BenchCtx *ctx)
+{
+    int x, y;
+
+    if (ctx->searchcache == NULL)
+        ctx->searchcache = bmp_searchcache_create(ctx->src, ctx->tpl);
+    bench_touch(ctx, 1);
+    bench_sink = bmp_searchcache_update(ctx->searchcache, ctx->work, ctx->dirty, &x, &y);
+}
+
+static const BenchCase bench_cases[] = {
+    {"load",            run_load,            1000},
+    {"save",            run_save,            1000},
+    {"load_mem",        run_load_mem,        1000},
+    {"save_mem",        run_save_mem,        1000},
+    {"async_roundtrip", run_async_roundtrip, 1000},
+    {"copy",            run_copy,            1000},
+    {"copy_rect",       run_copy_rect,       1000},
+    {"add_alpha",       run_add_alpha,       1000, 24},  //32λͼalpha, κ
+    {"reverse",         run_reverse,         1000},
+    {"horizontal_flip", run_horizontal_flip, 1000},
+    {"rotate",          run_rotate,          1000},
+    {"resize_by_clr",   run_resize_by_clr,   1000},
+    {"histogram",       run_histogram,       1000},
+    {"create_histogram", run_create_histogram, 1000},
+    {"tiled_histogram", run_tiled_histogram, 1000},
+    {"grayhistogram",   run_grayhistogram,   1000},
+    {"convert_gray",    run_convert_gray,    1000},
+    {"binaryzation",    run_binaryzation,    1000},
+    {"apply_lut",       run_apply_lut,       1000},
+    {"apply_lut_rgb",   run_apply_lut_rgb,   1000},
+    {"equalize_hist",   run_equalize_hist,   1000},
+    {"clahe",           run_clahe,           1000},
+    {"clahe_gray",      run_clahe_gray,      1000},
+    {"otsu",            run_otsu,            1000},
+    {"sauvola",         run_sauvola,         1000},
+    {"average_filter",  run_average_filter,  1000},
+    {"box_filter",      run_box_filter,      1000},
+    {"middle_filter",   run_middle_filter,   3},
+    {"morph_erode",     run_morph_erode,     1000},
+    {"morph_binary",    run_morph_binary,    1000},
+    {"to_ycbcr420",     run_to_ycbcr420,     1000},
+    {"from_ycbcr420",   run_from_ycbcr420,   1000},
+    {"to_hsv",          run_to_hsv,          1000},
+    {"to_lab",          run_to_lab,          1000},
+    {"gaussblur",       run_gaussblur,       100},
+    {"gaussblur_iir",   run_gaussblur_iir,   1000},
+    {"convolution",     run_convolution,     100},
+    {"convolve_sobel",  run_convolve_sobel,  100},
+    {"contrast",        run_contrast,        1000},
+    {"hash",            run_hash,            1000},
+    {"phash",           run_phash,           1000},
+    {"search",          run_search,          0.4},
+    {"search_pyramid",  run_search_pyramid,  13},
+    {"tplset_search",   run_tplset_search,   100},
+    {"diff",            run_diff,            1000},
+    {"diff_parallel",   run_diff_parallel,   1000},
+    {"dirty_diff",      run_dirty_diff,      1000},
+    {"gaussblur_update", run_gaussblur_update, 100},
+    {"histcache_update", run_histcache_update, 1000},
+    {"search_update",   run_searchcache_update, 100},
+};
+
+#define BENCH_CASE_COUNT (int)(sizeof(bench_cases) / sizeof(bench_cases[0]))
+
+/** ʱһ: 3, ۼԼ0.350 **/
+static void bench_run(const BenchCase *bc, BenchCtx *ctx, BenchResult *res)
+{
+    double start = 0, elapsed = 0, total = 0;
+    size_t allocs = 0, alloc_bytes = 0;
+    int iters = 0;
+
+    res->best_ms = -1;
+    while (iters < 3 || (total < 300 && iters < 50)) {
+        bmp_destroy(&ctx->work);
+        ctx->work = bmp_copy(ctx->src);
+
+        bench_alloc_count = bench_alloc_bytes = 0;
+        start = bench_now();
+        bc->run(ctx);
+        elapsed = bench_now() - start;
+        allocs += bench_alloc_count;
+        alloc_bytes += bench_alloc_bytes;
+
+        if (res->best_ms < 0 || elapsed < res->best_ms)
+            res->best_ms = elapsed;
+        total += elapsed;
+        iters++;
+    }
+
+    res->iters = iters;
+    res->mean_ms = total / iters;
+    res->allocs = (double)allocs / iters;
+    res->alloc_bytes = (double)alloc_bytes / iters;
+    if (res->best_ms <= 0)
+        res->best_ms = 1e-6;
+    res->mpps = (double)ctx->src->width * ctx->src->height / 1e6 / (res->best_ms / 1000.0);
+    res->bps = (double)ctx->src->size / (res->best_ms / 1000.0);
+}
+
+/** дһJSON(ÿһ, --compareȡ) **/
+static void bench_json_write(FILE *fp, const BenchResult *res, int last)
+{
+    fprintf(fp, "  {\"name\": \"%s\", \"size\": \"%s\", \"width\": %d, \"height\": %d, \"bits\": %d, "
+        "\"iters\": %d, \"best_ms\": %.4f, \"mean_ms\": %.4f, \"mpps\": %.3f, \"bytes_per_s\": %.0f, "
+        "\"allocs\": %.2f, \"alloc_bytes\": %.0f}%s\n",
+        res->name, res->size, res->width, res->height, res->bits, res->iters, res->best_ms, res->mean_ms,
+        res->mpps, res->bps, res->allocs, res->alloc_bytes, last ? "" : ",");
+}
+
+/** ȡ׼JSONеһ **/
+static int bench_json_read(const char *line, BenchResult *res)
+{
+    memset(res, 0, sizeof(BenchResult));
+    return sscanf(line, " {\"name\": \"%63[^\"]\", \"size\": \"%31[^\"]\", \"width\": %d, \"height\": %d, \"bits\": %d, "
+        "\"iters\": %d, \"best_ms\": %lf, \"mean_ms\": %lf, \"mpps\": %lf",
+        res->name, res->size, &res->width, &res->height, &res->bits, &res->iters,
+        &res->best_ms, &res->mean_ms, &res->mpps) == 9;
+}
+
+/** ׼Ա, ػ **/
+static int bench_compare(const char *file, const BenchResult *results, int count, double threshold)
+{
+    FILE *fp = NULL;
+    char line[1024];
+    BenchResult base;
+    double change = 0;
+    int i = 0, regress = 0;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+        fprintf(stderr, "cannot open baseline %s\n", file);
+        return -1;
+    }
+
+    printf("\n%-16s %-8s %4s %12s %12s %8s\n", "function", "size", "bits", "base MP/s", "MP/s", "change");
+    while (fgets(line, sizeof(line), fp)) {
+        if (!bench_json_read(line, &base)) continue;
+        for (i = 0; i < count; i++) {
+            if (strcmp(results[i].name, base.name) != 0 || strcmp(results[i].size, base.size) != 0 ||
+                results[i].bits != base.bits)
+                continue;
+            change = base.mpps > 0 ? (results[i].mpps - base.mpps) * 100.0 / base.mpps : 0;
+            printf("%-16s %-8s %4d %12.2f %12.2f %+7.1f%%%s\n", base.name, base.size, base.bits,
+                base.mpps, results[i].mpps, change, change < -threshold ? "  REGRESSION" : "");
+            if (change < -threshold)
+                regress++;
+        }
+    }
+    fclose(fp);
+    return regress;
+}
+
+/** Ƿڶŷָб **/
+static int bench_in_list(const char *list, const char *name)
+{
+    const char *p = list;
+    size_t len = strlen(name);
+
+    if (list == NULL) return 1;
+    while ((p = strstr(p, name)) != NULL) {
+        if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0'))
+            return 1;
+        p += len;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *json = NULL, *compare = NULL, *sizes = NULL, *filter = NULL;
+    double threshold = 10.0, mp = 0;
+    BenchResult *results = NULL;
+    BenchCtx ctx;
+    FILE *fp = NULL;
+    int i = 0, s = 0, c = 0, bits = 0, count = 0, regress = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) json = argv[++i];
+        else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) compare = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) sizes = argv[++i];
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) filter = argv[++i];
+        else if (strcmp(argv[i], "--quick") == 0) sizes = "vga,hd_odd";
+        else {
+            fprintf(stderr, "usage: %s [--quick] [--sizes vga,hd_odd,fhd_odd,12mp,100mp] [--filter name,...]\n"
+                "          [--json out.json] [--compare base.json] [--threshold pct]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (bench_check()) return 1;
+
+    results = (BenchResult *)malloc(sizeof(BenchResult) * BENCH_SIZE_COUNT * 2 * BENCH_CASE_COUNT);
+    if (results == NULL) return 2;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.file = "bench_tmp.bmp";
+    for (i = 0; i < 9; i++)
+        ctx.kern_data[i] = i == 4 ? 0.5 : 0.0625;
+    for (i = 0; i < 3; i++)
+        ctx.kern[i] = ctx.kern_data + i * 3;
+    ctx.sobel = bmp_kernel_preset(BMP_KERNEL_SOBEL_X);
+
+    printf("%-16s %-8s %4s %6s %10s %10s %10s %12s %8s\n",
+        "function", "size", "bits", "iters", "best ms", "mean ms", "MP/s", "MB/s", "allocs");
+
+    for (s = 0; s < BENCH_SIZE_COUNT; s++) {
+        if (!bench_in_list(sizes, bench_sizes[s].name)) continue;
+        mp = (double)bench_sizes[s].width * bench_sizes[s].height / 1e6;
+
+        for (bits = 24; bits <= 32; bits += 8) {
+            if ((ctx.src = bench_image(bench_sizes[s].width, bench_sizes[s].height, bits == 32)) == NULL) {
+                fprintf(stderr, "cannot allocate %s\n", bench_sizes[s].name);
+                continue;
+            }
+            ctx.tpl = bmp_copy_rect(ctx.src, ctx.src->width - 17, ctx.src->height - 17,
+                ctx.src->width - 1, ctx.src->height - 1);
+            ctx.tplset = bench_tplset(ctx.src, 64);
+            ctx.mem = (unsigned char *)bmp_save_mem(ctx.src, &ctx.memlen);
+            bmp_save(ctx.src, ctx.file);
+
+            for (c = 0; c < BENCH_CASE_COUNT; c++) {
+                BenchResult *res = results + count;
+
+                if (mp > bench_cases[c].max_mp || (bench_cases[c].bits && bench_cases[c].bits != bits) ||
+                    !bench_in_list(filter, bench_cases[c].name))
+                    continue;
+                memset(res, 0, sizeof(BenchResult));
+                strcpy(res->name, bench_cases[c].name);
+                strcpy(res->size, bench_sizes[s].name);
+                res->width = bench_sizes[s].width;
+                res->height = bench_sizes[s].height;
+                res->bits = bits;
+                bench_run(&bench_cases[c], &ctx, res);
+                count++;
+
+                printf("%-16s %-8s %4d %6d %10.3f %10.3f %10.2f %12.1f %8.1f\n", res->name, res->size, bits,
+                    res->iters, res->best_ms, res->mean_ms, res->mpps, res->bps / 1e6, res->allocs);
+                fflush(stdout);
+            }
+
+            bmp_destroy(&ctx.work);
+            bmp_destroy(&ctx.tpl);
+            bmp_tplset_destroy(&ctx.tplset);
+            bmp_dirty_destroy(&ctx.dirty);
+            bmp_destroy(&ctx.blur);
+            bmp_histcache_destroy(&ctx.histcache);
+            free(ctx.hist);
+            ctx.hist = NULL;
+            bmp_searchcache_destroy(&ctx.searchcache);
+            free(ctx.planebuf);
+            ctx.planebuf = NULL;
+            bmp_destroy(&ctx.src);
+            free(ctx.mem);
+            ctx.mem = NULL;
+        }
+    }
+    remove(ctx.file);
+
+    if (json) {
+        if ((fp = fopen(json, "w")) == NULL) {
+            fprintf(stderr, "cannot write %s\n", json);
+        } else {
+            fprintf(fp, "[\n");
+            for (i = 0; i < count; i++)
+                bench_json_write(fp, results + i, i == count - 1);
+            fprintf(fp, "]\n");
+            fclose(fp);
+        }
+    }
+
+    if (compare)
+        regress = bench_compare(compare, results, count, threshold);
+
+    free(results);
+    bmp_kernel_destroy(&ctx.sobel);
+    bmp_async_shutdown();
+    return regress != 0 ? 1 : 0;
+}
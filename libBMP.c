@@ -1,17 +1,71 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <limits.h>
 
 #include "libBMP.h"
 
-typedef unsigned short bmp_u_short;
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 
-#if (defined _M_X64) || (defined __x86_64__) || (defined __amd64)
-typedef int bmp_u_long;
+#ifndef BMP_NO_THREAD
+#ifdef _WIN32
+typedef HANDLE bmp_thread_t;
+typedef SRWLOCK bmp_mutex_t;
+typedef CONDITION_VARIABLE bmp_cond_t;
+#define BMP_MUTEX_INIT SRWLOCK_INIT
+#define BMP_COND_INIT CONDITION_VARIABLE_INIT
+#define BMP_THREAD_PROC(name, arg) static DWORD WINAPI name(LPVOID arg)
+#define BMP_THREAD_RETURN return 0
+#define bmp_mutex_lock(m) AcquireSRWLockExclusive(m)
+#define bmp_mutex_unlock(m) ReleaseSRWLockExclusive(m)
+#define bmp_cond_wait(c, m) SleepConditionVariableSRW(c, m, INFINITE, 0)
+#define bmp_cond_broadcast(c) WakeAllConditionVariable(c)
+#define bmp_thread_create(t, proc, arg) ((*(t) = CreateThread(NULL, 0, proc, arg, 0, NULL)) != NULL)
+#define bmp_thread_join(t) (WaitForSingleObject(t, INFINITE), CloseHandle(t))
 #else
-typedef unsigned long bmp_u_long;
+#include <pthread.h>
+typedef pthread_t bmp_thread_t;
+typedef pthread_mutex_t bmp_mutex_t;
+typedef pthread_cond_t bmp_cond_t;
+#define BMP_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define BMP_COND_INIT PTHREAD_COND_INITIALIZER
+#define BMP_THREAD_PROC(name, arg) static void *name(void *arg)
+#define BMP_THREAD_RETURN return NULL
+#define bmp_mutex_lock(m) pthread_mutex_lock(m)
+#define bmp_mutex_unlock(m) pthread_mutex_unlock(m)
+#define bmp_cond_wait(c, m) pthread_cond_wait(c, m)
+#define bmp_cond_broadcast(c) pthread_cond_broadcast(c)
+#define bmp_thread_create(t, proc, arg) (pthread_create(t, NULL, proc, arg) == 0)
+#define bmp_thread_join(t) pthread_join(t, NULL)
 #endif
+#endif
+
+//ļͷеֶι̶Ϊ16/32λ, longLP64ƽ̨Ϊ64λʹ
+typedef unsigned short bmp_u_short;
+typedef unsigned int bmp_u_long;
 
 #pragma pack(1)
 typedef struct
@@ -39,29 +93,372 @@ typedef struct
 }BITMAP_INFO_HEADER;
 #pragma pack()
 
-BMP *bmp_load(const char *file)
+// +---------------------------------------------------------
+// | ͳ
+// +---------------------------------------------------------
+
+static const char *bmp_stat_names[BMP_STAT_COUNT] = {
+    "bmp_load", "bmp_load_mem", "bmp_save", "bmp_save_mem", "bmp_copy", "bmp_copy_rect",
+    "bmp_add_alpha", "bmp_reverse", "bmp_horizontal_flip", "bmp_rotate", "bmp_resize_by_clr",
+    "bmp_histogram", "bmp_convert_gray", "bmp_binaryzation", "bmp_otsu", "bmp_average_filter",
+    "bmp_box_filter", "bmp_middle_filter", "bmp_gaussblur_filter", "bmp_convolution_filter",
+    "bmp_contrast", "bmp_search", "bmp_convolve", "bmp_gaussblur_iir",
+    "bmp_threshold_local", "bmp_search_pyramid",
+    "bmp_tplset_search", "bmp_hash", "bmp_phash",
+    "bmp_apply_lut", "bmp_dirty_diff", "bmp_convolve_update",
+    "bmp_histcache_update", "bmp_searchcache_update", "bmp_diff",
+    "bmp_equalize_hist", "bmp_clahe", "bmp_morphology_chain",
+    "bmp_to_planes", "bmp_from_planes",
+};
+
+#ifdef BMP_ENABLE_STATS
+
+#ifdef _MSC_VER
+#define BMP_TLS __declspec(thread)
+#else
+#define BMP_TLS __thread
+#endif
+
+//ͳǶ
+#ifndef BMP_STAT_DEPTH
+#define BMP_STAT_DEPTH 16
+#endif
+
+typedef struct BMPStatFrame
+{
+    int id;
+    double start;
+    unsigned long long alloc_bytes;
+}BMPStatFrame;
+
+//ֻ߳ջ, ܵȫ̹bmp_stat_total
+typedef struct BMPStatThread
+{
+    BMPStatFrame frame[BMP_STAT_DEPTH];
+    int depth, tid;
+    unsigned long long alloc_bytes;
+}BMPStatThread;
+
+static BMP_TLS BMPStatThread bmp_stat_thread;
+static BMPStats bmp_stat_total;
+
+static FILE *bmp_trace_fp = NULL;
+static int bmp_trace_events = 0, bmp_trace_tids = 0;
+static double bmp_trace_start = 0;
+#ifndef BMP_NO_THREAD
+static bmp_mutex_t bmp_stat_lock = BMP_MUTEX_INIT;
+static bmp_mutex_t bmp_trace_lock = BMP_MUTEX_INIT;
+#define BMP_STAT_LOCK() bmp_mutex_lock(&bmp_stat_lock)
+#define BMP_STAT_UNLOCK() bmp_mutex_unlock(&bmp_stat_lock)
+#else
+#define BMP_STAT_LOCK()
+#define BMP_STAT_UNLOCK()
+#endif
+
+/** ʱ(΢) **/
+static double bmp_stat_now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1000000.0 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+#endif
+}
+
+/** ͳڴ, ⲿ滻ķ亯ٰװ **/
+#if !defined(malloc) || !defined(calloc) || !defined(realloc)
+static void bmp_stat_alloc(size_t size)
+{
+    bmp_stat_thread.alloc_bytes += size;
+    BMP_STAT_LOCK();
+    bmp_stat_total.allocs++;
+    bmp_stat_total.alloc_bytes += size;
+    BMP_STAT_UNLOCK();
+}
+#endif
+
+#ifndef malloc
+static void *bmp_stat_malloc(size_t size)
+{
+    bmp_stat_alloc(size);
+    return malloc(size);
+}
+#endif
+
+#ifndef calloc
+static void *bmp_stat_calloc(size_t count, size_t size)
+{
+    bmp_stat_alloc(count * size);
+    return calloc(count, size);
+}
+#endif
+
+//reallocµĴС
+#ifndef realloc
+static void *bmp_stat_realloc(void *ptr, size_t size)
+{
+    bmp_stat_alloc(size);
+    return realloc(ptr, size);
+}
+#endif
+
+/** ʼ **/
+static void bmp_stat_begin(int id)
+{
+    BMPStatFrame *frame = NULL;
+
+    if (bmp_stat_thread.depth < BMP_STAT_DEPTH) {
+        frame = &bmp_stat_thread.frame[bmp_stat_thread.depth];
+        frame->id = id;
+        frame->alloc_bytes = bmp_stat_thread.alloc_bytes;
+        frame->start = bmp_stat_now();
+    }
+    bmp_stat_thread.depth++;
+}
+
+/** һtrace¼ **/
+static void bmp_trace_event(int id, double start, double dur, unsigned long long pixels)
+{
+#ifndef BMP_NO_THREAD
+    bmp_mutex_lock(&bmp_trace_lock);
+#endif
+    if (bmp_trace_fp) {
+        if (bmp_stat_thread.tid == 0)
+            bmp_stat_thread.tid = ++bmp_trace_tids;
+        fprintf(bmp_trace_fp, "%s{\"name\":\"%s\",\"cat\":\"libBMP\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"pid\":1,\"tid\":%d,\"args\":{\"pixels\":%llu}}",
+            bmp_trace_events++ ? ",\n" : "", bmp_stat_names[id], start - bmp_trace_start, dur,
+            bmp_stat_thread.tid, pixels);
+    }
+#ifndef BMP_NO_THREAD
+    bmp_mutex_unlock(&bmp_trace_lock);
+#endif
+}
+
+/** , ¼ʱ **/
+static void bmp_stat_end(int id, unsigned long long pixels)
+{
+    BMPStatFrame *frame = NULL;
+    BMPStatEntry *entry = &bmp_stat_total.func[id];
+    unsigned long long alloc = 0;
+    double dur = 0;
+
+    if (bmp_stat_thread.depth <= 0) return;
+    bmp_stat_thread.depth--;
+    if (bmp_stat_thread.depth >= BMP_STAT_DEPTH) return;
+
+    frame = &bmp_stat_thread.frame[bmp_stat_thread.depth];
+    dur = bmp_stat_now() - frame->start;
+    alloc = bmp_stat_thread.alloc_bytes - frame->alloc_bytes;
+
+    BMP_STAT_LOCK();
+    entry->calls++;
+    entry->ns += (unsigned long long)(dur * 1000.0);
+    entry->pixels += pixels;
+    entry->alloc_bytes += alloc;
+    if (alloc > entry->max_alloc)
+        entry->max_alloc = alloc;
+    BMP_STAT_UNLOCK();
+
+    //Ƿtracebmp_trace_eventж
+    bmp_trace_event(id, frame->start, dur, pixels);
+}
+
+#define BMP_STAT_BEGIN(id) bmp_stat_begin(id)
+#define BMP_STAT_END(id, pixels) bmp_stat_end(id, (unsigned long long)(pixels))
+
+//з䶼ͳ
+#ifndef malloc
+#define malloc(size) bmp_stat_malloc(size)
+#endif
+#ifndef calloc
+#define calloc(count, size) bmp_stat_calloc(count, size)
+#endif
+#ifndef realloc
+#define realloc(ptr, size) bmp_stat_realloc(ptr, size)
+#endif
+
+#else
+
+#define BMP_STAT_BEGIN(id)
+#define BMP_STAT_END(id, pixels)
+
+#endif
+
+/** ȡ߳ۼƵͳ **/
+void bmp_stats_snapshot(BMPStats *stats)
+{
+    int i = 0;
+
+    if (stats == NULL) return;
+    memset(stats, 0, sizeof(BMPStats));
+#ifdef BMP_ENABLE_STATS
+    BMP_STAT_LOCK();
+    memcpy(stats, &bmp_stat_total, sizeof(BMPStats));
+    BMP_STAT_UNLOCK();
+#endif
+    for (i = 0; i < BMP_STAT_COUNT; i++)
+        stats->func[i].name = bmp_stat_names[i];
+}
+
+/** ̵߳ͳ **/
+void bmp_stats_reset(void)
+{
+#ifdef BMP_ENABLE_STATS
+    BMP_STAT_LOCK();
+    memset(&bmp_stat_total, 0, sizeof(BMPStats));
+    BMP_STAT_UNLOCK();
+#endif
+}
+
+/** ʼChrome trace-event JSON **/
+int bmp_trace_open(const char *file)
+{
+#ifdef BMP_ENABLE_STATS
+    FILE *fp = NULL;
+
+    if (STRNULL(file) || (fp = fopen(file, "w")) == NULL) return 0;
+    fprintf(fp, "[\n");
+
+    bmp_trace_close();
+#ifndef BMP_NO_THREAD
+    bmp_mutex_lock(&bmp_trace_lock);
+#endif
+    bmp_trace_events = 0;
+    bmp_trace_start = bmp_stat_now();
+    bmp_trace_fp = fp;
+#ifndef BMP_NO_THREAD
+    bmp_mutex_unlock(&bmp_trace_lock);
+#endif
+    return 1;
+#else
+    (void)file;
+    return 0;
+#endif
+}
+
+/** trace **/
+void bmp_trace_close(void)
+{
+#ifdef BMP_ENABLE_STATS
+#ifndef BMP_NO_THREAD
+    bmp_mutex_lock(&bmp_trace_lock);
+#endif
+    if (bmp_trace_fp) {
+        fprintf(bmp_trace_fp, "\n]\n");
+        fclose(bmp_trace_fp);
+        bmp_trace_fp = NULL;
+    }
+#ifndef BMP_NO_THREAD
+    bmp_mutex_unlock(&bmp_trace_lock);
+#endif
+#endif
+}
+
+#define BMP_HEADER_SIZE (sizeof(BITMAP_FILE_HEADER) + sizeof(BITMAP_INFO_HEADER))
+
+//BI_BITFIELDSR/G/B(/A)40ֽϢͷ֮(V2ϵϢͷ, 򵥶12ֽ)
+#define BMP_MASKS_SIZE 16
+
+/** ֻBGRAֽ˳ͬ, ֽڶȡλ **/
+static int bmp_check_masks(const unsigned char *header, size_t len, unsigned long infosize)
+{
+    bmp_u_long mask[4] = {0, 0, 0, 0};
+
+    if (len < BMP_HEADER_SIZE + 12) return 0;
+    memcpy(mask, header + BMP_HEADER_SIZE, 12);
+    //V3ϵϢͷalpha
+    if (infosize >= sizeof(BITMAP_INFO_HEADER) + 16) {
+        if (len < BMP_HEADER_SIZE + 16) return 0;
+        memcpy(mask + 3, header + BMP_HEADER_SIZE + 12, 4);
+    }
+    return mask[0] == 0x00FF0000 && mask[1] == 0x0000FF00 && mask[2] == 0x000000FF &&
+        (mask[3] == 0 || mask[3] == 0xFF000000);
+}
+
+/** Уļͷ, headerlenֽڿ(BMP_HEADER_SIZE), ɹ1 **/
+static int bmp_parse_header(const unsigned char *header, size_t len, BMP *bmp, int *topdown, unsigned long *offbits)
+{
+    BITMAP_FILE_HEADER file_header;
+    BITMAP_INFO_HEADER info_header;
+    unsigned long long need = 0;
+    int width = 0, height = 0;
+
+    memcpy(&file_header, header, sizeof(BITMAP_FILE_HEADER));
+    memcpy(&info_header, header + sizeof(BITMAP_FILE_HEADER), sizeof(BITMAP_INFO_HEADER));
+
+    if (file_header.bfType != 0x4d42) return 0;
+    if ((unsigned long)info_header.biSize < sizeof(BITMAP_INFO_HEADER)) return 0;
+
+    //ʱֻ֧2432λ
+    if (info_header.biBitCount != 24 && info_header.biBitCount != 32) return 0;
+    if (info_header.biCompression != 0 && !(info_header.biCompression == 3 && info_header.biBitCount == 32 &&
+        bmp_check_masks(header, len, (unsigned long)info_header.biSize)))
+        return 0;
+
+    //ļеĳߴ, ֹ
+    width = (int)info_header.biWidth;
+    height = (int)info_header.biHeight;
+    if (width <= 0 || height == 0 || height < -INT_MAX) return 0;
+
+    bmp->alpha = info_header.biBitCount == 32 ? 1 : 0;
+    bmp->width = width;
+    bmp->height = abs(height);
+    if (bmp->width > (INT_MAX - 31) / 32) return 0;
+    if ((double)BMP_PERLINE_REALSIZE(bmp) * bmp->height > (double)((size_t)-1 / 2)) return 0;
+    bmp->size = (size_t)BMP_PERLINE_REALSIZE(bmp) * bmp->height;
+
+    //ݱϢͷ֮, 40ֽϢͷBI_BITFIELDSļҪ12ֽ
+    need = sizeof(BITMAP_FILE_HEADER) + (unsigned long long)info_header.biSize;
+    if (info_header.biCompression == 3 && info_header.biSize == sizeof(BITMAP_INFO_HEADER))
+        need += 12;
+    if ((unsigned long long)file_header.bfOffBits < need) return 0;
+
+    *topdown = height < 0;
+    *offbits = (unsigned long)file_header.bfOffBits;
+    return 1;
+}
+
+/** ȡļ, ɹ1 **/
+static int bmp_file_length(FILE *fp, unsigned long long *length)
+{
+#ifdef _WIN32
+    __int64 n = _filelengthi64(_fileno(fp));
+
+    if (n < 0) return 0;
+    *length = (unsigned long long)n;
+#else
+    struct stat st;
+
+    if (fstat(fileno(fp), &st) != 0) return 0;
+    *length = (unsigned long long)st.st_size;
+#endif
+    return 1;
+}
+
+/** ļȡͼ **/
+static BMP *bmp_load_file(const char *file)
 {
     FILE *fp = NULL;
     BMP *bmp = NULL;
-    BITMAP_FILE_HEADER file_header = {0};
-    BITMAP_INFO_HEADER info_header = {0};
+    unsigned char header[BMP_HEADER_SIZE + BMP_MASKS_SIZE];
+    unsigned long long length = 0;
+    unsigned long offbits = 0;
+    size_t len = 0;
+    int topdown = 0;
     
     if (STRNULL(file)) return NULL;
 
     fp = fopen(file, "rb");
     if (!fp) return NULL;
 
-    if (fread(&file_header, sizeof(BITMAP_FILE_HEADER), 1, fp) != 1) {
-        fclose(fp);
-        return NULL;
-    }
-    
-    if (fread(&info_header, sizeof(BITMAP_INFO_HEADER), 1, fp) != 1) {
-        fclose(fp);
-        return NULL;
-    }
-
-    if (file_header.bfType != 0x4d42) {
+    //ļͷϢͷһζ, ܴͬڵ
+    if ((len = fread(header, 1, sizeof(header), fp)) < BMP_HEADER_SIZE) {
         fclose(fp);
         return NULL;
     }
@@ -72,22 +469,19 @@ BMP *bmp_load(const char *file)
     }
     memset(bmp, 0, sizeof(BMP));
 
-    //ʱֻ֧2432λ
-    if (info_header.biBitCount != 24 && info_header.biBitCount != 32) {
+    //ȷļȷʵͷĳ, ٰóȷ
+    if (!bmp_parse_header(header, len, bmp, &topdown, &offbits) || !bmp_file_length(fp, &length) ||
+        length < offbits || length - offbits < (unsigned long long)bmp->size) {
         free(bmp);
         fclose(fp);
         return NULL;
     }
 
-    if (info_header.biBitCount == 32)
-        bmp->alpha = 1;
-
-    bmp->size = info_header.biSizeImage;
-    bmp->width = info_header.biWidth;
-    bmp->height = info_header.biHeight;
-
-    if (bmp->size == 0) {
-        bmp->size = BMP_PERLINE_REALSIZE(bmp) * bmp->height;
+    //Ѷ벿, Ƕλ
+    if (offbits > LONG_MAX || fseek(fp, (long)offbits, SEEK_SET) != 0) {
+        free(bmp);
+        fclose(fp);
+        return NULL;
     }
 
     bmp->data = (unsigned char *)malloc(bmp->size);
@@ -96,7 +490,6 @@ BMP *bmp_load(const char *file)
         fclose(fp);
         return NULL;
     }
-    memset(bmp->data, 0, bmp->size);
 
     if (fread(bmp->data, 1, (size_t)bmp->size, fp) != (size_t)bmp->size) {
         free(bmp->data);
@@ -105,127 +498,422 @@ BMP *bmp_load(const char *file)
         return NULL;
     }
     
-    if (bmp->height < 0) {
-        bmp->height = abs(bmp->height);
-    } else {
+    if (!topdown)
         bmp_reverse(bmp);
-    }
 
     fclose(fp);
     return bmp;
 }
 
-void bmp_save(BMP *bmp, const char *file)
+BMP *bmp_load(const char *file)
 {
-    FILE *fp = NULL;
-    BITMAP_FILE_HEADER kFileHeader;
-    BITMAP_INFO_HEADER kInfoHeader;
+    BMP *bmp = NULL;
 
-    if (!bmp || STRNULL(file)) return;
-    
-    memset(&kFileHeader, 0, sizeof(BITMAP_FILE_HEADER));
-    memset(&kInfoHeader, 0, sizeof(BITMAP_INFO_HEADER));
+    BMP_STAT_BEGIN(BMP_STAT_LOAD);
+    bmp = bmp_load_file(file);
+    BMP_STAT_END(BMP_STAT_LOAD, bmp ? (double)bmp->width * bmp->height : 0);
+    return bmp;
+}
 
-    kFileHeader.bfType = 0x4d42;
-    kFileHeader.bfSize = sizeof(BITMAP_FILE_HEADER) + sizeof(BITMAP_INFO_HEADER) + bmp->size;
-    kFileHeader.bfReserved1 = 0;
-    kFileHeader.bfReserved2 = 0;
-    kFileHeader.bfOffBits = sizeof(BITMAP_FILE_HEADER) + sizeof(BITMAP_INFO_HEADER);
-    
-    kInfoHeader.biSize = sizeof(BITMAP_INFO_HEADER);
-    kInfoHeader.biWidth = bmp->width;
-    kInfoHeader.biHeight = bmp->height;
-    kInfoHeader.biPlanes = 1;
-    kInfoHeader.biBitCount = bmp->alpha == 1 ? 32 : 24;
-    kInfoHeader.biCompression = 0L;
-    kInfoHeader.biSizeImage = bmp->size;
-    kInfoHeader.biXPelsPerMeter = 0;
-    kInfoHeader.biYPelsPerMeter = 0;
-    kInfoHeader.biClrUsed = 0;
-    kInfoHeader.biClrImportant = 0;
-    
-    if ((fp = fopen(file, "wb+")) == NULL) return;
-    fwrite(&kFileHeader, sizeof(BITMAP_FILE_HEADER), 1, fp);
-    fwrite(&kInfoHeader, sizeof(BITMAP_INFO_HEADER), 1, fp);
+/** ڴ, wrap == 1 ʱֱ **/
+static BMP *bmp_load_mem_ex(const void *buf, size_t len, int wrap)
+{
+    const unsigned char *src = (const unsigned char *)buf;
+    BMP *bmp = NULL;
+    unsigned long offbits = 0;
+    int topdown = 0, h = 0, preline = 0;
 
-    //תдͼ
-    {
-        unsigned char *src = NULL;
-        int hsrc = 0, preline = 0;
+    if (src == NULL || len < BMP_HEADER_SIZE) return NULL;
+
+    if ((bmp = (BMP *)malloc(sizeof(BMP))) == NULL) return NULL;
+    memset(bmp, 0, sizeof(BMP));
+
+    //ݲƫԽʱܾ
+    if (!bmp_parse_header(src, len, bmp, &topdown, &offbits) ||
+        offbits > len || len - offbits < (size_t)bmp->size ||
+        (wrap && !topdown)) {
+        free(bmp);
+        return NULL;
+    }
+    src += offbits;
+
+    if (wrap) {
+        bmp->data = (unsigned char *)src;
+        return bmp;
+    }
+
+    bmp->data = (unsigned char *)malloc(bmp->size);
+    if (bmp->data == NULL) {
+        free(bmp);
+        return NULL;
+    }
 
+    if (topdown) {
+        memcpy(bmp->data, src, bmp->size);
+    } else {
         preline = BMP_PERLINE_REALSIZE(bmp);
-        for (hsrc = bmp->height - 1; hsrc >= 0; hsrc--) {
-            src = bmp->data + hsrc * preline;
-            fwrite(src, preline, 1, fp);
-        }
+        for (h = 0; h < (int)bmp->height; h++)
+            memcpy(bmp->data + (size_t)h * preline, src + (size_t)(bmp->height - 1 - h) * preline, preline);
     }
+    return bmp;
+}
 
-    fclose(fp);
+/** ڴȡͼ **/
+BMP *bmp_load_mem(const void *buf, size_t len)
+{
+    BMP *bmp = NULL;
+
+    BMP_STAT_BEGIN(BMP_STAT_LOAD_MEM);
+    bmp = bmp_load_mem_ex(buf, len, 0);
+    BMP_STAT_END(BMP_STAT_LOAD_MEM, bmp ? (double)bmp->width * bmp->height : 0);
+    return bmp;
 }
 
-void bmp_destroy(BMP **bmp)
+/** ֱڴеͼ(϶´洢), ֻ **/
+BMP *bmp_wrap_mem(const void *buf, size_t len)
+{
+    return bmp_load_mem_ex(buf, len, 1);
+}
+
+/** ͷbmp_wrap_memĽ, ͷ **/
+void bmp_unwrap(BMP **bmp)
 {
     if (bmp == NULL || *bmp == NULL)
         return;
 
-    free((*bmp)->data);
     free(*bmp);
     *bmp = NULL;
 }
 
-// +---------------------------------------------------------
-// | ͼ
-// +---------------------------------------------------------
-
-/** һͼ **/
-BMP *bmp_copy(BMP *bmp)
+/** ļͷ, topdown == 1 ʱ߶Ϊ **/
+static void bmp_make_header(BMP *bmp, int topdown, unsigned char *header)
 {
-    BMP *dst = NULL;
+    BITMAP_FILE_HEADER kFileHeader;
+    BITMAP_INFO_HEADER kInfoHeader;
+    size_t size = (size_t)BMP_PERLINE_REALSIZE(bmp) * bmp->height;
 
-    if (BMPNULL(bmp)) return NULL;
+    memset(&kFileHeader, 0, sizeof(BITMAP_FILE_HEADER));
+    memset(&kInfoHeader, 0, sizeof(BITMAP_INFO_HEADER));
 
-    dst = (BMP *)malloc(sizeof(BMP));
-    if (dst == NULL) return NULL;
+    kFileHeader.bfType = 0x4d42;
+    //4GʱļͷеĴС޷ʾ, ȡʱֶ
+    kFileHeader.bfSize = size > 0xFFFFFFFFUL - BMP_HEADER_SIZE ? 0xFFFFFFFFUL : (bmp_u_long)(BMP_HEADER_SIZE + size);
+    kFileHeader.bfOffBits = BMP_HEADER_SIZE;
 
-    dst->width = bmp->width;
-    dst->height = bmp->height;
-    dst->size = bmp->size;
-    dst->alpha = bmp->alpha;
-    dst->data = (unsigned char *)malloc(bmp->size);
-    if (dst->data == NULL) {
-        free(dst);
-        return NULL;
-    }
+    kInfoHeader.biSize = sizeof(BITMAP_INFO_HEADER);
+    kInfoHeader.biWidth = bmp->width;
+    kInfoHeader.biHeight = topdown ? -bmp->height : bmp->height;
+    kInfoHeader.biPlanes = 1;
+    kInfoHeader.biBitCount = bmp->alpha == 1 ? 32 : 24;
+    kInfoHeader.biSizeImage = size > 0xFFFFFFFFUL ? 0 : (bmp_u_long)size;
 
-    memcpy(dst->data, bmp->data, dst->size);
-    return dst;
+    memcpy(header, &kFileHeader, sizeof(BITMAP_FILE_HEADER));
+    memcpy(header + sizeof(BITMAP_FILE_HEADER), &kInfoHeader, sizeof(BITMAP_INFO_HEADER));
 }
 
-/** ͼеһ **/
-BMP *bmp_copy_rect(BMP *bmp, int left, int top, int right, int bottom)
+/** ֽ **/
+size_t bmp_encoded_size(BMP *bmp)
 {
-    BMP *dst = NULL;
+    if (BMPNULL(bmp)) return 0;
+    return BMP_HEADER_SIZE + (size_t)BMP_PERLINE_REALSIZE(bmp) * bmp->height;
+}
 
-    int bytepix = 0, perline = 0;
-    int bytepix_dst = 0, perline_dst = 0;
-    int w, h, dstw, dsth;
-    int speed, speed_dst;
-    
-    if (BMPNULL(bmp)) return NULL;
-    if (right <= left || bottom <= top) return NULL;
-    
-    dst = (BMP *)malloc(sizeof(BMP));
-    if (dst == NULL) return NULL;
+/** ļͷͼ, dstbmp_encoded_sizeֽ **/
+static void bmp_encode(BMP *bmp, int topdown, unsigned char *dst)
+{
+    int h = 0, preline = 0;
 
-    right = right > bmp->width ? bmp->width : right;
-    bottom = bottom > bmp->height ? bmp->height : bottom;
+    bmp_make_header(bmp, topdown, dst);
+    dst += BMP_HEADER_SIZE;
 
-    dst->width = right - left;
-    dst->height = bottom - top;
-    dst->alpha = 0;
-    dst->size = dst->height * BMP_PERLINE_REALSIZE(dst);
+    preline = BMP_PERLINE_REALSIZE(bmp);
+    if (topdown) {
+        memcpy(dst, bmp->data, (size_t)preline * bmp->height);
+        return;
+    }
 
-    bytepix = bmp->alpha == 1 ? 4 : 3;
+    //תдͼ
+    for (h = 0; h < (int)bmp->height; h++)
+        memcpy(dst + (size_t)h * preline, bmp->data + (size_t)(bmp->height - 1 - h) * preline, preline);
+}
+
+/** 뵽ָڴ, дֽ, ռ䲻㷵0 **/
+size_t bmp_save_mem_to(BMP *bmp, void *buf, size_t len)
+{
+    size_t need = bmp_encoded_size(bmp);
+
+    if (need == 0 || buf == NULL || len < need) return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_SAVE_MEM);
+    bmp_encode(bmp, 0, (unsigned char *)buf);
+    BMP_STAT_END(BMP_STAT_SAVE_MEM, (double)bmp->width * bmp->height);
+    return need;
+}
+
+/** 뵽·ڴ, free **/
+void *bmp_save_mem(BMP *bmp, size_t *len)
+{
+    size_t need = bmp_encoded_size(bmp);
+    void *buf = NULL;
+
+    if (len) *len = 0;
+    if (need == 0 || (buf = malloc(need)) == NULL) return NULL;
+
+    bmp_save_mem_to(bmp, buf, need);
+    if (len) *len = need;
+    return buf;
+}
+
+#ifndef _WIN32
+
+#ifndef BMP_IOV_MAX
+#define BMP_IOV_MAX 1024
+#endif
+
+//O_DIRECTҪĶ
+#ifndef BMP_DIRECT_ALIGN
+#define BMP_DIRECT_ALIGN 4096
+#endif
+
+/** дȫiovec, дźж **/
+static int bmp_writev_all(int fd, struct iovec *iov, int count)
+{
+    ssize_t n = 0;
+    int batch = 0;
+
+    while (count > 0) {
+        //, ֮writev0ʾ޷д
+        if (iov->iov_len == 0) {
+            iov++;
+            count--;
+            continue;
+        }
+        batch = count > BMP_IOV_MAX ? BMP_IOV_MAX : count;
+        n = writev(fd, iov, batch);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        while (count > 0 && n >= (ssize_t)iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0 && n > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 1;
+}
+
+/** O_DIRECTд: 뻺һдضϵʵʳ; ļϵͳܾд(EINVAL)ʱ-1 **/
+static int bmp_save_direct(BMP *bmp, int fd, int topdown)
+{
+    size_t need = bmp_encoded_size(bmp), total = 0;
+    void *buf = NULL;
+    ssize_t n = 0;
+    int recode = 0;
+
+    total = (need + BMP_DIRECT_ALIGN - 1) / BMP_DIRECT_ALIGN * BMP_DIRECT_ALIGN;
+    if (posix_memalign(&buf, BMP_DIRECT_ALIGN, total) != 0) return 0;
+
+    memset((unsigned char *)buf + need, 0, total - need);
+    bmp_encode(bmp, topdown, (unsigned char *)buf);
+    do {
+        n = write(fd, buf, total);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0 && errno == EINVAL)
+        recode = -1;
+    else
+        recode = n == (ssize_t)total && ftruncate(fd, (off_t)need) == 0;
+    free(buf);
+    return recode;
+}
+
+/** ͼ, ɹ1 **/
+static int bmp_save_file(BMP *bmp, const char *file, int flags)
+{
+    unsigned char header[BMP_HEADER_SIZE];
+    struct iovec *iov = NULL, iov2[2];
+    int fd = -1, h = 0, preline = 0, count = 0, recode = 0;
+    int topdown = (flags & BMP_SAVE_TOPDOWN) ? 1 : 0;
+
+    if (BMPNULL(bmp) || STRNULL(file)) return 0;
+
+#ifdef O_DIRECT
+    if (flags & BMP_SAVE_DIRECT) {
+        fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+        if (fd >= 0) {
+            if ((recode = bmp_save_direct(bmp, fd, topdown)) >= 0)
+                goto done;
+            close(fd);
+            recode = 0;
+        }
+        //ļϵͳ֧ʱ(ʧܻд뱻ܾ)˻ͨд
+    }
+#endif
+
+    if ((fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) return 0;
+
+    bmp_make_header(bmp, topdown, header);
+    preline = BMP_PERLINE_REALSIZE(bmp);
+
+    //϶ʱֱд, ÿһiovecд
+    if (topdown) {
+        iov = iov2;
+        iov[1].iov_base = bmp->data;
+        iov[1].iov_len = (size_t)preline * bmp->height;
+        count = 2;
+    } else {
+        iov = (struct iovec *)malloc(sizeof(struct iovec) * (bmp->height + 1));
+        if (iov == NULL) {
+            close(fd);
+            return 0;
+        }
+        for (h = 0; h < (int)bmp->height; h++) {
+            iov[h + 1].iov_base = bmp->data + (size_t)(bmp->height - 1 - h) * preline;
+            iov[h + 1].iov_len = preline;
+        }
+        count = bmp->height + 1;
+    }
+    iov[0].iov_base = header;
+    iov[0].iov_len = BMP_HEADER_SIZE;
+
+    recode = bmp_writev_all(fd, iov, count);
+    if (iov != iov2)
+        free(iov);
+
+#ifdef O_DIRECT
+done:
+#endif
+    if (recode && (flags & BMP_SAVE_SYNC)) {
+#if defined(__linux__)
+        recode = fdatasync(fd) == 0;
+#else
+        recode = fsync(fd) == 0;
+#endif
+    }
+    if (close(fd) != 0)
+        recode = 0;
+    return recode;
+}
+
+#else
+
+/** ͼ, ɹ1 **/
+static int bmp_save_file(BMP *bmp, const char *file, int flags)
+{
+    FILE *fp = NULL;
+    unsigned char *buf = NULL;
+    size_t need = bmp_encoded_size(bmp);
+    int recode = 0;
+
+    if (need == 0 || STRNULL(file)) return 0;
+    if ((buf = (unsigned char *)malloc(need)) == NULL) return 0;
+
+    //ļһд
+    bmp_encode(bmp, (flags & BMP_SAVE_TOPDOWN) ? 1 : 0, buf);
+    if ((fp = fopen(file, "wb")) != NULL) {
+        recode = fwrite(buf, need, 1, fp) == 1;
+        if (recode && (flags & BMP_SAVE_SYNC))
+            recode = fflush(fp) == 0 && _commit(_fileno(fp)) == 0;
+        if (fclose(fp) != 0)
+            recode = 0;
+    }
+    free(buf);
+    return recode;
+}
+
+#endif
+
+/** ͼ, ɹ1 **/
+int bmp_save_ex(BMP *bmp, const char *file, int flags)
+{
+    int recode = 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_SAVE);
+    recode = bmp_save_file(bmp, file, flags);
+    BMP_STAT_END(BMP_STAT_SAVE, recode ? (double)bmp->width * bmp->height : 0);
+    return recode;
+}
+
+void bmp_save(BMP *bmp, const char *file)
+{
+    bmp_save_ex(bmp, file, 0);
+}
+
+void bmp_destroy(BMP **bmp)
+{
+    if (bmp == NULL || *bmp == NULL)
+        return;
+
+    free((*bmp)->data);
+    free(*bmp);
+    *bmp = NULL;
+}
+
+// +---------------------------------------------------------
+// | ͼ
+// +---------------------------------------------------------
+
+/** һͼ **/
+BMP *bmp_copy(BMP *bmp)
+{
+    BMP *dst = NULL;
+
+    if (BMPNULL(bmp)) return NULL;
+
+    BMP_STAT_BEGIN(BMP_STAT_COPY);
+    dst = (BMP *)malloc(sizeof(BMP));
+    if (dst == NULL) {
+        BMP_STAT_END(BMP_STAT_COPY, 0);
+        return NULL;
+    }
+
+    dst->width = bmp->width;
+    dst->height = bmp->height;
+    dst->size = bmp->size;
+    dst->alpha = bmp->alpha;
+    dst->data = (unsigned char *)malloc(bmp->size);
+    if (dst->data == NULL) {
+        free(dst);
+        BMP_STAT_END(BMP_STAT_COPY, 0);
+        return NULL;
+    }
+
+    memcpy(dst->data, bmp->data, dst->size);
+    BMP_STAT_END(BMP_STAT_COPY, (double)bmp->width * bmp->height);
+    return dst;
+}
+
+/** ͼеһ **/
+BMP *bmp_copy_rect(BMP *bmp, int left, int top, int right, int bottom)
+{
+    BMP *dst = NULL;
+
+    int bytepix = 0, perline = 0;
+    int bytepix_dst = 0, perline_dst = 0;
+    int w, h, dstw, dsth;
+    size_t speed, speed_dst;
+    
+    if (BMPNULL(bmp)) return NULL;
+    if (right <= left || bottom <= top) return NULL;
+    
+    BMP_STAT_BEGIN(BMP_STAT_COPY_RECT);
+    dst = (BMP *)malloc(sizeof(BMP));
+    if (dst == NULL) {
+        BMP_STAT_END(BMP_STAT_COPY_RECT, 0);
+        return NULL;
+    }
+
+    right = right > bmp->width ? bmp->width : right;
+    bottom = bottom > bmp->height ? bmp->height : bottom;
+
+    dst->width = right - left;
+    dst->height = bottom - top;
+    dst->alpha = 0;
+    dst->size = (size_t)dst->height * BMP_PERLINE_REALSIZE(dst);
+
+    bytepix = bmp->alpha == 1 ? 4 : 3;
     perline = BMP_PERLINE_REALSIZE(bmp);
 
     bytepix_dst = 3;
@@ -234,13 +922,14 @@ BMP *bmp_copy_rect(BMP *bmp, int left, int top, int right, int bottom)
     dst->data = (unsigned char *)malloc(dst->size);
     if (dst->data == NULL) {
         free(dst);
+        BMP_STAT_END(BMP_STAT_COPY_RECT, 0);
         return NULL;
     }
 
     for (dsth = 0, h = top; h < (int)bottom; h++, dsth++) {
         for (dstw = 0, w = left; w < (int)right; w++, dstw++) {
-            speed = h * perline + w * bytepix;
-            speed_dst = dsth * perline_dst + dstw * bytepix_dst;
+            speed = (size_t)h * perline + w * bytepix;
+            speed_dst = (size_t)dsth * perline_dst + dstw * bytepix_dst;
 
 
             dst->data[speed_dst] = bmp->data[speed];
@@ -249,6 +938,7 @@ BMP *bmp_copy_rect(BMP *bmp, int left, int top, int right, int bottom)
         }
     }
 
+    BMP_STAT_END(BMP_STAT_COPY_RECT, (double)dst->width * dst->height);
     return dst;
 }
 
@@ -257,21 +947,25 @@ void bmp_add_alpha(BMP *bmp)
 {
     BMP buf = {0};
     
-    int w = 0, h = 0, speed = 0;
+    int w = 0, h = 0;
+    size_t speed = 0;
     int bytepix = 0, perline = 0;
     
-    int w2 = 0, h2 = 0, speed2 = 0;
+    int w2 = 0, h2 = 0;
+    size_t speed2 = 0;
     int bytepix2 = 0, perline2 = 0;
     
     if (BMPNULL(bmp) || bmp->alpha == 1) return;
     
     buf = *bmp;
     
+    BMP_STAT_BEGIN(BMP_STAT_ADD_ALPHA);
     bmp->alpha = 1;
-    bmp->size = BMP_PERLINE_REALSIZE(bmp) * bmp->height;
+    bmp->size = (size_t)BMP_PERLINE_REALSIZE(bmp) * bmp->height;
     bmp->data = (unsigned char *)malloc(bmp->size);
     if (bmp->data == NULL) {
         *bmp = buf;
+        BMP_STAT_END(BMP_STAT_ADD_ALPHA, 0);
         return;
     }
     
@@ -293,6 +987,7 @@ void bmp_add_alpha(BMP *bmp)
         speed2 += perline2;
     }
     free(buf.data);
+    BMP_STAT_END(BMP_STAT_ADD_ALPHA, (double)bmp->width * bmp->height);
 }
 
 /** תͼ(BMP) **/
@@ -303,36 +998,49 @@ void bmp_reverse(BMP *bmp)
     
     if (BMPNULL(bmp)) return;
 
+    BMP_STAT_BEGIN(BMP_STAT_REVERSE);
     new_data = (unsigned char *)malloc(bmp->size);
-    if (new_data == NULL) return;
+    if (new_data == NULL) {
+        BMP_STAT_END(BMP_STAT_REVERSE, 0);
+        return;
+    }
 
     preline = BMP_PERLINE_REALSIZE(bmp);
     for (hsrc = 0, hdst = bmp->height - 1; hsrc < (int)bmp->height; hsrc++, hdst--) {
-        src = bmp->data + hsrc * preline;
-        dst = new_data + hdst * preline;
+        src = bmp->data + (size_t)hsrc * preline;
+        dst = new_data + (size_t)hdst * preline;
         memcpy(dst, src, preline);
     }
 
     free(bmp->data);
     bmp->data = new_data;
+    BMP_STAT_END(BMP_STAT_REVERSE, (double)bmp->width * bmp->height);
 }
 
 /** ˮƽת **/
 void bmp_horizontal_flip(BMP *bmp)
 {
-    int i = 0, w = 0, h = 0, speedleft = 0, speedright = 0;
+    int i = 0, w = 0, h = 0;
+    size_t speedleft = 0, speedright = 0;
     int bytepix = 0, perline = 0;
     unsigned char left = 0, right = 0;
 
     if (BMPNULL(bmp)) return;
 
+    BMP_STAT_BEGIN(BMP_STAT_HORIZONTAL_FLIP);
+#ifdef BMP_USE_CXX_KERNELS
+    if (bmp_cxx_horizontal_flip(bmp)) {
+        BMP_STAT_END(BMP_STAT_HORIZONTAL_FLIP, (double)bmp->width * bmp->height);
+        return;
+    }
+#endif
     perline = BMP_PERLINE_REALSIZE(bmp);
     bytepix = bmp->alpha == 1 ? 4 : 3;
 
     for (h = 0; h < (int)bmp->height; h++) {
         for (w = 0; w < (int)bmp->width / 2; w++) {
-            speedleft = h * perline + w * bytepix;
-            speedright = h * perline + (bmp->width - 1 - w) * bytepix;
+            speedleft = (size_t)h * perline + w * bytepix;
+            speedright = (size_t)h * perline + (bmp->width - 1 - w) * bytepix;
             for (i = 0; i < 3; i++) {
                 left = bmp->data[speedleft + i];
                 right = bmp->data[speedright + i];
@@ -341,6 +1049,7 @@ void bmp_horizontal_flip(BMP *bmp)
             }
         }
     }
+    BMP_STAT_END(BMP_STAT_HORIZONTAL_FLIP, (double)bmp->width * bmp->height);
 }
 
 /** ͼת **/
@@ -351,7 +1060,8 @@ void bmp_rotate(BMP *bmp, double angle, int flag, BMPBGR fillclr)
     int w = 0, h = 0, preline_real = 0, bytepix = 0, preline_real_dst = 0;
     int after_mid_x = 0, after_mid_y = 0, before_mid_x = 0, before_mid_y = 0;
     int after_x = 0, after_y = 0, before_x = 0, before_y = 0;
-    int newwidth = 0, newheight = 0, newsize = 0;
+    int newwidth = 0, newheight = 0;
+    size_t newsize = 0;
     unsigned char *tmp = NULL;
 
     if (BMPNULL(bmp)) return;
@@ -369,7 +1079,7 @@ void bmp_rotate(BMP *bmp, double angle, int flag, BMPBGR fillclr)
         newwidth = bmp->width;
         newheight = bmp->height;
         preline_real_dst = BMP_PERLINE_REALSIZE(bmp);
-        newsize = preline_real_dst * newheight;
+        newsize = (size_t)preline_real_dst * newheight;
     } else {
         before_mid_x = bmp->width / 2;
         before_mid_y = bmp->height / 2;
@@ -378,16 +1088,20 @@ void bmp_rotate(BMP *bmp, double angle, int flag, BMPBGR fillclr)
         after_mid_x = bmp->width;
         after_mid_y = bmp->height;
         preline_real_dst = ((newwidth * (bmp->alpha == 1 ? 32 : 24) + 31) / 32 * 4);
-        newsize = preline_real_dst * newheight;
+        newsize = (size_t)preline_real_dst * newheight;
+    }
+    BMP_STAT_BEGIN(BMP_STAT_ROTATE);
+    if ((tmp = (unsigned char *)malloc(newsize)) == NULL) {
+        BMP_STAT_END(BMP_STAT_ROTATE, 0);
+        return;
     }
-    if ((tmp = (unsigned char *)malloc(newsize)) == NULL) return;
 
     //ɫ
     for (h = 0; h < newheight; h++) {
         for (w = 0; w < newwidth; w++) {
-            *(tmp + h * preline_real_dst + w * bytepix + 0) = fillclr.b;
-            *(tmp + h * preline_real_dst + w * bytepix + 1) = fillclr.g;
-            *(tmp + h * preline_real_dst + w * bytepix + 2) = fillclr.r;
+            *(tmp + (size_t)h * preline_real_dst + w * bytepix + 0) = fillclr.b;
+            *(tmp + (size_t)h * preline_real_dst + w * bytepix + 1) = fillclr.g;
+            *(tmp + (size_t)h * preline_real_dst + w * bytepix + 2) = fillclr.r;
         }
     }
 
@@ -399,9 +1113,9 @@ void bmp_rotate(BMP *bmp, double angle, int flag, BMPBGR fillclr)
             before_y = (int)(cos_angle * after_y - sin_angle * after_x) + before_mid_y;
             before_x = (int)(sin_angle * after_y + cos_angle * after_x) + before_mid_x;
             if (before_y >= 0 && before_y < bmp->height && before_x >= 0 && before_x < bmp->width) {
-                *(tmp + h * preline_real_dst + w * bytepix + 0) = *(bmp->data + before_y * preline_real + before_x * bytepix + 0);
-                *(tmp + h * preline_real_dst + w * bytepix + 1) = *(bmp->data + before_y * preline_real + before_x * bytepix + 1);
-                *(tmp + h * preline_real_dst + w * bytepix + 2) = *(bmp->data + before_y * preline_real + before_x * bytepix + 2);
+                *(tmp + (size_t)h * preline_real_dst + w * bytepix + 0) = *(bmp->data + (size_t)before_y * preline_real + before_x * bytepix + 0);
+                *(tmp + (size_t)h * preline_real_dst + w * bytepix + 1) = *(bmp->data + (size_t)before_y * preline_real + before_x * bytepix + 1);
+                *(tmp + (size_t)h * preline_real_dst + w * bytepix + 2) = *(bmp->data + (size_t)before_y * preline_real + before_x * bytepix + 2);
             }
         }
     }
@@ -411,25 +1125,28 @@ void bmp_rotate(BMP *bmp, double angle, int flag, BMPBGR fillclr)
     bmp->height = newheight;
     bmp->size = newsize;
     bmp->data = tmp;
+    BMP_STAT_END(BMP_STAT_ROTATE, (double)newwidth * newheight);
 }
 
 /** ָɫΪɫ, ϻ **/
 void bmp_resize_by_clr(BMP *bmp, BMPBGR bgclr)
 {
     int left = -1, top = -1, right = -1, bottom = -1;
-    int w = 0, h = 0, speed = 0;
+    int w = 0, h = 0;
+    size_t speed = 0;
     int bytepix = 0, perline_real = 0;
     BMP *dst = NULL;
 
     if (BMPNULL(bmp)) return;
 
+    BMP_STAT_BEGIN(BMP_STAT_RESIZE_BY_CLR);
     perline_real = BMP_PERLINE_REALSIZE(bmp);
     bytepix = bmp->alpha == 1 ? 4 : 3;
 
     //
     for (h = 0; h < (int)bmp->height; h++) {
         for (w = 0; w < (int)bmp->width; w++) {
-            speed = h * perline_real + w * bytepix;
+            speed = (size_t)h * perline_real + w * bytepix;
             if (bmp->data[speed] != bgclr.b || bmp->data[speed + 1] != bgclr.g || bmp->data[speed + 2] != bgclr.r) {
                 top = h;
                 break;
@@ -441,7 +1158,7 @@ void bmp_resize_by_clr(BMP *bmp, BMPBGR bgclr)
     //
     for (h = (int)bmp->height - 1; h >= 0; h--) {
         for (w = 0; w < (int)bmp->width; w++) {
-            speed = h * perline_real + w * bytepix;
+            speed = (size_t)h * perline_real + w * bytepix;
             if (bmp->data[speed] != bgclr.b || bmp->data[speed + 1] != bgclr.g || bmp->data[speed + 2] != bgclr.r) {
                 bottom = h;
                 break;
@@ -453,7 +1170,7 @@ void bmp_resize_by_clr(BMP *bmp, BMPBGR bgclr)
     //
     for (w = 0; w < (int)bmp->width; w++) {
         for (h = 0; h < (int)bmp->height; h++) {
-            speed = h * perline_real + w * bytepix;
+            speed = (size_t)h * perline_real + w * bytepix;
             if (bmp->data[speed] != bgclr.b || bmp->data[speed + 1] != bgclr.g || bmp->data[speed + 2] != bgclr.r) {
                 left = w;
                 break;
@@ -465,7 +1182,7 @@ void bmp_resize_by_clr(BMP *bmp, BMPBGR bgclr)
     //
     for (w = (int)bmp->width - 1; w >= 0; w--) {
         for (h = 0; h < (int)bmp->height; h++) {
-            speed = h * perline_real + w * bytepix;
+            speed = (size_t)h * perline_real + w * bytepix;
             if (bmp->data[speed] != bgclr.b || bmp->data[speed + 1] != bgclr.g || bmp->data[speed + 2] != bgclr.r) {
                 right = w;
                 break;
@@ -485,17 +1202,23 @@ void bmp_resize_by_clr(BMP *bmp, BMPBGR bgclr)
             free(dst);
         }
     }
+    BMP_STAT_END(BMP_STAT_RESIZE_BY_CLR, (double)bmp->width * bmp->height);
 }
 
 /** ֱͼ **/
 int *bmp_histogram(BMP *bmp, int offset)
 {
-    int w = 0, h = 0, speed = 0;
+    int w = 0, h = 0;
+    size_t speed = 0;
     int bytepix = 0, perline = 0;
     int *histogram = NULL;
     
-    if (BMPNULL(bmp) || (histogram = (int *)malloc(sizeof(int) * 256)) == NULL)
+    if (BMPNULL(bmp)) return NULL;
+    BMP_STAT_BEGIN(BMP_STAT_HISTOGRAM);
+    if ((histogram = (int *)malloc(sizeof(int) * 256)) == NULL) {
+        BMP_STAT_END(BMP_STAT_HISTOGRAM, 0);
         return NULL;
+    }
     memset(histogram, 0, sizeof(int) * 256);
     
     perline = BMP_PERLINE_SUP(bmp);
@@ -505,6 +1228,7 @@ int *bmp_histogram(BMP *bmp, int offset)
     histogram[bmp->data[speed + offset]]++;
     
     BMP_LOOP_STOP(bmp, speed);
+    BMP_STAT_END(BMP_STAT_HISTOGRAM, (double)bmp->width * bmp->height);
     return histogram;
 }
 
@@ -520,7 +1244,8 @@ BMP *bmp_create_histogram(int *histogram, BMPBGR clr)
 {
     BMP *bmp = NULL;
 
-    int w = 0, h = 0, speed = 0;
+    int w = 0, h = 0;
+    size_t speed = 0;
     int bytepix = 4, perline_realsize = 0;
     int i = 0, max_height = 0;
     
@@ -549,7 +1274,7 @@ BMP *bmp_create_histogram(int *histogram, BMPBGR clr)
     
     for (w = 0; w < 256; w++) {
         for (h = 0; h < histogram[w]; h++) {
-            speed = h * perline_realsize + w *bytepix;
+            speed = (size_t)h * perline_realsize + w *bytepix;
             bmp->data[speed + 0] = clr.b;
             bmp->data[speed + 1] = clr.g;
             bmp->data[speed + 2] = clr.r;
@@ -563,42 +1288,40 @@ BMP *bmp_create_histogram(int *histogram, BMPBGR clr)
 /** תҶͼ **/
 void bmp_convert_gray(BMP *bmp)
 {
-    int w = 0, h = 0, speed = 0;
-    int bytepix = 0, perline = 0;
+    BMPLut lut;
 
     if (BMPNULL(bmp)) return;
 
-    perline = BMP_PERLINE_SUP(bmp);
-    bytepix = bmp->alpha == 1 ? 4 : 3;
-    BMP_LOOP_START(bmp, w, h);
-
-    bmp->data[speed] = bmp->data[speed + 1] = bmp->data[speed + 2] = 
-        (int)(bmp->data[speed + 2] * 0.3 + bmp->data[speed + 1] * 0.59 + bmp->data[speed] * 0.11);
-
-    BMP_LOOP_STOP(bmp, speed);
+    BMP_STAT_BEGIN(BMP_STAT_CONVERT_GRAY);
+#ifdef BMP_USE_CXX_KERNELS
+    if (bmp_cxx_convert_gray(bmp)) {
+        BMP_STAT_END(BMP_STAT_CONVERT_GRAY, (double)bmp->width * bmp->height);
+        return;
+    }
+#endif
+    bmp_lut_init(&lut, BMP_LUT_GRAY);
+    bmp_apply_lut(bmp, &lut);
+    BMP_STAT_END(BMP_STAT_CONVERT_GRAY, (double)bmp->width * bmp->height);
 }
 
 /** ֵ **/
 void bmp_binaryzation(BMP *bmp, int k)
 {
-    int w = 0, h = 0, speed = 0;
-    int bytepix = 0, perline = 0;
-    int avg = 0;
+    BMPLut lut;
 
     if (BMPNULL(bmp)) return;
 
-    perline = BMP_PERLINE_SUP(bmp);
-    bytepix = bmp->alpha == 1 ? 4 : 3;
-    BMP_LOOP_START(bmp, w, h);
-
-    avg = (bmp->data[speed] + bmp->data[speed + 1] + bmp->data[speed + 2]) / 3;
-    if (avg >= k) {
-        bmp->data[speed] = bmp->data[speed + 1] = bmp->data[speed + 2] = 0xff;
-    } else {
-        bmp->data[speed] = bmp->data[speed + 1] = bmp->data[speed + 2] = 0x00;
+    BMP_STAT_BEGIN(BMP_STAT_BINARYZATION);
+#ifdef BMP_USE_CXX_KERNELS
+    if (bmp_cxx_binaryzation(bmp, k)) {
+        BMP_STAT_END(BMP_STAT_BINARYZATION, (double)bmp->width * bmp->height);
+        return;
     }
-
-    BMP_LOOP_STOP(bmp, speed);
+#endif
+    bmp_lut_init(&lut, BMP_LUT_AVERAGE);
+    bmp_lut_threshold(&lut, k);
+    bmp_apply_lut(bmp, &lut);
+    BMP_STAT_END(BMP_STAT_BINARYZATION, (double)bmp->width * bmp->height);
 }
 
 /** otsu㷨 **/
@@ -614,7 +1337,13 @@ int bmp_otsu(BMP *bmp)
     
     float w0, w1, u0tmp, u1tmp, u0, u1, u, deltaTmp, deltaMax = 0;
     
-    if (BMPNULL(bmp) || (buf = bmp_copy(bmp)) == NULL) return 125;
+    if (BMPNULL(bmp)) return 125;
+
+    BMP_STAT_BEGIN(BMP_STAT_OTSU);
+    if ((buf = bmp_copy(bmp)) == NULL) {
+        BMP_STAT_END(BMP_STAT_OTSU, 0);
+        return 125;
+    }
     
     grayhistogram = bmp_grayhistogram(buf);
     pixnum = buf->width * buf->height;
@@ -650,74 +1379,138 @@ int bmp_otsu(BMP *bmp)
     }
     
     bmp_destroy(&buf);
+    free(grayhistogram);
+    BMP_STAT_END(BMP_STAT_OTSU, (double)bmp->width * bmp->height);
     return threshold;
 }
 
-/** ֵ/˲ **/
-static int bmp_average_filter_calc(BMP *bmp, int w, int h, int offset, int box)
+/** ֵ/˲: кͻ, ÿغʱbox޹ **/
+static int bmp_box_sum_filter(BMP *bmp, int box, unsigned char *dst)
 {
-    int x = 0, y = 0, avgvalue = 0, bufw = 0, bufh = 0;
+    int *xmap = NULL;
+    size_t *ymap = NULL;
+    unsigned int *colsum = NULL, sum[3];
+    int x = 0, y = 0, c = 0, i = 0, pw = 0, area = 0;
     int bytepix = 0, perline = 0;
+    const unsigned char *add = NULL, *sub = NULL;
 
+    box = box < 0 ? 0 : box;
+    pw = bmp->width + 2 * box;
+    area = (2 * box + 1) * (2 * box + 1);
     perline = BMP_PERLINE_REALSIZE(bmp);
     bytepix = bmp->alpha == 1 ? 4 : 3;
 
-    for (x = -box; x <= box; x++) {
-        for (y = -box; y <= box; y++) {
-            bufw = (w + y) < 0 ? -(w + y) : (w + y);
-            bufh = (h + x) < 0 ? -(h + x) : (h + x);
-            bufw =  (bufw >= (int)bmp->width) ? bufw - (bufw - (int)bmp->width + 1) : bufw;
-            bufh =  (bufh >= (int)bmp->height) ? bufh - (bufh - (int)bmp->height + 1) : bufh;
-            avgvalue += bmp->data[bufh * perline + bufw * bytepix + offset];
+    xmap = (int *)malloc(sizeof(int) * pw);
+    ymap = (size_t *)malloc(sizeof(size_t) * (bmp->height + 2 * box + 1));
+    colsum = (unsigned int *)malloc(sizeof(unsigned int) * pw * 3);
+    if (xmap == NULL || ymap == NULL || colsum == NULL) {
+        free(xmap);
+        free(ymap);
+        free(colsum);
+        return 0;
+    }
+
+    //Խ: Ͼ, ȡԵ
+    for (i = 0; i < pw; i++) {
+        x = abs(i - box);
+        xmap[i] = (x >= bmp->width ? bmp->width - 1 : x) * bytepix;
+    }
+    for (i = 0; i < bmp->height + 2 * box + 1; i++) {
+        y = abs(i - box);
+        ymap[i] = (size_t)(y >= bmp->height ? bmp->height - 1 : y) * perline;
+    }
+
+    memset(colsum, 0, sizeof(unsigned int) * pw * 3);
+    for (i = 0; i < 2 * box + 1; i++) {
+        add = bmp->data + ymap[i];
+        for (x = 0; x < pw; x++) for (c = 0; c < 3; c++)
+            colsum[x * 3 + c] += add[xmap[x] + c];
+    }
+
+    for (y = 0; y < bmp->height; y++) {
+        //кһ
+        if (y > 0) {
+            add = bmp->data + ymap[y + 2 * box];
+            sub = bmp->data + ymap[y - 1];
+            for (x = 0; x < pw; x++) for (c = 0; c < 3; c++)
+                colsum[x * 3 + c] += add[xmap[x] + c] - sub[xmap[x] + c];
+        }
+
+        sum[0] = sum[1] = sum[2] = 0;
+        for (x = 0; x < 2 * box + 1; x++) for (c = 0; c < 3; c++)
+            sum[c] += colsum[x * 3 + c];
+        for (x = 0; x < bmp->width; x++) {
+            if (x > 0) {
+                for (c = 0; c < 3; c++)
+                    sum[c] += colsum[(x + 2 * box) * 3 + c] - colsum[(x - 1) * 3 + c];
+            }
+            for (c = 0; c < 3; c++)
+                dst[(size_t)y * perline + x * bytepix + c] = (unsigned char)(sum[c] / area);
         }
     }
 
-    box = 2 * box + 1;
-    return avgvalue / (box * box);
+    free(xmap);
+    free(ymap);
+    free(colsum);
+    return 1;
 }
 
 /** ֵ˲ **/
 void bmp_average_filter(BMP *bmp)
 {
-    int w = 0, h = 0, speed = 0;
-    int bytepix = 0, perline = 0;
     unsigned char *tmp = NULL;
     
-    if (BMPNULL(bmp) || (tmp = (unsigned char *)malloc(bmp->size)) == NULL) return;
-    
-    perline = BMP_PERLINE_SUP(bmp);
-    bytepix = bmp->alpha == 1 ? 4 : 3;
-    BMP_LOOP_START(bmp, w, h);
-    
-    tmp[speed]     = bmp_average_filter_calc(bmp, w, h, 0, 1);
-    tmp[speed + 1] = bmp_average_filter_calc(bmp, w, h, 1, 1);
-    tmp[speed + 2] = bmp_average_filter_calc(bmp, w, h, 2, 1);
+    if (BMPNULL(bmp)) return;
 
-    BMP_LOOP_STOP(bmp, speed);
-    free(bmp->data);
-    bmp->data = tmp;
+    BMP_STAT_BEGIN(BMP_STAT_AVERAGE_FILTER);
+#ifdef BMP_USE_CXX_KERNELS
+    if (bmp_cxx_box_filter(bmp, 1)) {
+        BMP_STAT_END(BMP_STAT_AVERAGE_FILTER, (double)bmp->width * bmp->height);
+        return;
+    }
+#endif
+    if ((tmp = (unsigned char *)malloc(bmp->size)) == NULL) {
+        BMP_STAT_END(BMP_STAT_AVERAGE_FILTER, 0);
+        return;
+    }
+    
+    memcpy(tmp, bmp->data, bmp->size);
+    if (bmp_box_sum_filter(bmp, 1, tmp)) {
+        free(bmp->data);
+        bmp->data = tmp;
+    } else {
+        free(tmp);
+    }
+    BMP_STAT_END(BMP_STAT_AVERAGE_FILTER, (double)bmp->width * bmp->height);
 }
 
 /** ˲ **/
 void bmp_box_filter(BMP *bmp, int box)
 {
-    int w = 0, h = 0, speed = 0;
-    int bytepix = 0, perline = 0;
     unsigned char *tmp = NULL;
     
-    if (BMPNULL(bmp) || (tmp = (unsigned char *)malloc(bmp->size)) == NULL) return;
-    
-    perline = BMP_PERLINE_SUP(bmp);
-    bytepix = bmp->alpha == 1 ? 4 : 3;
-    BMP_LOOP_START(bmp, w, h);
+    if (BMPNULL(bmp)) return;
 
-    tmp[speed]     = bmp_average_filter_calc(bmp, w, h, 0, box);
-    tmp[speed + 1] = bmp_average_filter_calc(bmp, w, h, 1, box);
-    tmp[speed + 2] = bmp_average_filter_calc(bmp, w, h, 2, box);
+    BMP_STAT_BEGIN(BMP_STAT_BOX_FILTER);
+#ifdef BMP_USE_CXX_KERNELS
+    if (bmp_cxx_box_filter(bmp, box)) {
+        BMP_STAT_END(BMP_STAT_BOX_FILTER, (double)bmp->width * bmp->height);
+        return;
+    }
+#endif
+    if ((tmp = (unsigned char *)malloc(bmp->size)) == NULL) {
+        BMP_STAT_END(BMP_STAT_BOX_FILTER, 0);
+        return;
+    }
     
-    BMP_LOOP_STOP(bmp, speed);
-    free(bmp->data);
-    bmp->data = tmp;
+    memcpy(tmp, bmp->data, bmp->size);
+    if (bmp_box_sum_filter(bmp, box, tmp)) {
+        free(bmp->data);
+        bmp->data = tmp;
+    } else {
+        free(tmp);
+    }
+    BMP_STAT_END(BMP_STAT_BOX_FILTER, (double)bmp->width * bmp->height);
 }
 
 /** 㷨 **/
@@ -751,7 +1544,7 @@ static int bmp_middle_filter_calc(BMP *bmp, int w, int h, int offset, int box)
 
     value = (int *)malloc(sizeof(int) * box_size);
     if (value == NULL)
-        return bmp->data[h * perline + w * bytepix + offset];
+        return bmp->data[(size_t)h * perline + w * bytepix + offset];
     
     for (x = -box; x <= box; x++) {
         for (y = -box; y <= box; y++) {
@@ -759,7 +1552,7 @@ static int bmp_middle_filter_calc(BMP *bmp, int w, int h, int offset, int box)
             bufh = (h + x) < 0 ? -(h + x) : (h + x);
             bufw =  (bufw >= (int)bmp->width) ? bufw - (bufw - (int)bmp->width + 1) : bufw;
             bufh =  (bufh >= (int)bmp->height) ? bufh - (bufh - (int)bmp->height + 1) : bufh;
-            value[value_i++] = bmp->data[bufh * perline + bufw * bytepix + offset];
+            value[value_i++] = bmp->data[(size_t)bufh * perline + bufw * bytepix + offset];
         }
     }
     
@@ -772,11 +1565,24 @@ static int bmp_middle_filter_calc(BMP *bmp, int w, int h, int offset, int box)
 /** ֵ˲ **/
 void bmp_middle_filter(BMP *bmp, int box)
 {
-    int w = 0, h = 0, speed = 0;
+    int w = 0, h = 0;
+    size_t speed = 0;
     int bytepix = 0, perline = 0;
     unsigned char *tmp = NULL;
     
-    if (BMPNULL(bmp) || (tmp = (unsigned char *)malloc(bmp->size)) == NULL) return;
+    if (BMPNULL(bmp)) return;
+
+    BMP_STAT_BEGIN(BMP_STAT_MIDDLE_FILTER);
+#ifdef BMP_USE_CXX_KERNELS
+    if (bmp_cxx_middle_filter(bmp, box)) {
+        BMP_STAT_END(BMP_STAT_MIDDLE_FILTER, (double)bmp->width * bmp->height);
+        return;
+    }
+#endif
+    if ((tmp = (unsigned char *)malloc(bmp->size)) == NULL) {
+        BMP_STAT_END(BMP_STAT_MIDDLE_FILTER, 0);
+        return;
+    }
     
     perline = BMP_PERLINE_SUP(bmp);
     bytepix = bmp->alpha == 1 ? 4 : 3;
@@ -789,6 +1595,7 @@ void bmp_middle_filter(BMP *bmp, int box)
     BMP_LOOP_STOP(bmp, speed);
     free(bmp->data);
     bmp->data = tmp;
+    BMP_STAT_END(BMP_STAT_MIDDLE_FILTER, (double)bmp->width * bmp->height);
 }
 
 /** ˹ʽ **/
@@ -803,25 +1610,36 @@ static double **bmp_gaussblur(double sigma)
     int i = 0, j = 0;
     int winsize = (1 + (((int)ceil(3 * sigma)) * 2));
     int winsizehalf = winsize / 2;
-    double **result = NULL;
+    double **result = NULL, sum = 0;
     
     result = (double **)malloc(sizeof(double *) * winsize);
     for (i = 0; i < winsize; i++) {
         result[i] = (double *)malloc(sizeof(double) * winsize);
         for (j = 0; j < winsize; j++) {
             result[i][j] = gauss_twice(sigma, i - winsizehalf, j - winsizehalf);
+            sum += result[i][j];
         }
     }
+    //sigmaСʱԶ1, һŲ
+    for (i = 0; i < winsize; i++) for (j = 0; j < winsize; j++)
+        result[i][j] /= sum;
     return result;
 }
 
-/** ˹˲ **/
-void bmp_gaussblur_filter(BMP *bmp, double sigma)
+//Young - van Vliet qʽֻsigmaС0.5ʱ, Сʱ
+#define BMP_GAUSS_IIR_MIN 0.5
+
+/**  6sigma+1 ľ **/
+static void bmp_gaussblur_fir(BMP *bmp, double sigma)
 {
-    int i = 0, j = 0, winsize = 0;
+    int i = 0, winsize = 0;
     double **kern = NULL;
 
-    if (BMPNULL(bmp) || (kern = bmp_gaussblur(sigma)) == NULL) return;
+    BMP_STAT_BEGIN(BMP_STAT_GAUSSBLUR_FILTER);
+    if ((kern = bmp_gaussblur(sigma)) == NULL) {
+        BMP_STAT_END(BMP_STAT_GAUSSBLUR_FILTER, 0);
+        return;
+    }
 
     winsize = (1 + (((int)ceil(3 * sigma)) * 2));
     bmp_convolution_filter(bmp, kern, winsize);
@@ -830,63 +1648,673 @@ void bmp_gaussblur_filter(BMP *bmp, double sigma)
         free(kern[i]);
     }
     free(kern);
+    BMP_STAT_END(BMP_STAT_GAUSSBLUR_FILTER, (double)bmp->width * bmp->height);
 }
 
-/**  **/
-static int bmp_convolution_filter_calc(BMP *bmp, int w, int h, int offset, double **convolu, int size)
+/** ˹˲ **/
+void bmp_gaussblur_filter(BMP *bmp, double sigma)
 {
-    double value = 0.0f;
+    if (BMPNULL(bmp)) return;
 
-    int x = 0, y = 0, bufw = 0, bufh = 0, sizehalf = size / 2;
-    int bytepix = 0, perline_realsize = 0;
-    
-    perline_realsize = BMP_PERLINE_REALSIZE(bmp);
-    bytepix = bmp->alpha == 1 ? 4 : 3;
-    for (x = -sizehalf; x <= sizehalf; x++) {
-        for (y = -sizehalf; y <= sizehalf; y++) {
-            bufw = (w + y) < 0 ? -(w + y) : (w + y);
-            bufh = (h + x) < 0 ? -(h + x) : (h + x);
-            bufw =  (bufw >= (int)bmp->width) ? bufw - (bufw - (int)bmp->width + 1) : bufw;
-            bufh =  (bufh >= (int)bmp->height) ? bufh - (bufh - (int)bmp->height + 1) : bufh;
-            value += bmp->data[bufh * perline_realsize + bufw * bytepix + offset] * convolu[x + sizehalf][y + sizehalf];
+    //sigmaʱõݹ˹, ʱsigma޹
+    if (sigma >= BMP_GAUSS_IIR_SIGMA && sigma >= BMP_GAUSS_IIR_MIN)
+        bmp_gaussblur_iir(bmp, sigma);
+    else
+        bmp_gaussblur_fir(bmp, sigma);
+}
+
+/** ݹ˹ϵ(Young - van Vliet),  B, a[0..2] Ϊһķϵ **/
+static float bmp_gauss_iir_coef(double sigma, float *a)
+{
+    double q = 0, b0 = 0, b1 = 0, b2 = 0, b3 = 0;
+
+    if (sigma >= 2.5)
+        q = 0.98711 * sigma - 0.96330;
+    else
+        q = 3.97156 - 4.14554 * sqrt(1 - 0.26891 * sigma);
+
+    b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+    b1 = 2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q;
+    b2 = -(1.4281 * q * q + 1.26661 * q * q * q);
+    b3 = 0.422205 * q * q * q;
+
+    a[0] = (float)(b1 / b0);
+    a[1] = (float)(b2 / b0);
+    a[2] = (float)(b3 / b0);
+    return (float)(1.0 - (b1 + b2 + b3) / b0);
+}
+
+/** ߽: ĩ֮󰴳uʱ, ݹĳʼΪ u + M * (ĩ - u) **/
+static int bmp_gauss_iir_matrix(double sigma, float B, const float *a, float *m)
+{
+    //ƫڳΰ˥, 12sigmaɺ; ϵͳԵ, λƫһμM
+    int len = (int)(12 * sigma) + 16, k = 0, j = 0;
+    double *d = NULL, g1 = 0, g2 = 0, g3 = 0, v = 0;
+
+    if ((d = (double *)malloc(sizeof(double) * (len + 3))) == NULL) return 0;
+    for (k = 0; k < 3; k++) {
+        //d[0..2]Ϊĩƫ(), ֮ݹ
+        d[0] = d[1] = d[2] = 0;
+        d[2 - k] = 1;
+        for (j = 3; j < len + 3; j++)
+            d[j] = a[0] * d[j - 1] + a[1] * d[j - 2] + a[2] * d[j - 3];
+        //Զ״̬ݹصĩ֮
+        g1 = g2 = g3 = 0;
+        for (j = len + 2; j >= 3; j--) {
+            v = B * d[j] + a[0] * g1 + a[1] * g2 + a[2] * g3;
+            g3 = g2;
+            g2 = g1;
+            g1 = v;
+            if (j <= 5) m[(j - 3) * 3 + k] = (float)v;
+        }
+    }
+    free(d);
+    return 1;
+}
+
+/** ݹĳʼֵ: v[i] = u + sum(m[i][k] * (w[k] - u)), w[k]Ϊk+1 **/
+static void bmp_gauss_iir_edge(const float *m, float u, float w0, float w1, float w2, float *v)
+{
+    int i = 0;
+
+    for (i = 0; i < 3; i++)
+        v[i] = u + m[i * 3] * (w0 - u) + m[i * 3 + 1] * (w1 - u) + m[i * 3 + 2] * (w2 - u);
+}
+
+/** зݹ, ͨͬʱ, ߽簴ظԵش **/
+static void bmp_gauss_iir_row(float *row, int width, float B, const float *a, const float *m)
+{
+    float p1[3], p2[3], p3[3], last[3], e[3], v = 0;
+    int x = 0, c = 0;
+
+    //: ֵ̬ǱԵر
+    for (c = 0; c < 3; c++) {
+        p1[c] = p2[c] = p3[c] = row[c];
+        last[c] = row[(width - 1) * 3 + c];
+    }
+    for (x = 0; x < width; x++) {
+        for (c = 0; c < 3; c++) {
+            v = B * row[x * 3 + c] + a[0] * p1[c] + a[1] * p2[c] + a[2] * p3[c];
+            p3[c] = p2[c];
+            p2[c] = p1[c];
+            p1[c] = row[x * 3 + c] = v;
+        }
+    }
+
+    for (c = 0; c < 3; c++) {
+        //ʱp1..p3Ϊĩ(Ȳ3ʱʼֵ)
+        bmp_gauss_iir_edge(m, last[c], p1[c], p2[c], p3[c], e);
+        p1[c] = e[0];
+        p2[c] = e[1];
+        p3[c] = e[2];
+    }
+    for (x = width - 1; x >= 0; x--) {
+        for (c = 0; c < 3; c++) {
+            v = B * row[x * 3 + c] + a[0] * p1[c] + a[1] * p2[c] + a[2] * p3[c];
+            p3[c] = p2[c];
+            p2[c] = p1[c];
+            p1[c] = row[x * 3 + c] = v;
+        }
+    }
+}
+
+/** зݹһ: ͬʱ,  **/
+static void bmp_gauss_iir_col(float *dst, const float *p1, const float *p2, const float *p3, int n, float B, const float *a)
+{
+    float a0 = a[0], a1 = a[1], a2 = a[2];
+    int i = 0;
+
+    for (i = 0; i < n; i++)
+        dst[i] = B * dst[i] + a0 * p1[i] + a1 * p2[i] + a2 * p3[i];
+}
+
+/** ݹ˹˲, ÿغʱsigma޹, ߽簴ظԵش **/
+void bmp_gaussblur_iir(BMP *bmp, double sigma)
+{
+    float *buf = NULL, *edge = NULL, *last = NULL, *row = NULL, B = 0, a[3], m[9], e[3];
+    int w = 0, h = 0, c = 0, v = 0, n = 0, i = 0, p1 = 0, p2 = 0, p3 = 0;
+    int bytepix = 0, perline = 0;
+    unsigned char *src = NULL;
+
+    if (BMPNULL(bmp) || sigma <= 0) return;
+    if (sigma < BMP_GAUSS_IIR_MIN) {
+        bmp_gaussblur_fir(bmp, sigma);
+        return;
+    }
+
+    BMP_STAT_BEGIN(BMP_STAT_GAUSSBLUR_IIR);
+    n = bmp->width * 3;
+    B = bmp_gauss_iir_coef(sigma, a);
+    buf = (float *)malloc(sizeof(float) * (size_t)n * bmp->height);
+    //edge: ߽, last: зһ
+    edge = (float *)malloc(sizeof(float) * n * 4);
+    if (buf == NULL || edge == NULL || !bmp_gauss_iir_matrix(sigma, B, a, m)) {
+        free(buf);
+        free(edge);
+        BMP_STAT_END(BMP_STAT_GAUSSBLUR_IIR, 0);
+        return;
+    }
+    last = edge + (size_t)n * 3;
+
+    perline = BMP_PERLINE_REALSIZE(bmp);
+    bytepix = bmp->alpha == 1 ? 4 : 3;
+
+    for (h = 0; h < bmp->height; h++) {
+        src = bmp->data + (size_t)h * perline;
+        row = buf + (size_t)h * n;
+        for (w = 0; w < bmp->width; w++) for (c = 0; c < 3; c++)
+            row[w * 3 + c] = src[w * bytepix + c];
+        bmp_gauss_iir_row(row, bmp->width, B, a, m);
+    }
+
+    //з, ϱ߽ȡһ
+    memcpy(edge, buf, sizeof(float) * n);
+    memcpy(last, buf + (size_t)(bmp->height - 1) * n, sizeof(float) * n);
+    for (h = 0; h < bmp->height; h++) {
+        p1 = h - 1;
+        p2 = h - 2;
+        p3 = h - 3;
+        bmp_gauss_iir_col(buf + (size_t)h * n,
+            p1 < 0 ? edge : buf + (size_t)p1 * n,
+            p2 < 0 ? edge : buf + (size_t)p2 * n,
+            p3 < 0 ? edge : buf + (size_t)p3 * n, n, B, a);
+    }
+
+    //з, ±߽а߽ĩ(߶Ȳ3ʱȡĳʼֵ)
+    p1 = bmp->height - 1;
+    p2 = bmp->height - 2;
+    p3 = bmp->height - 3;
+    for (i = 0; i < n; i++) {
+        bmp_gauss_iir_edge(m, last[i], buf[(size_t)p1 * n + i],
+            p2 < 0 ? edge[i] : buf[(size_t)p2 * n + i],
+            p3 < 0 ? edge[i] : buf[(size_t)p3 * n + i], e);
+        edge[i] = e[0];
+        edge[n + i] = e[1];
+        edge[2 * n + i] = e[2];
+    }
+    for (h = bmp->height - 1; h >= 0; h--) {
+        p1 = h + 1;
+        p2 = h + 2;
+        p3 = h + 3;
+        bmp_gauss_iir_col(buf + (size_t)h * n,
+            p1 >= bmp->height ? edge + (size_t)(p1 - bmp->height) * n : buf + (size_t)p1 * n,
+            p2 >= bmp->height ? edge + (size_t)(p2 - bmp->height) * n : buf + (size_t)p2 * n,
+            p3 >= bmp->height ? edge + (size_t)(p3 - bmp->height) * n : buf + (size_t)p3 * n, n, B, a);
+    }
+
+    for (h = 0; h < bmp->height; h++) {
+        src = bmp->data + (size_t)h * perline;
+        row = buf + (size_t)h * n;
+        for (w = 0; w < bmp->width; w++) for (c = 0; c < 3; c++) {
+            v = (int)(row[w * 3 + c] + 0.5f);
+            src[w * bytepix + c] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
         }
     }
 
-    return (int)value;
+    free(buf);
+    free(edge);
+    BMP_STAT_END(BMP_STAT_GAUSSBLUR_IIR, (double)bmp->width * bmp->height);
+}
+
+/** size x size doubleתΪ **/
+static BMPKernel *bmp_kernel_from_matrix(double **convolu, int size)
+{
+    BMPKernel *kernel = NULL;
+    float *taps = NULL;
+    int i = 0, j = 0;
+
+    if ((taps = (float *)malloc(sizeof(float) * size * size)) != NULL) {
+        for (i = 0; i < size; i++) for (j = 0; j < size; j++)
+            taps[i * size + j] = (float)convolu[i][j];
+        kernel = bmp_kernel_create(taps, size, size);
+        free(taps);
+    }
+    return kernel;
 }
 
 /**  **/
 void bmp_convolution_filter(BMP *bmp, double **convolu, int size)
 {
-    int w = 0, h = 0, speed = 0;
+    BMPKernel *kernel = NULL;
+    BMPBGR fillclr = {0, 0, 0};
+
+    if (BMPNULL(bmp) || !convolu || size <= 0) return;
+
+    BMP_STAT_BEGIN(BMP_STAT_CONVOLUTION_FILTER);
+    kernel = bmp_kernel_from_matrix(convolu, size);
+
+    //, 벢
+    bmp_convolve(bmp, kernel, BMP_BORDER_MIRROR, fillclr);
+    bmp_kernel_destroy(&kernel);
+    BMP_STAT_END(BMP_STAT_CONVOLUTION_FILTER, (double)bmp->width * bmp->height);
+}
+
+// +---------------------------------------------------------
+// | 
+// +---------------------------------------------------------
+
+struct BMPKernel
+{
+    int width, height;
+    float *taps;                //ԭʼϵ
+    int *fixed, shift;          //άϵ
+    int separable;
+    int *row, rshift;           //ɷʱ/жϵ
+    int *col, cshift;
+    int hsym, vsym;             ///зԳ
+};
+
+//мСλ
+#define BMP_CONV_FRAC 6
+
+/** ѡ񶨵λ: ϵint16, ۼӲint32 **/
+static int bmp_kernel_shift(const float *taps, int n, double input_max)
+{
+    double maxv = 0, sum = 0;
+    int i = 0, shift = 24;
+
+    for (i = 0; i < n; i++) {
+        if (fabs(taps[i]) > maxv) maxv = fabs(taps[i]);
+        sum += fabs(taps[i]);
+    }
+    while (shift > 0 && (maxv * (1 << shift) > 32767.0 || input_max * sum * (1 << shift) > 2147483647.0))
+        shift--;
+    if (maxv * (1 << shift) > 32767.0 || input_max * sum * (1 << shift) > 2147483647.0)
+        return -1;
+    return shift;
+}
+
+/** ϵ **/
+static void bmp_kernel_quantize(const float *taps, int n, int shift, int *fixed)
+{
+    int i = 0;
+
+    for (i = 0; i < n; i++)
+        fixed[i] = (int)floor(taps[i] * (1 << shift) + 0.5);
+}
+
+/** ϵǷԳ **/
+static int bmp_kernel_symmetric(const int *fixed, int n, int stride)
+{
+    int i = 0;
+
+    for (i = 0; i < n / 2; i++) {
+        if (fixed[i * stride] != fixed[(n - 1 - i) * stride])
+            return 0;
+    }
+    return 1;
+}
+
+/** ֽΪ  x , ɷ뷵1 **/
+static int bmp_kernel_factor(const float *taps, int width, int height, float *row, float *col)
+{
+    int i = 0, j = 0, pr = 0, pc = 0;
+    double maxv = 0, pivot = 0;
+
+    for (i = 0; i < height; i++) for (j = 0; j < width; j++) {
+        if (fabs(taps[i * width + j]) > maxv) {
+            maxv = fabs(taps[i * width + j]);
+            pr = i;
+            pc = j;
+        }
+    }
+    if (maxv == 0) return 0;
+
+    pivot = taps[pr * width + pc];
+    for (j = 0; j < width; j++)
+        row[j] = taps[pr * width + j];
+    for (i = 0; i < height; i++)
+        col[i] = (float)(taps[i * width + pc] / pivot);
+
+    for (i = 0; i < height; i++) for (j = 0; j < width; j++) {
+        if (fabs((double)col[i] * row[j] - taps[i * width + j]) > maxv * 1e-5)
+            return 0;
+    }
+    return 1;
+}
+
+/** (ϵ, Ϊ) **/
+BMPKernel *bmp_kernel_create(const float *taps, int width, int height)
+{
+    BMPKernel *kernel = NULL;
+    float *row = NULL, *col = NULL;
+    double rowsum = 0;
+    int i = 0, n = width * height;
+
+    if (taps == NULL || width <= 0 || height <= 0 || width % 2 == 0 || height % 2 == 0) return NULL;
+
+    if ((kernel = (BMPKernel *)malloc(sizeof(BMPKernel))) == NULL) return NULL;
+    memset(kernel, 0, sizeof(BMPKernel));
+    kernel->width = width;
+    kernel->height = height;
+
+    kernel->taps = (float *)malloc(sizeof(float) * n);
+    kernel->fixed = (int *)malloc(sizeof(int) * n);
+    kernel->row = (int *)malloc(sizeof(int) * width);
+    kernel->col = (int *)malloc(sizeof(int) * height);
+    row = (float *)malloc(sizeof(float) * width);
+    col = (float *)malloc(sizeof(float) * height);
+    if (!kernel->taps || !kernel->fixed || !kernel->row || !kernel->col || !row || !col)
+        goto fail;
+
+    memcpy(kernel->taps, taps, sizeof(float) * n);
+    if ((kernel->shift = bmp_kernel_shift(taps, n, 255.0)) < 0)
+        goto fail;
+    bmp_kernel_quantize(taps, n, kernel->shift, kernel->fixed);
+    //ά·иϵ, ͬ
+    kernel->vsym = 1;
+    for (i = 0; i < height / 2 && kernel->vsym; i++)
+        kernel->vsym = memcmp(kernel->fixed + i * width, kernel->fixed + (height - 1 - i) * width, sizeof(int) * width) == 0;
+
+    //ɷʱзBMP_CONV_FRACλС, зڴ˻ۼ
+    if (bmp_kernel_factor(taps, width, height, row, col)) {
+        for (i = 0; i < width; i++)
+            rowsum += fabs(row[i]);
+        kernel->rshift = bmp_kernel_shift(row, width, 255.0);
+        kernel->cshift = bmp_kernel_shift(col, height, 255.0 * (1 << BMP_CONV_FRAC) * rowsum);
+        if (kernel->rshift >= 0 && kernel->cshift >= 0) {
+            bmp_kernel_quantize(row, width, kernel->rshift, kernel->row);
+            bmp_kernel_quantize(col, height, kernel->cshift, kernel->col);
+            kernel->hsym = bmp_kernel_symmetric(kernel->row, width, 1);
+            kernel->vsym = bmp_kernel_symmetric(kernel->col, height, 1);
+            kernel->separable = 1;
+        }
+    }
+
+    free(row);
+    free(col);
+    return kernel;
+
+fail:
+    free(row);
+    free(col);
+    bmp_kernel_destroy(&kernel);
+    return NULL;
+}
+
+/** (int16ϵ, ʵֵΪ taps / 2^shift) **/
+BMPKernel *bmp_kernel_create_fixed(const short *taps, int width, int height, int shift)
+{
+    BMPKernel *kernel = NULL;
+    float *buf = NULL;
+    int i = 0;
+
+    if (taps == NULL || width <= 0 || height <= 0 || shift < 0 || shift > 15) return NULL;
+    if ((buf = (float *)malloc(sizeof(float) * width * height)) == NULL) return NULL;
+
+    for (i = 0; i < width * height; i++)
+        buf[i] = (float)taps[i] / (float)(1 << shift);
+    kernel = bmp_kernel_create(buf, width, height);
+    free(buf);
+    return kernel;
+}
+
+/** Ԥþ **/
+BMPKernel *bmp_kernel_preset(int type)
+{
+    static const float sobel_x[9] = {-1, 0, 1, -2, 0, 2, -1, 0, 1};
+    static const float sobel_y[9] = {-1, -2, -1, 0, 0, 0, 1, 2, 1};
+    static const float sharpen[9] = {0, -1, 0, -1, 5, -1, 0, -1, 0};
+    static const float emboss[9]  = {-2, -1, 0, -1, 1, 1, 0, 1, 2};
+
+    switch (type) {
+    case BMP_KERNEL_SOBEL_X: return bmp_kernel_create(sobel_x, 3, 3);
+    case BMP_KERNEL_SOBEL_Y: return bmp_kernel_create(sobel_y, 3, 3);
+    case BMP_KERNEL_SHARPEN: return bmp_kernel_create(sharpen, 3, 3);
+    case BMP_KERNEL_EMBOSS:  return bmp_kernel_create(emboss, 3, 3);
+    }
+    return NULL;
+}
+
+/** Ƿ񰴿ɷ **/
+int bmp_kernel_separable(BMPKernel *kernel)
+{
+    return kernel ? kernel->separable : 0;
+}
+
+/** ͷž **/
+void bmp_kernel_destroy(BMPKernel **kernel)
+{
+    if (kernel == NULL || *kernel == NULL)
+        return;
+
+    free((*kernel)->taps);
+    free((*kernel)->fixed);
+    free((*kernel)->row);
+    free((*kernel)->col);
+    free(*kernel);
+    *kernel = NULL;
+}
+
+/** ߽ӳ, ʱ-1 **/
+static int bmp_border_index(int i, int n, int border)
+{
+    if (i >= 0 && i < n) return i;
+    if (border == BMP_BORDER_CONSTANT) return -1;
+    if (border == BMP_BORDER_REPLICATE || n == 1) return i < 0 ? 0 : n - 1;
+
+    //, 뾶ͼʱ۷
+    while (i < 0 || i >= n)
+        i = i < 0 ? -i : 2 * n - 2 - i;
+    return i;
+}
+
+/** ȡһͨһԲñ߽, ֮ѭж **/
+static void bmp_pad_plane(BMP *bmp, int offset, int rx, int ry, int border, unsigned char fill, unsigned char *plane)
+{
+    int x = 0, y = 0, sx = 0, sy = 0;
+    int pw = bmp->width + 2 * rx, ph = bmp->height + 2 * ry;
+    int bytepix = bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(bmp);
+    const unsigned char *src = NULL;
+    unsigned char *dst = NULL;
+
+    for (y = 0; y < ph; y++) {
+        dst = plane + (size_t)y * pw;
+        if ((sy = bmp_border_index(y - ry, bmp->height, border)) < 0) {
+            memset(dst, fill, pw);
+            continue;
+        }
+        src = bmp->data + (size_t)sy * perline + offset;
+        for (x = 0; x < bmp->width; x++)
+            dst[rx + x] = src[x * bytepix];
+        for (x = 0; x < rx; x++) {
+            sx = bmp_border_index(x - rx, bmp->width, border);
+            dst[x] = sx < 0 ? fill : dst[rx + sx];
+            sx = bmp_border_index(bmp->width + x, bmp->width, border);
+            dst[rx + bmp->width + x] = sx < 0 ? fill : dst[rx + sx];
+        }
+    }
+}
+
+/** acc[x] += q * (src[x] + src2[x]), src2ΪNULL **/
+static void bmp_conv_mac_u8(int *acc, const unsigned char *src, const unsigned char *src2, int q, int n)
+{
+    int x = 0;
+#ifdef __AVX2__
+    __m256i vq = _mm256_set1_epi32(q), v;
+
+    for (; x + 8 <= n; x += 8) {
+        v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + x)));
+        if (src2)
+            v = _mm256_add_epi32(v, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src2 + x))));
+        v = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(acc + x)), _mm256_mullo_epi32(v, vq));
+        _mm256_storeu_si256((__m256i *)(acc + x), v);
+    }
+#endif
+    if (src2) {
+        for (; x < n; x++) acc[x] += q * (src[x] + src2[x]);
+    } else {
+        for (; x < n; x++) acc[x] += q * src[x];
+    }
+}
+
+/** acc[x] += q * (src[x] + src2[x]), 32λм **/
+static void bmp_conv_mac_i32(int *acc, const int *src, const int *src2, int q, int n)
+{
+    int x = 0;
+#ifdef __AVX2__
+    __m256i vq = _mm256_set1_epi32(q), v;
+
+    for (; x + 8 <= n; x += 8) {
+        v = _mm256_loadu_si256((const __m256i *)(src + x));
+        if (src2)
+            v = _mm256_add_epi32(v, _mm256_loadu_si256((const __m256i *)(src2 + x)));
+        v = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(acc + x)), _mm256_mullo_epi32(v, vq));
+        _mm256_storeu_si256((__m256i *)(acc + x), v);
+    }
+#endif
+    if (src2) {
+        for (; x < n; x++) acc[x] += q * (src[x] + src2[x]);
+    } else {
+        for (; x < n; x++) acc[x] += q * src[x];
+    }
+}
+
+/** 벢͵0~255 **/
+static void bmp_conv_pack(const int *acc, int shift, unsigned char *dst, int n)
+{
+    int x = 0, v = 0, round = shift > 0 ? 1 << (shift - 1) : 0;
+#ifdef __AVX2__
+    __m256i vr = _mm256_set1_epi32(round), a, b;
+    __m128i s = _mm_cvtsi32_si128(shift), p;
+
+    for (; x + 16 <= n; x += 16) {
+        a = _mm256_sra_epi32(_mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(acc + x)), vr), s);
+        b = _mm256_sra_epi32(_mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(acc + x + 8)), vr), s);
+        a = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+        p = _mm_packus_epi16(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+        _mm_storeu_si128((__m128i *)(dst + x), p);
+    }
+#endif
+    for (; x < n; x++) {
+        v = (acc[x] + round) >> shift;
+        dst[x] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+}
+
+/** άһͨ **/
+static void bmp_conv_plane_2d(BMPKernel *kernel, const unsigned char *plane, int pw, int width, int height,
+    int *acc, unsigned char *line, unsigned char *dst, int bytepix, int perline)
+{
+    int x = 0, y = 0, i = 0, j = 0, q = 0, rows = 0;
+    const unsigned char *src = NULL, *src2 = NULL;
+
+    rows = kernel->vsym ? (kernel->height + 1) / 2 : kernel->height;
+    for (y = 0; y < height; y++) {
+        memset(acc, 0, sizeof(int) * width);
+        for (i = 0; i < rows; i++) {
+            for (j = 0; j < kernel->width; j++) {
+                if ((q = kernel->fixed[i * kernel->width + j]) == 0) continue;
+                src = plane + (size_t)(y + i) * pw + j;
+                //¶ԳʱкϲΪһγ˷
+                src2 = kernel->vsym && i != kernel->height - 1 - i ?
+                    plane + (size_t)(y + kernel->height - 1 - i) * pw + j : NULL;
+                bmp_conv_mac_u8(acc, src, src2, q, width);
+            }
+        }
+        bmp_conv_pack(acc, kernel->shift, line, width);
+        for (x = 0; x < width; x++)
+            dst[(size_t)y * perline + x * bytepix] = line[x];
+    }
+}
+
+/** ɷ붨һͨ **/
+static void bmp_conv_plane_sep(BMPKernel *kernel, const unsigned char *plane, int pw, int ph, int width, int height,
+    int *acc, int *tmp, unsigned char *line, unsigned char *dst, int bytepix, int perline)
+{
+    int x = 0, y = 0, i = 0, q = 0, taps = 0, down = kernel->rshift - BMP_CONV_FRAC;
+    const unsigned char *src = NULL;
+    int *row = NULL;
+
+    //з
+    taps = kernel->hsym ? (kernel->width + 1) / 2 : kernel->width;
+    for (y = 0; y < ph; y++) {
+        row = tmp + (size_t)y * width;
+        src = plane + (size_t)y * pw;
+        memset(row, 0, sizeof(int) * width);
+        for (i = 0; i < taps; i++) {
+            if ((q = kernel->row[i]) == 0) continue;
+            bmp_conv_mac_u8(row, src + i, kernel->hsym && i != kernel->width - 1 - i ?
+                src + kernel->width - 1 - i : NULL, q, width);
+        }
+        if (down > 0) {
+            for (x = 0; x < width; x++) row[x] = (row[x] + (1 << (down - 1))) >> down;
+        } else if (down < 0) {
+            for (x = 0; x < width; x++) row[x] <<= -down;
+        }
+    }
+
+    //з
+    taps = kernel->vsym ? (kernel->height + 1) / 2 : kernel->height;
+    for (y = 0; y < height; y++) {
+        memset(acc, 0, sizeof(int) * width);
+        for (i = 0; i < taps; i++) {
+            if ((q = kernel->col[i]) == 0) continue;
+            bmp_conv_mac_i32(acc, tmp + (size_t)(y + i) * width, kernel->vsym && i != kernel->height - 1 - i ?
+                tmp + (size_t)(y + kernel->height - 1 - i) * width : NULL, q, width);
+        }
+        bmp_conv_pack(acc, kernel->cshift + BMP_CONV_FRAC, line, width);
+        for (x = 0; x < width; x++)
+            dst[(size_t)y * perline + x * bytepix] = line[x];
+    }
+}
+
+/** , borderΪBMP_BORDER_*, ʱʹfillclr **/
+void bmp_convolve(BMP *bmp, BMPKernel *kernel, int border, BMPBGR fillclr)
+{
+    unsigned char *plane = NULL, *line = NULL;
+    int *acc = NULL, *tmp = NULL;
+    int rx = 0, ry = 0, pw = 0, ph = 0, c = 0;
     int bytepix = 0, perline = 0;
-    unsigned char *tmp = NULL;
-    
-    if (BMPNULL(bmp) || !convolu || (tmp = (unsigned char *)malloc(bmp->size)) == NULL) return;
-    
-    perline = BMP_PERLINE_SUP(bmp);
+    unsigned char fill[3];
+
+    if (BMPNULL(bmp) || kernel == NULL) return;
+
+    BMP_STAT_BEGIN(BMP_STAT_CONVOLVE);
+    rx = kernel->width / 2;
+    ry = kernel->height / 2;
+    pw = bmp->width + 2 * rx;
+    ph = bmp->height + 2 * ry;
     bytepix = bmp->alpha == 1 ? 4 : 3;
-    BMP_LOOP_START(bmp, w, h);
-    
-    tmp[speed]     = bmp_convolution_filter_calc(bmp, w, h, 0, convolu, size);
-    tmp[speed + 1] = bmp_convolution_filter_calc(bmp, w, h, 1, convolu, size);
-    tmp[speed + 2] = bmp_convolution_filter_calc(bmp, w, h, 2, convolu, size);
-    
-    BMP_LOOP_STOP(bmp, speed);
-    free(bmp->data);
-    bmp->data = tmp;
+    perline = BMP_PERLINE_REALSIZE(bmp);
+    fill[0] = (unsigned char)fillclr.b;
+    fill[1] = (unsigned char)fillclr.g;
+    fill[2] = (unsigned char)fillclr.r;
+
+    plane = (unsigned char *)malloc((size_t)pw * ph);
+    line = (unsigned char *)malloc(bmp->width);
+    acc = (int *)malloc(sizeof(int) * bmp->width);
+    if (kernel->separable)
+        tmp = (int *)malloc(sizeof(int) * (size_t)ph * bmp->width);
+
+    if (plane && line && acc && (tmp || !kernel->separable)) {
+        //ͨĸ, ֱдԭͼ
+        for (c = 0; c < 3; c++) {
+            bmp_pad_plane(bmp, c, rx, ry, border, fill[c], plane);
+            if (kernel->separable) {
+                bmp_conv_plane_sep(kernel, plane, pw, ph, bmp->width, bmp->height, acc, tmp, line,
+                    bmp->data + c, bytepix, perline);
+            } else {
+                bmp_conv_plane_2d(kernel, plane, pw, bmp->width, bmp->height, acc, line,
+                    bmp->data + c, bytepix, perline);
+            }
+        }
+    }
+
+    free(plane);
+    free(line);
+    free(acc);
+    free(tmp);
+    BMP_STAT_END(BMP_STAT_CONVOLVE, (double)bmp->width * bmp->height);
 }
 
-/** Աbmp1, bmp2 **/
-int bmp_contrast(BMP *bmp1, BMP *bmp2)
+/** ضԱ **/
+static int bmp_contrast_calc(BMP *bmp1, BMP *bmp2)
 {
     int w = 0, h = 0;
-    int speed1 = 0, perline1 = 0, bytepix1 = 0;
-    int speed2 = 0, perline2 = 0, bytepix2 = 0;
-
-    if (BMPNULL(bmp1) || BMPNULL(bmp2)) return 0;
-    if (bmp1->width != bmp2->width || bmp1->height != bmp2->height)
-        return 0;
+    size_t speed1 = 0, speed2 = 0;
+    int perline1 = 0, bytepix1 = 0;
+    int perline2 = 0, bytepix2 = 0;
 
     perline1 = BMP_PERLINE_REALSIZE(bmp1);
     bytepix1 = bmp1->alpha == 1 ? 4 : 3;
@@ -895,8 +2323,8 @@ int bmp_contrast(BMP *bmp1, BMP *bmp2)
 
     for (h = 0; h < (int)bmp1->height; h++) {
         for (w = 0; w < (int)bmp1->width; w++) {
-            speed1 = h * perline1 + w * bytepix1;
-            speed2 = h * perline2 + w * bytepix2;
+            speed1 = (size_t)h * perline1 + w * bytepix1;
+            speed2 = (size_t)h * perline2 + w * bytepix2;
             
             if (bmp1->data[speed1] != bmp2->data[speed2] || 
                 bmp1->data[speed1 + 1] != bmp2->data[speed2 + 1] ||
@@ -907,6 +2335,21 @@ int bmp_contrast(BMP *bmp1, BMP *bmp2)
     return 1;
 }
 
+/** Աbmp1, bmp2 **/
+int bmp_contrast(BMP *bmp1, BMP *bmp2)
+{
+    int recode = 0;
+
+    if (BMPNULL(bmp1) || BMPNULL(bmp2)) return 0;
+    if (bmp1->width != bmp2->width || bmp1->height != bmp2->height)
+        return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_CONTRAST);
+    recode = bmp_contrast_calc(bmp1, bmp2);
+    BMP_STAT_END(BMP_STAT_CONTRAST, (double)bmp1->width * bmp1->height);
+    return recode;
+}
+
 static int bmp_search_ex(BMP *bmp, int w, int h, BMP *bmp2)
 {
     BMP *bmp3 = NULL;
@@ -920,15 +2363,12 @@ static int bmp_search_ex(BMP *bmp, int w, int h, BMP *bmp2)
     return recode;
 }
 
-/** bmpѰbmp2 **/
-int bmp_search(BMP *bmp, BMP *bmp2, int *x, int *y)
+/** λò **/
+static int bmp_search_calc(BMP *bmp, BMP *bmp2, int *x, int *y)
 {
     int w = 0, h = 0;
     int w_size = 0, h_size = 0;   //bmpɨ跶Χ
 
-    if (BMPNULL(bmp) || BMPNULL(bmp2)) return 0;
-    if (bmp->width < bmp2->width || bmp->height < bmp2->height) return 0;
-
     w_size = (int)bmp->width - (int)bmp2->width;
     h_size = (int)bmp->height - (int)bmp2->height;
 
@@ -942,10 +2382,4038 @@ int bmp_search(BMP *bmp, BMP *bmp2, int *x, int *y)
     return 0;
 }
 
-/*
-void function(BMP *bmp)
+/** bmpѰbmp2 **/
+int bmp_search(BMP *bmp, BMP *bmp2, int *x, int *y)
+{
+    int recode = 0;
+
+    if (BMPNULL(bmp) || BMPNULL(bmp2)) return 0;
+    if (bmp->width < bmp2->width || bmp->height < bmp2->height) return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_SEARCH);
+    recode = bmp_search_calc(bmp, bmp2, x, y);
+    BMP_STAT_END(BMP_STAT_SEARCH, (double)bmp->width * bmp->height);
+    return recode;
+}
+
+// +---------------------------------------------------------
+// | 첽д
+// +---------------------------------------------------------
+
+struct BMPAsync
+{
+    int save;                   //0 ȡ, 1 
+    char *file;
+    BMP *bmp;
+    int result, done;
+    int finished;               //صѷ
+    BMPAsyncCallback callback;
+    void *userdata;
+    BMPAsync *next;
+};
+
+/** ִһ **/
+static void bmp_async_run(BMPAsync *req)
 {
-    int w = 0, h = 0, speed = 0;
+    if (req->save) {
+        req->result = bmp_save_ex(req->bmp, req->file, 0);
+    } else {
+        req->bmp = bmp_load(req->file);
+        req->result = req->bmp != NULL;
+    }
+}
+
+#ifndef BMP_NO_THREAD
+
+//stopbmp_async_shutdownڼΪ1, ʱͶ
+static struct
+{
+    bmp_mutex_t lock;
+    bmp_cond_t queue_cond, done_cond;
+    BMPAsync *head, *tail;
+    int started, stop;
+}bmp_async_pool = {BMP_MUTEX_INIT, BMP_COND_INIT, BMP_COND_INIT, NULL, NULL, 0, 0};
+static bmp_thread_t bmp_async_threads[BMP_ASYNC_THREADS];
+
+/** ߳ **/
+BMP_THREAD_PROC(bmp_async_worker, arg)
+{
+    BMPAsync *req = NULL;
+
+    (void)arg;
+    for (;;) {
+        bmp_mutex_lock(&bmp_async_pool.lock);
+        while (bmp_async_pool.head == NULL && !bmp_async_pool.stop)
+            bmp_cond_wait(&bmp_async_pool.queue_cond, &bmp_async_pool.lock);
+        if (bmp_async_pool.head == NULL) {
+            bmp_mutex_unlock(&bmp_async_pool.lock);
+            break;
+        }
+        req = bmp_async_pool.head;
+        bmp_async_pool.head = req->next;
+        if (bmp_async_pool.head == NULL)
+            bmp_async_pool.tail = NULL;
+        bmp_mutex_unlock(&bmp_async_pool.lock);
+
+        bmp_async_run(req);
+
+        bmp_mutex_lock(&bmp_async_pool.lock);
+        req->done = 1;
+        bmp_cond_broadcast(&bmp_async_pool.done_cond);
+        bmp_mutex_unlock(&bmp_async_pool.lock);
+
+        //صпbmp_async_waitȡý
+        if (req->callback)
+            req->callback(req, req->result, req->userdata);
+
+        bmp_mutex_lock(&bmp_async_pool.lock);
+        req->finished = 1;
+        bmp_cond_broadcast(&bmp_async_pool.done_cond);
+        bmp_mutex_unlock(&bmp_async_pool.lock);
+    }
+    BMP_THREAD_RETURN;
+}
+
+/** Ͷ, Ҫʱ߳; ڹرջ޷߳ʱ0 **/
+static int bmp_async_submit(BMPAsync *req)
+{
+    int i = 0;
+
+    bmp_mutex_lock(&bmp_async_pool.lock);
+    //رڼ乤߳̿˳, Ͷݺ˴
+    if (bmp_async_pool.stop) {
+        bmp_mutex_unlock(&bmp_async_pool.lock);
+        return 0;
+    }
+    if (!bmp_async_pool.started) {
+        for (i = 0; i < BMP_ASYNC_THREADS; i++) {
+            if (!bmp_thread_create(&bmp_async_threads[i], bmp_async_worker, NULL))
+                break;
+        }
+        bmp_async_pool.started = i;
+        if (i == 0) {
+            bmp_mutex_unlock(&bmp_async_pool.lock);
+            return 0;
+        }
+    }
+    if (bmp_async_pool.tail)
+        bmp_async_pool.tail->next = req;
+    else
+        bmp_async_pool.head = req;
+    bmp_async_pool.tail = req;
+    bmp_cond_broadcast(&bmp_async_pool.queue_cond);
+    bmp_mutex_unlock(&bmp_async_pool.lock);
+    return 1;
+}
+
+#endif
+
+/** Ͷ **/
+static BMPAsync *bmp_async_create(int save, BMP *bmp, const char *file, BMPAsyncCallback callback, void *userdata)
+{
+    BMPAsync *req = NULL;
+
+    if (STRNULL(file)) return NULL;
+    if ((req = (BMPAsync *)malloc(sizeof(BMPAsync))) == NULL) return NULL;
+    memset(req, 0, sizeof(BMPAsync));
+
+    if ((req->file = (char *)malloc(strlen(file) + 1)) == NULL) {
+        free(req);
+        return NULL;
+    }
+    strcpy(req->file, file);
+    req->save = save;
+    req->bmp = bmp;
+    req->callback = callback;
+    req->userdata = userdata;
+
+#ifndef BMP_NO_THREAD
+    if (bmp_async_submit(req)) return req;
+#endif
+
+    //߳̿ʱͬ
+    bmp_async_run(req);
+    req->done = 1;
+    if (req->callback)
+        req->callback(req, req->result, req->userdata);
+    req->finished = 1;
+    return req;
+}
+
+/** 첽ȡͼ **/
+BMPAsync *bmp_load_async(const char *file, BMPAsyncCallback callback, void *userdata)
+{
+    return bmp_async_create(0, NULL, file, callback, userdata);
+}
+
+/** 첽ͼ, ǰbmp޸Ļͷ **/
+BMPAsync *bmp_save_async(BMP *bmp, const char *file, BMPAsyncCallback callback, void *userdata)
+{
+    if (BMPNULL(bmp)) return NULL;
+    return bmp_async_create(1, bmp, file, callback, userdata);
+}
+
+/** ѯǷ, ɷ1 **/
+int bmp_async_poll(BMPAsync *req)
+{
+    int done = 0;
+
+    if (!req) return 1;
+#ifndef BMP_NO_THREAD
+    bmp_mutex_lock(&bmp_async_pool.lock);
+    done = req->done;
+    bmp_mutex_unlock(&bmp_async_pool.lock);
+#else
+    done = req->done;
+#endif
+    return done;
+}
+
+/** ȴɲؽ, loadʱbmp **/
+int bmp_async_wait(BMPAsync *req, BMP **bmp)
+{
+    if (!req) return 0;
+#ifndef BMP_NO_THREAD
+    bmp_mutex_lock(&bmp_async_pool.lock);
+    while (!req->done)
+        bmp_cond_wait(&bmp_async_pool.done_cond, &bmp_async_pool.lock);
+    bmp_mutex_unlock(&bmp_async_pool.lock);
+#endif
+    if (bmp && !req->save) {
+        *bmp = req->bmp;
+        req->bmp = NULL;
+    }
+    return req->result;
+}
+
+/** ͷ(ȴ), ڻصе **/
+void bmp_async_destroy(BMPAsync **req)
+{
+    if (req == NULL || *req == NULL)
+        return;
+
+#ifndef BMP_NO_THREAD
+    bmp_mutex_lock(&bmp_async_pool.lock);
+    while (!(*req)->finished)
+        bmp_cond_wait(&bmp_async_pool.done_cond, &bmp_async_pool.lock);
+    bmp_mutex_unlock(&bmp_async_pool.lock);
+#endif
+    if (!(*req)->save)
+        bmp_destroy(&(*req)->bmp);
+    free((*req)->file);
+    free(*req);
+    *req = NULL;
+}
+
+/** رչ߳ **/
+void bmp_async_shutdown(void)
+{
+#ifndef BMP_NO_THREAD
+    int i = 0, started = 0;
+
+    bmp_mutex_lock(&bmp_async_pool.lock);
+    //߳ڹرʱ, ֻ߳joinһ
+    while (bmp_async_pool.stop)
+        bmp_cond_wait(&bmp_async_pool.done_cond, &bmp_async_pool.lock);
+    if ((started = bmp_async_pool.started) == 0) {
+        bmp_mutex_unlock(&bmp_async_pool.lock);
+        return;
+    }
+    bmp_async_pool.stop = 1;
+    bmp_cond_broadcast(&bmp_async_pool.queue_cond);
+    bmp_mutex_unlock(&bmp_async_pool.lock);
+
+    //ʣ߳˳
+    for (i = 0; i < started; i++)
+        bmp_thread_join(bmp_async_threads[i]);
+
+    //߳ȫ˳ٴͶ
+    bmp_mutex_lock(&bmp_async_pool.lock);
+    bmp_async_pool.started = 0;
+    bmp_async_pool.stop = 0;
+    bmp_cond_broadcast(&bmp_async_pool.done_cond);
+    bmp_mutex_unlock(&bmp_async_pool.lock);
+#endif
+}
+
+// +---------------------------------------------------------
+// | ͼ
+// +---------------------------------------------------------
+
+/** ͼ(ƽ), gray == 1 ʱ (b + g + r) / 3 ͨ **/
+BMPIntegral *bmp_integral_create(BMP *bmp, int gray)
+{
+    BMPIntegral *integral = NULL;
+    unsigned long long rowsum[3], rowsq[3], *sum = NULL, *sq = NULL;
+    int w = 0, h = 0, c = 0, v = 0, stride = 0, channels = 0;
+    int bytepix = 0, perline = 0;
+    size_t count = 0;
+    const unsigned char *src = NULL;
+
+    if (BMPNULL(bmp)) return NULL;
+
+    if ((integral = (BMPIntegral *)malloc(sizeof(BMPIntegral))) == NULL) return NULL;
+    channels = gray ? 1 : 3;
+    integral->width = bmp->width;
+    integral->height = bmp->height;
+    integral->channels = channels;
+
+    count = (size_t)(bmp->width + 1) * (bmp->height + 1) * channels;
+    integral->sum = (unsigned long long *)malloc(sizeof(unsigned long long) * count);
+    integral->sqsum = (unsigned long long *)malloc(sizeof(unsigned long long) * count);
+    if (integral->sum == NULL || integral->sqsum == NULL) {
+        bmp_integral_destroy(&integral);
+        return NULL;
+    }
+
+    perline = BMP_PERLINE_REALSIZE(bmp);
+    bytepix = bmp->alpha == 1 ? 4 : 3;
+    stride = (bmp->width + 1) * channels;
+
+    //Ϊ0
+    memset(integral->sum, 0, sizeof(unsigned long long) * stride);
+    memset(integral->sqsum, 0, sizeof(unsigned long long) * stride);
+    for (h = 0; h < bmp->height; h++) {
+        src = bmp->data + (size_t)h * perline;
+        sum = integral->sum + (size_t)(h + 1) * stride;
+        sq = integral->sqsum + (size_t)(h + 1) * stride;
+        memset(rowsum, 0, sizeof(rowsum));
+        memset(rowsq, 0, sizeof(rowsq));
+        for (c = 0; c < channels; c++)
+            sum[c] = sq[c] = 0;
+
+        for (w = 0; w < bmp->width; w++) {
+            for (c = 0; c < channels; c++) {
+                v = gray ? (src[0] + src[1] + src[2]) / 3 : src[c];
+                rowsum[c] += v;
+                rowsq[c] += v * v;
+                sum[(w + 1) * channels + c] = sum[(w + 1) * channels + c - stride] + rowsum[c];
+                sq[(w + 1) * channels + c] = sq[(w + 1) * channels + c - stride] + rowsq[c];
+            }
+            src += bytepix;
+        }
+    }
+    return integral;
+}
+
+/** ͷŻͼ **/
+void bmp_integral_destroy(BMPIntegral **integral)
+{
+    if (integral == NULL || *integral == NULL)
+        return;
+
+    free((*integral)->sum);
+    free((*integral)->sqsum);
+    free(*integral);
+    *integral = NULL;
+}
+
+/** ڸͨĺƽ,  **/
+static long long bmp_rect_sums(BMPIntegral *integral, BMPRect *rect, double *sum, double *sqsum)
+{
+    int left = 0, top = 0, right = 0, bottom = 0, c = 0, stride = 0, channels = 0;
+    size_t a = 0, b = 0, d = 0, e = 0;
+
+    if (integral == NULL || rect == NULL) return 0;
+
+    //üͼ, right/bottom
+    left = rect->left < 0 ? 0 : rect->left;
+    top = rect->top < 0 ? 0 : rect->top;
+    right = rect->right > integral->width ? integral->width : rect->right;
+    bottom = rect->bottom > integral->height ? integral->height : rect->bottom;
+    if (right <= left || bottom <= top) return 0;
+
+    channels = integral->channels;
+    stride = (integral->width + 1) * channels;
+    a = (size_t)top * stride + left * channels;
+    b = (size_t)top * stride + right * channels;
+    d = (size_t)bottom * stride + left * channels;
+    e = (size_t)bottom * stride + right * channels;
+    for (c = 0; c < channels; c++) {
+        sum[c] = (double)(integral->sum[e + c] - integral->sum[b + c] - integral->sum[d + c] + integral->sum[a + c]);
+        if (sqsum)
+            sqsum[c] = (double)(integral->sqsum[e + c] - integral->sqsum[b + c] - integral->sqsum[d + c] + integral->sqsum[a + c]);
+    }
+    return (long long)(right - left) * (bottom - top);
+}
+
+/** ֵ, ɹ1 **/
+int bmp_rect_mean(BMPIntegral *integral, BMPRect *rect, double *mean)
+{
+    double sum[3];
+    long long count = 0;
+    int c = 0;
+
+    if (mean == NULL || (count = bmp_rect_sums(integral, rect, sum, NULL)) <= 0) return 0;
+
+    for (c = 0; c < integral->channels; c++)
+        mean[c] = sum[c] / count;
+    return 1;
+}
+
+/** 򷽲, ɹ1 **/
+int bmp_rect_variance(BMPIntegral *integral, BMPRect *rect, double *variance)
+{
+    double sum[3], sqsum[3], mean = 0;
+    long long count = 0;
+    int c = 0;
+
+    if (variance == NULL || (count = bmp_rect_sums(integral, rect, sum, sqsum)) <= 0) return 0;
+
+    for (c = 0; c < integral->channels; c++) {
+        mean = sum[c] / count;
+        variance[c] = sqsum[c] / count - mean * mean;
+        if (variance[c] < 0)
+            variance[c] = 0;
+    }
+    return 1;
+}
+
+/** ֲֵֵ, method 0: Sauvola, 1: Bradley **/
+static void bmp_threshold_local(BMP *bmp, int window, double k, int method)
+{
+    BMPIntegral *integral = NULL;
+    BMPRect rect;
+    double sum = 0, sqsum = 0, mean = 0, sd = 0, threshold = 0;
+    long long count = 0;
+    int w = 0, h = 0, half = 0, value = 0;
+    size_t speed = 0;
+    int bytepix = 0, perline = 0;
+
+    if ((integral = bmp_integral_create(bmp, 1)) == NULL) return;
+
+    half = (window < 1 ? 1 : window) / 2;
+    perline = BMP_PERLINE_SUP(bmp);
+    bytepix = bmp->alpha == 1 ? 4 : 3;
+    BMP_LOOP_START(bmp, w, h);
+
+    rect.left = w - half;
+    rect.top = h - half;
+    rect.right = w + half + 1;
+    rect.bottom = h + half + 1;
+    count = bmp_rect_sums(integral, &rect, &sum, &sqsum);
+    value = (bmp->data[speed] + bmp->data[speed + 1] + bmp->data[speed + 2]) / 3;
+
+    mean = sum / count;
+    if (method == 0) {
+        //T = m * (1 + k * (s / R - 1)), R = 128
+        sd = sqsum / count - mean * mean;
+        sd = sd > 0 ? sqrt(sd) : 0;
+        threshold = mean * (1 + k * (sd / 128.0 - 1));
+    } else {
+        //T = m * (1 - t)
+        threshold = mean * (1 - k);
+    }
+
+    if (value > threshold) {
+        bmp->data[speed] = bmp->data[speed + 1] = bmp->data[speed + 2] = 0xff;
+    } else {
+        bmp->data[speed] = bmp->data[speed + 1] = bmp->data[speed + 2] = 0x00;
+    }
+
+    BMP_LOOP_STOP(bmp, speed);
+    bmp_integral_destroy(&integral);
+}
+
+/** SauvolaӦֵ, windowΪڱ߳, kһȡ0.2~0.5 **/
+void bmp_threshold_sauvola(BMP *bmp, int window, double k)
+{
+    if (BMPNULL(bmp)) return;
+
+    BMP_STAT_BEGIN(BMP_STAT_THRESHOLD_LOCAL);
+    bmp_threshold_local(bmp, window, k, 0);
+    BMP_STAT_END(BMP_STAT_THRESHOLD_LOCAL, (double)bmp->width * bmp->height);
+}
+
+/** BradleyӦֵ, ھֲֵ (1 - t) Ϊ, tһȡ0.15 **/
+void bmp_threshold_bradley(BMP *bmp, int window, double t)
+{
+    if (BMPNULL(bmp)) return;
+
+    BMP_STAT_BEGIN(BMP_STAT_THRESHOLD_LOCAL);
+    bmp_threshold_local(bmp, window, t, 1);
+    BMP_STAT_END(BMP_STAT_THRESHOLD_LOCAL, (double)bmp->width * bmp->height);
+}
+
+// +---------------------------------------------------------
+// | 
+// +---------------------------------------------------------
+
+typedef struct BMPCandidate
+{
+    int x, y;
+    long long sad;
+}BMPCandidate;
+
+/** 2x2ƽСһ, Ϊ24λ **/
+static BMP *bmp_pyramid_down(BMP *bmp)
+{
+    BMP *dst = NULL;
+    const unsigned char *s0 = NULL, *s1 = NULL;
+    unsigned char *d = NULL;
+    int w = 0, h = 0, c = 0, bytepix = 0, perline = 0, perline_dst = 0;
+
+    if (bmp->width < 2 || bmp->height < 2) return NULL;
+    if ((dst = (BMP *)malloc(sizeof(BMP))) == NULL) return NULL;
+
+    dst->width = bmp->width / 2;
+    dst->height = bmp->height / 2;
+    dst->alpha = 0;
+    dst->size = (size_t)BMP_PERLINE_REALSIZE(dst) * dst->height;
+    if ((dst->data = (unsigned char *)malloc(dst->size)) == NULL) {
+        free(dst);
+        return NULL;
+    }
+    memset(dst->data, 0, dst->size);
+
+    bytepix = bmp->alpha == 1 ? 4 : 3;
+    perline = BMP_PERLINE_REALSIZE(bmp);
+    perline_dst = BMP_PERLINE_REALSIZE(dst);
+    for (h = 0; h < dst->height; h++) {
+        s0 = bmp->data + (size_t)2 * h * perline;
+        s1 = s0 + perline;
+        d = dst->data + (size_t)h * perline_dst;
+        for (w = 0; w < dst->width; w++) {
+            for (c = 0; c < 3; c++)
+                d[c] = (unsigned char)((s0[c] + s0[bytepix + c] + s1[c] + s1[bytepix + c] + 2) >> 2);
+            s0 += 2 * bytepix;
+            s1 += 2 * bytepix;
+            d += 3;
+        }
+    }
+    return dst;
+}
+
+/** , 0ԭͼ(Ƚͷ) **/
+BMPPyramid *bmp_pyramid_create(BMP *bmp, int levels)
+{
+    BMPPyramid *pyramid = NULL;
+    int i = 0;
+
+    if (BMPNULL(bmp)) return NULL;
+    levels = levels < 1 ? 1 : (levels > BMP_PYRAMID_MAX ? BMP_PYRAMID_MAX : levels);
+
+    if ((pyramid = (BMPPyramid *)malloc(sizeof(BMPPyramid))) == NULL) return NULL;
+    memset(pyramid, 0, sizeof(BMPPyramid));
+
+    pyramid->level[0] = bmp;
+    for (i = 1; i < levels; i++) {
+        if ((pyramid->level[i] = bmp_pyramid_down(pyramid->level[i - 1])) == NULL)
+            break;
+    }
+    pyramid->levels = i;
+    return pyramid;
+}
+
+/** ͷŽ(ͷԭͼ) **/
+void bmp_pyramid_destroy(BMPPyramid **pyramid)
+{
+    int i = 0;
+
+    if (pyramid == NULL || *pyramid == NULL)
+        return;
+
+    for (i = 1; i < (*pyramid)->levels; i++)
+        bmp_destroy(&(*pyramid)->level[i]);
+    free(*pyramid);
+    *pyramid = NULL;
+}
+
+/** (x, y)ľԲ֮, limitʱǰ **/
+static long long bmp_search_sad(BMP *bmp, BMP *bmp2, int x, int y, long long limit)
+{
+    const unsigned char *s = NULL, *t = NULL;
+    int w = 0, h = 0, c = 0, d = 0;
+    int bytepix = bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(bmp);
+    int bytepix2 = bmp2->alpha == 1 ? 4 : 3, perline2 = BMP_PERLINE_REALSIZE(bmp2);
+    long long sad = 0;
+
+    for (h = 0; h < bmp2->height; h++) {
+        s = bmp->data + (size_t)(y + h) * perline + x * bytepix;
+        t = bmp2->data + (size_t)h * perline2;
+        for (w = 0; w < bmp2->width; w++) {
+            for (c = 0; c < 3; c++) {
+                d = s[c] - t[c];
+                sad += d < 0 ? -d : d;
+            }
+            s += bytepix;
+            t += bytepix2;
+        }
+        if (sad > limit) break;
+    }
+    return sad;
+}
+
+/** (x, y)ÿtolerance1 **/
+static int bmp_search_verify(BMP *bmp, BMP *bmp2, int x, int y, int tolerance)
+{
+    const unsigned char *s = NULL, *t = NULL;
+    int w = 0, h = 0, c = 0, d = 0;
+    int bytepix = bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(bmp);
+    int bytepix2 = bmp2->alpha == 1 ? 4 : 3, perline2 = BMP_PERLINE_REALSIZE(bmp2);
+
+    for (h = 0; h < bmp2->height; h++) {
+        s = bmp->data + (size_t)(y + h) * perline + x * bytepix;
+        t = bmp2->data + (size_t)h * perline2;
+        for (w = 0; w < bmp2->width; w++) {
+            for (c = 0; c < 3; c++) {
+                d = s[c] - t[c];
+                if (d > tolerance || d < -tolerance) return 0;
+            }
+            s += bytepix;
+            t += bytepix2;
+        }
+    }
+    return 1;
+}
+
+/** sadѡ, صǰ̭ **/
+static long long bmp_candidate_push(BMPCandidate *cand, int *count, int max, int x, int y, long long sad)
+{
+    int i = 0;
+
+    if (*count == max && sad >= cand[max - 1].sad)
+        return cand[max - 1].sad;
+
+    i = *count < max ? (*count)++ : max - 1;
+    for (; i > 0 && cand[i - 1].sad > sad; i--)
+        cand[i] = cand[i - 1];
+    cand[i].x = x;
+    cand[i].y = y;
+    cand[i].sad = sad;
+    return *count == max ? cand[max - 1].sad : LLONG_MAX;
+}
+
+/** ѽõĽ, ֲȫͼҺѡ, Сϸ **/
+int bmp_search_pyramid_ex(BMPPyramid *pyramid, BMPPyramid *pyramid2, int tolerance, int maxcand, int *x, int *y)
+{
+    BMPCandidate *cand = NULL, *next = NULL, *swap = NULL;
+    BMP *bmp = NULL, *bmp2 = NULL;
+    long long limit = LLONG_MAX, sad = 0;
+    int level = 0, i = 0, w = 0, h = 0, count = 0, nextcount = 0;
+    int left = 0, top = 0, right = 0, bottom = 0, found = 0, bx = 0, by = 0, level_start = 0;
+
+    if (pyramid == NULL || pyramid2 == NULL) return 0;
+    bmp = pyramid->level[0];
+    bmp2 = pyramid2->level[0];
+    if (bmp->width < bmp2->width || bmp->height < bmp2->height) return 0;
+
+    maxcand = maxcand < 1 ? 1 : maxcand;
+    cand = (BMPCandidate *)malloc(sizeof(BMPCandidate) * maxcand);
+    next = (BMPCandidate *)malloc(sizeof(BMPCandidate) * maxcand);
+    if (cand == NULL || next == NULL) {
+        free(cand);
+        free(next);
+        return 0;
+    }
+
+    //ģֲٱ4x4
+    level = pyramid->levels < pyramid2->levels ? pyramid->levels : pyramid2->levels;
+    for (level--; level > 0; level--) {
+        if (pyramid2->level[level]->width >= 4 && pyramid2->level[level]->height >= 4) break;
+    }
+
+    BMP_STAT_BEGIN(BMP_STAT_SEARCH_PYRAMID);
+    level_start = level;
+
+    //ģ̫С޷Сʱ˻ΪԭͼУ
+    if (level == 0) {
+        for (h = 0; h <= bmp->height - bmp2->height && !found; h++) for (w = 0; w <= bmp->width - bmp2->width; w++) {
+            if (bmp_search_verify(bmp, bmp2, w, h, tolerance)) {
+                found = 1;
+                bx = w;
+                by = h;
+                break;
+            }
+        }
+    }
+    else {
+        //ֲȫͼ
+        bmp = pyramid->level[level];
+        bmp2 = pyramid2->level[level];
+        for (h = 0; h <= bmp->height - bmp2->height; h++) for (w = 0; w <= bmp->width - bmp2->width; w++) {
+            if ((sad = bmp_search_sad(bmp, bmp2, w, h, limit)) < limit || count < maxcand)
+                limit = bmp_candidate_push(cand, &count, maxcand, w, h, sad);
+        }
+    }
+
+    //ϸ, Ŵ2 2 Χ, ԭͼϰУ
+    while (level > 0) {
+        level--;
+        bmp = pyramid->level[level];
+        bmp2 = pyramid2->level[level];
+        limit = LLONG_MAX;
+        nextcount = 0;
+        for (i = 0; i < count; i++) {
+            left = cand[i].x * 2 - 2 < 0 ? 0 : cand[i].x * 2 - 2;
+            top = cand[i].y * 2 - 2 < 0 ? 0 : cand[i].y * 2 - 2;
+            right = cand[i].x * 2 + 2 > bmp->width - bmp2->width ? bmp->width - bmp2->width : cand[i].x * 2 + 2;
+            bottom = cand[i].y * 2 + 2 > bmp->height - bmp2->height ? bmp->height - bmp2->height : cand[i].y * 2 + 2;
+            for (h = top; h <= bottom; h++) for (w = left; w <= right; w++) {
+                if (level > 0) {
+                    if ((sad = bmp_search_sad(bmp, bmp2, w, h, limit)) < limit || nextcount < maxcand)
+                        limit = bmp_candidate_push(next, &nextcount, maxcand, w, h, sad);
+                }
+                else if (bmp_search_verify(bmp, bmp2, w, h, tolerance)) {
+                    //ƥʱȡsadС, ͬʱȡϿ
+                    sad = bmp_search_sad(bmp, bmp2, w, h, LLONG_MAX);
+                    if (!found || sad < limit || (sad == limit && (h < by || (h == by && w < bx)))) {
+                        found = 1;
+                        limit = sad;
+                        bx = w;
+                        by = h;
+                    }
+                }
+            }
+        }
+        swap = cand;
+        cand = next;
+        next = swap;
+        count = nextcount;
+    }
+
+    //ֲֻλ0ģ, ģƫƴСͬ, ʵλÿܲںѡ,
+    //ʱԭͼУ, ֻҪƥλþһҵ
+    if (!found && level_start > 0) {
+        bmp = pyramid->level[0];
+        bmp2 = pyramid2->level[0];
+        for (h = 0; h <= bmp->height - bmp2->height && !found; h++) for (w = 0; w <= bmp->width - bmp2->width; w++) {
+            if (bmp_search_verify(bmp, bmp2, w, h, tolerance)) {
+                found = 1;
+                bx = w;
+                by = h;
+                break;
+            }
+        }
+    }
+
+    if (found) {
+        if (x) *x = bx;
+        if (y) *y = by;
+    }
+
+    free(cand);
+    free(next);
+    BMP_STAT_END(BMP_STAT_SEARCH_PYRAMID, (double)pyramid->level[0]->width * pyramid->level[0]->height);
+    return found;
+}
+
+/** , ҵ1, ÿtoleranceΪͬ **/
+int bmp_search_pyramid(BMP *bmp, BMP *bmp2, int levels, int tolerance, int maxcand, int *x, int *y)
+{
+    BMPPyramid *pyramid = NULL, *pyramid2 = NULL;
+    int recode = 0;
+
+    if (BMPNULL(bmp) || BMPNULL(bmp2)) return 0;
+    if (bmp->width < bmp2->width || bmp->height < bmp2->height) return 0;
+
+    pyramid = bmp_pyramid_create(bmp, levels);
+    pyramid2 = bmp_pyramid_create(bmp2, levels);
+    if (pyramid && pyramid2)
+        recode = bmp_search_pyramid_ex(pyramid, pyramid2, tolerance, maxcand, x, y);
+
+    bmp_pyramid_destroy(&pyramid);
+    bmp_pyramid_destroy(&pyramid2);
+    return recode;
+}
+
+// +---------------------------------------------------------
+// | ģ
+// +---------------------------------------------------------
+
+//ê㳤(), ģխʱȡģ
+#define BMP_TPLSET_ANCHOR 4
+
+typedef struct BMPTplAnchor
+{
+    unsigned int key[BMP_TPLSET_ANCHOR];
+    int len;
+    int index;                  //ģ
+    int ax, ay;                 //êģеλ
+    int next;                   //ͬһͰһ
+}BMPTplAnchor;
+
+struct BMPTemplateSet
+{
+    BMP **tpl;
+    int count, capacity;
+    BMPTplAnchor *anchor;       //ÿģһê
+    int *bucket, mask;
+    unsigned char filter[8192]; //ϣ16λλͼ, ų
+    int lenmask;                //ֹê㳤
+    int compiled;
+};
+
+static unsigned int bmp_tplset_hash(const unsigned int *key, int len)
+{
+    unsigned int hash = 2166136261u;
+    int i = 0;
+
+    for (i = 0; i < len; i++) {
+        hash ^= key[i];
+        hash *= 16777619u;
+        hash ^= hash >> 15;
+    }
+    return hash;
+}
+
+/** һشΪ 0xRRGGBB **/
+static void bmp_tplset_pack(BMP *bmp, int h, unsigned int *dst)
+{
+    const unsigned char *s = bmp->data + (size_t)h * BMP_PERLINE_REALSIZE(bmp);
+    int bytepix = bmp->alpha == 1 ? 4 : 3, w = 0;
+
+    for (w = 0; w < bmp->width; w++, s += bytepix)
+        dst[w] = s[0] | (s[1] << 8) | ((unsigned int)s[2] << 16);
+}
+
+/** ģ弯 **/
+BMPTemplateSet *bmp_tplset_create(void)
+{
+    BMPTemplateSet *set = NULL;
+
+    if ((set = (BMPTemplateSet *)malloc(sizeof(BMPTemplateSet))) == NULL) return NULL;
+    memset(set, 0, sizeof(BMPTemplateSet));
+    return set;
+}
+
+/** ģ(һ), ģ, ʧܷ-1 **/
+int bmp_tplset_add(BMPTemplateSet *set, BMP *bmp)
+{
+    BMP **tpl = NULL;
+
+    if (set == NULL || BMPNULL(bmp)) return -1;
+
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 16;
+        if ((tpl = (BMP **)realloc(set->tpl, sizeof(BMP *) * set->capacity)) == NULL) {
+            set->capacity = set->count;
+            return -1;
+        }
+        set->tpl = tpl;
+    }
+    if ((set->tpl[set->count] = bmp_copy(bmp)) == NULL) return -1;
+
+    set->compiled = 0;
+    return set->count++;
+}
+
+/** Ϊģѡê: ر仯һ, ܿɫ **/
+static void bmp_tplset_anchor(BMP *bmp, unsigned int *line, BMPTplAnchor *anchor)
+{
+    int len = bmp->width < BMP_TPLSET_ANCHOR ? bmp->width : BMP_TPLSET_ANCHOR;
+    int w = 0, h = 0, i = 0, score = 0, best = -1;
+
+    for (h = 0; h < bmp->height && best < len - 1; h++) {
+        bmp_tplset_pack(bmp, h, line);
+        for (w = 0; w + len <= bmp->width; w++) {
+            for (score = 0, i = 1; i < len; i++)
+                score += line[w + i] != line[w + i - 1];
+            if (score > best) {
+                best = score;
+                anchor->ax = w;
+                anchor->ay = h;
+                memcpy(anchor->key, line + w, sizeof(unsigned int) * len);
+                if (best == len - 1) break;
+            }
+        }
+    }
+    anchor->len = len;
+}
+
+/** ê, ģ± **/
+int bmp_tplset_compile(BMPTemplateSet *set)
+{
+    unsigned int *line = NULL, hash = 0;
+    int i = 0, maxwidth = 0, size = 0;
+
+    if (set == NULL || set->count == 0) return 0;
+
+    for (i = 0; i < set->count; i++)
+        maxwidth = set->tpl[i]->width > maxwidth ? set->tpl[i]->width : maxwidth;
+    for (size = 16; size < set->count * 2; size <<= 1);
+
+    free(set->anchor);
+    free(set->bucket);
+    set->anchor = (BMPTplAnchor *)malloc(sizeof(BMPTplAnchor) * set->count);
+    set->bucket = (int *)malloc(sizeof(int) * size);
+    line = (unsigned int *)malloc(sizeof(unsigned int) * maxwidth);
+    if (set->anchor == NULL || set->bucket == NULL || line == NULL) {
+        free(set->anchor);
+        free(set->bucket);
+        free(line);
+        set->anchor = NULL;
+        set->bucket = NULL;
+        set->compiled = 0;
+        return 0;
+    }
+
+    set->mask = size - 1;
+    set->lenmask = 0;
+    memset(set->bucket, -1, sizeof(int) * size);
+    memset(set->filter, 0, sizeof(set->filter));
+    for (i = 0; i < set->count; i++) {
+        bmp_tplset_anchor(set->tpl[i], line, set->anchor + i);
+        set->anchor[i].index = i;
+        hash = bmp_tplset_hash(set->anchor[i].key, set->anchor[i].len);
+        set->anchor[i].next = set->bucket[hash & set->mask];
+        set->bucket[hash & set->mask] = i;
+        set->filter[(hash & 0xFFFF) >> 3] |= 1 << (hash & 7);
+        set->lenmask |= 1 << set->anchor[i].len;
+    }
+
+    free(line);
+    set->compiled = 1;
+    return 1;
+}
+
+/** ɨһbmp, ÿҵһcallback(ģ, x, y), callback0ʱֹͣ; ҵ **/
+int bmp_tplset_search(BMPTemplateSet *set, BMP *bmp, BMPTemplateCallback callback, void *userdata)
+{
+    BMPTplAnchor *anchor = NULL;
+    BMP *tpl = NULL;
+    unsigned int *line = NULL, hash = 0;
+    int w = 0, h = 0, len = 0, i = 0, x = 0, y = 0, found = 0, stop = 0;
+
+    if (set == NULL || BMPNULL(bmp)) return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_TPLSET_SEARCH);
+    if ((!set->compiled && !bmp_tplset_compile(set)) ||
+        (line = (unsigned int *)malloc(sizeof(unsigned int) * bmp->width)) == NULL) {
+        BMP_STAT_END(BMP_STAT_TPLSET_SEARCH, 0);
+        return 0;
+    }
+
+    for (h = 0; h < bmp->height && !stop; h++) {
+        bmp_tplset_pack(bmp, h, line);
+        for (w = 0; w < bmp->width && !stop; w++) {
+            for (len = 1; len <= BMP_TPLSET_ANCHOR && !stop; len++) {
+                if (!(set->lenmask & (1 << len)) || w + len > bmp->width) continue;
+
+                hash = bmp_tplset_hash(line + w, len);
+                if (!(set->filter[(hash & 0xFFFF) >> 3] & (1 << (hash & 7)))) continue;
+
+                for (i = set->bucket[hash & set->mask]; i >= 0 && !stop; i = anchor->next) {
+                    anchor = set->anchor + i;
+                    if (anchor->len != len || memcmp(anchor->key, line + w, sizeof(unsigned int) * len)) continue;
+
+                    //ê, Уģ
+                    tpl = set->tpl[anchor->index];
+                    x = w - anchor->ax;
+                    y = h - anchor->ay;
+                    if (x < 0 || y < 0 || x + tpl->width > bmp->width || y + tpl->height > bmp->height) continue;
+                    if (!bmp_search_verify(bmp, tpl, x, y, 0)) continue;
+
+                    found++;
+                    if (callback && !callback(anchor->index, x, y, userdata)) stop = 1;
+                }
+            }
+        }
+    }
+
+    free(line);
+    BMP_STAT_END(BMP_STAT_TPLSET_SEARCH, (double)bmp->width * bmp->height);
+    return found;
+}
+
+/** ͷģ弯 **/
+void bmp_tplset_destroy(BMPTemplateSet **set)
+{
+    int i = 0;
+
+    if (set == NULL || *set == NULL)
+        return;
+
+    for (i = 0; i < (*set)->count; i++)
+        bmp_destroy(&(*set)->tpl[i]);
+    free((*set)->tpl);
+    free((*set)->anchor);
+    free((*set)->bucket);
+    free(*set);
+    *set = NULL;
+}
+
+// +---------------------------------------------------------
+// | ͼָ
+// +---------------------------------------------------------
+
+#define BMP_HASH_P1 0x9E3779B185EBCA87ULL
+#define BMP_HASH_P2 0xC2B2AE3D27D4EB4FULL
+#define BMP_HASH_P3 0x165667B19E3779F9ULL
+#define BMP_HASH_P4 0x85EBCA77C2B2AE63ULL
+#define BMP_HASH_P5 0x27D4EB2F165667C5ULL
+
+static const unsigned long long bmp_hash_key[4] = {
+    BMP_HASH_P5, BMP_HASH_P4, BMP_HASH_P3, BMP_HASH_P2
+};
+
+/** 32ֽһ: acc[i] += lo(d^k) * hi(d^k), ͨۼԭֵ **/
+static void bmp_hash_stripe(unsigned long long *acc, const unsigned char *p)
+{
+    unsigned long long d[4], dk = 0;
+    int i = 0;
+
+    memcpy(d, p, 32);
+    for (i = 0; i < 4; i++) {
+        dk = d[i] ^ bmp_hash_key[i];
+        acc[i ^ 1] += d[i];
+        acc[i] += (dk & 0xFFFFFFFFULL) * (dk >> 32);
+    }
+}
+
+/** һ(ֽ), β32ֽڲ0 **/
+static void bmp_hash_row(unsigned long long *acc, const unsigned char *p, int len)
+{
+    unsigned char tail[32];
+    int i = 0;
+
+#ifdef __AVX2__
+    __m256i vacc = _mm256_loadu_si256((const __m256i *)acc);
+    __m256i vkey = _mm256_loadu_si256((const __m256i *)bmp_hash_key);
+    __m256i d, dk;
+
+    for (; i + 32 <= len; i += 32) {
+        d = _mm256_loadu_si256((const __m256i *)(p + i));
+        dk = _mm256_xor_si256(d, vkey);
+        vacc = _mm256_add_epi64(vacc, _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+        vacc = _mm256_add_epi64(vacc, _mm256_mul_epu32(dk, _mm256_srli_epi64(dk, 32)));
+    }
+    _mm256_storeu_si256((__m256i *)acc, vacc);
+#else
+    for (; i + 32 <= len; i += 32)
+        bmp_hash_stripe(acc, p + i);
+#endif
+
+    if (i < len) {
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, p + i, len - i);
+        bmp_hash_stripe(acc, tail);
+    }
+
+    for (i = 0; i < 4; i++) {
+        acc[i] ^= acc[i] >> 47;
+        acc[i] ^= bmp_hash_key[i];
+        acc[i] *= BMP_HASH_P1;
+    }
+}
+
+/** ݹϣ(64λ), βֽ, ߺλͬϣͬ **/
+unsigned long long bmp_hash(BMP *bmp)
+{
+    unsigned long long acc[4], hash = 0;
+    int h = 0, i = 0, perline = 0, len = 0;
+
+    if (BMPNULL(bmp)) return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_HASH);
+    acc[0] = BMP_HASH_P1 ^ (unsigned long long)bmp->width;
+    acc[1] = BMP_HASH_P2 ^ (unsigned long long)bmp->height;
+    acc[2] = BMP_HASH_P3 ^ (unsigned long long)(bmp->alpha == 1);
+    acc[3] = BMP_HASH_P4;
+
+    perline = BMP_PERLINE_REALSIZE(bmp);
+    len = bmp->width * (bmp->alpha == 1 ? 4 : 3);
+    for (h = 0; h < bmp->height; h++)
+        bmp_hash_row(acc, bmp->data + (size_t)h * perline, len);
+
+    hash = (unsigned long long)len * bmp->height * BMP_HASH_P5;
+    for (i = 0; i < 4; i++) {
+        acc[i] ^= acc[i] >> 33;
+        acc[i] *= BMP_HASH_P2;
+        hash ^= acc[i];
+        hash = ((hash << 27) | (hash >> 37)) * BMP_HASH_P1 + BMP_HASH_P4;
+    }
+    hash ^= hash >> 33;
+    hash *= BMP_HASH_P2;
+    hash ^= hash >> 29;
+    hash *= BMP_HASH_P3;
+    hash ^= hash >> 32;
+
+    BMP_STAT_END(BMP_STAT_HASH, (double)bmp->width * bmp->height);
+    return hash;
+}
+
+/** Ҷ(ͬbmp_convert_grayȨ)ƽŵ width x height **/
+static int bmp_gray_area(BMP *bmp, int width, int height, double *dst)
+{
+    double *col = NULL, sum = 0;
+    const unsigned char *s = NULL;
+    int x = 0, y = 0, w = 0, h = 0, x0 = 0, x1 = 0, y0 = 0, y1 = 0;
+    int bytepix = bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(bmp);
+
+    if ((col = (double *)malloc(sizeof(double) * bmp->width)) == NULL) return 0;
+
+    for (y = 0; y < height; y++) {
+        y0 = (int)((long long)y * bmp->height / height);
+        y1 = (int)((long long)(y + 1) * bmp->height / height);
+        y1 = y1 > y0 ? y1 : y0 + 1;
+
+        memset(col, 0, sizeof(double) * bmp->width);
+        for (h = y0; h < y1; h++) {
+            s = bmp->data + (size_t)h * perline;
+            for (w = 0; w < bmp->width; w++, s += bytepix)
+                col[w] += s[2] * 0.3 + s[1] * 0.59 + s[0] * 0.11;
+        }
+
+        for (x = 0; x < width; x++) {
+            x0 = (int)((long long)x * bmp->width / width);
+            x1 = (int)((long long)(x + 1) * bmp->width / width);
+            x1 = x1 > x0 ? x1 : x0 + 1;
+            for (sum = 0, w = x0; w < x1; w++)
+                sum += col[w];
+            dst[y * width + x] = sum / ((double)(x1 - x0) * (y1 - y0));
+        }
+    }
+
+    free(col);
+    return 1;
+}
+
+/** ֵϣ: 8x8Ҷ, ھֵλΪ1 **/
+unsigned long long bmp_ahash(BMP *bmp)
+{
+    unsigned long long hash = 0;
+    double gray[64], avg = 0;
+    int i = 0;
+
+    if (BMPNULL(bmp)) return 0;
+    if (!bmp_gray_area(bmp, 8, 8, gray)) return 0;
+
+    for (i = 0; i < 64; i++)
+        avg += gray[i];
+    avg /= 64;
+    for (i = 0; i < 64; i++)
+        hash |= (unsigned long long)(gray[i] > avg) << i;
+    return hash;
+}
+
+/** ֵϣ: 9x8Ҷ, СұߵλΪ1 **/
+unsigned long long bmp_dhash(BMP *bmp)
+{
+    unsigned long long hash = 0;
+    double gray[72];
+    int x = 0, y = 0;
+
+    if (BMPNULL(bmp)) return 0;
+    if (!bmp_gray_area(bmp, 9, 8, gray)) return 0;
+
+    for (y = 0; y < 8; y++) for (x = 0; x < 8; x++)
+        hash |= (unsigned long long)(gray[y * 9 + x] < gray[y * 9 + x + 1]) << (y * 8 + x);
+    return hash;
+}
+
+static int bmp_double_cmp(const void *a, const void *b)
+{
+    double d = *(const double *)a - *(const double *)b;
+    return d < 0 ? -1 : (d > 0 ? 1 : 0);
+}
+
+/** ֪ϣ: 32x32ҶDCT, ȡƵ8x8, ֵλΪ1 **/
+unsigned long long bmp_phash(BMP *bmp)
+{
+    unsigned long long hash = 0;
+    double gray[32 * 32], cosine[8][32], tmp[32][8], coef[64], sorted[64], median = 0;
+    int u = 0, v = 0, x = 0, y = 0;
+
+    if (BMPNULL(bmp)) return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_PHASH);
+    if (!bmp_gray_area(bmp, 32, 32, gray)) {
+        BMP_STAT_END(BMP_STAT_PHASH, 0);
+        return 0;
+    }
+
+    for (u = 0; u < 8; u++) for (x = 0; x < 32; x++)
+        cosine[u][x] = cos((2 * x + 1) * u * 3.14159265358979323846 / 64);
+
+    //к, ֻҪ8x8
+    for (y = 0; y < 32; y++) for (v = 0; v < 8; v++) {
+        for (tmp[y][v] = 0, x = 0; x < 32; x++)
+            tmp[y][v] += gray[y * 32 + x] * cosine[v][x];
+    }
+    for (u = 0; u < 8; u++) for (v = 0; v < 8; v++) {
+        for (coef[u * 8 + v] = 0, y = 0; y < 32; y++)
+            coef[u * 8 + v] += cosine[u][y] * tmp[y][v];
+    }
+
+    memcpy(sorted, coef, sizeof(coef));
+    qsort(sorted, 64, sizeof(double), bmp_double_cmp);
+    median = (sorted[31] + sorted[32]) / 2;
+    for (u = 0; u < 64; u++)
+        hash |= (unsigned long long)(coef[u] > median) << u;
+
+    BMP_STAT_END(BMP_STAT_PHASH, (double)bmp->width * bmp->height);
+    return hash;
+}
+
+/** ϣĺ **/
+int bmp_hamming(unsigned long long hash, unsigned long long hash2)
+{
+    unsigned long long x = hash ^ hash2;
+
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// +---------------------------------------------------------
+// | ָ(BK)
+// +---------------------------------------------------------
+
+typedef struct BMPHashNode
+{
+    unsigned long long hash;
+    int id;
+    int distance;               //븸ڵľ
+    int child, sibling;         //һӽڵ/һֵܽڵ, -1Ϊ
+}BMPHashNode;
+
+struct BMPHashIndex
+{
+    BMPHashNode *node;
+    int count, capacity;
+};
+
+/**  **/
+BMPHashIndex *bmp_hashindex_create(void)
+{
+    BMPHashIndex *index = NULL;
+
+    if ((index = (BMPHashIndex *)malloc(sizeof(BMPHashIndex))) == NULL) return NULL;
+    memset(index, 0, sizeof(BMPHashIndex));
+    return index;
+}
+
+/** һϣ, idɵ߶ **/
+int bmp_hashindex_add(BMPHashIndex *index, unsigned long long hash, int id)
+{
+    BMPHashNode *node = NULL;
+    int cur = 0, i = 0, distance = 0;
+
+    if (index == NULL) return 0;
+
+    if (index->count == index->capacity) {
+        index->capacity = index->capacity ? index->capacity * 2 : 1024;
+        if ((node = (BMPHashNode *)realloc(index->node, sizeof(BMPHashNode) * index->capacity)) == NULL) {
+            index->capacity = index->count;
+            return 0;
+        }
+        index->node = node;
+    }
+
+    node = index->node + index->count;
+    node->hash = hash;
+    node->id = id;
+    node->distance = 0;
+    node->child = node->sibling = -1;
+
+    //žͬӽڵ, ûʱΪµӽڵ
+    while (index->count > 0) {
+        distance = bmp_hamming(index->node[cur].hash, hash);
+        for (i = index->node[cur].child; i >= 0 && index->node[i].distance != distance; i = index->node[i].sibling);
+        if (i < 0) {
+            node->distance = distance;
+            node->sibling = index->node[cur].child;
+            index->node[cur].child = index->count;
+            break;
+        }
+        cur = i;
+    }
+
+    index->count++;
+    return 1;
+}
+
+/** BK, radius < 0 ʱΪ(뾶), ƥ **/
+static int bmp_hashindex_walk(BMPHashIndex *index, unsigned long long hash, int radius,
+    BMPHashMatch *matches, int max)
+{
+    int *stack = NULL, *grow = NULL, top = 0, size = 256, found = 0;
+    int cur = 0, i = 0, distance = 0, nearest = radius < 0;
+
+    if (index == NULL || index->count == 0) return 0;
+    if ((stack = (int *)malloc(sizeof(int) * size)) == NULL) return 0;
+
+    radius = nearest ? 64 : radius;
+    stack[top++] = 0;
+    while (top > 0) {
+        cur = stack[--top];
+        distance = bmp_hamming(index->node[cur].hash, hash);
+        if (distance <= radius) {
+            if (nearest) {
+                if (found == 0 || distance < matches->distance) {
+                    matches->id = index->node[cur].id;
+                    matches->distance = distance;
+                    radius = distance;
+                    found = 1;
+                }
+            }
+            else {
+                if (found < max) {
+                    matches[found].id = index->node[cur].id;
+                    matches[found].distance = distance;
+                }
+                found++;
+            }
+        }
+
+        //ǲʽ: ֻ븸ڵ [distance - radius, distance + radius] 
+        for (i = index->node[cur].child; i >= 0; i = index->node[i].sibling) {
+            if (index->node[i].distance < distance - radius || index->node[i].distance > distance + radius)
+                continue;
+            if (top == size) {
+                if ((grow = (int *)realloc(stack, sizeof(int) * size * 2)) == NULL) {
+                    free(stack);
+                    return found;
+                }
+                stack = grow;
+                size *= 2;
+            }
+            stack[top++] = i;
+        }
+    }
+
+    free(stack);
+    return found;
+}
+
+/** Ҿ벻maxdistȫϣ(maxdistΪ0ȷ), дmax, ƥ **/
+int bmp_hashindex_find(BMPHashIndex *index, unsigned long long hash, int maxdist, BMPHashMatch *matches, int max)
+{
+    if (maxdist < 0 || (matches == NULL && max > 0)) return 0;
+    return bmp_hashindex_walk(index, hash, maxdist, matches, max);
+}
+
+/** Ĺϣ, Ϊշ0 **/
+int bmp_hashindex_nearest(BMPHashIndex *index, unsigned long long hash, BMPHashMatch *match)
+{
+    if (match == NULL) return 0;
+    return bmp_hashindex_walk(index, hash, -1, match, 1);
+}
+
+/** еĹϣ **/
+int bmp_hashindex_count(BMPHashIndex *index)
+{
+    return index ? index->count : 0;
+}
+
+/** ͷ **/
+void bmp_hashindex_destroy(BMPHashIndex **index)
+{
+    if (index == NULL || *index == NULL)
+        return;
+
+    free((*index)->node);
+    free(*index);
+    *index = NULL;
+}
+
+// +---------------------------------------------------------
+// | ֿͼ(ڴĴͼ)
+// +---------------------------------------------------------
+
+typedef struct BMPTile
+{
+    BMP *bmp;                   //ڴʱΪNULL
+    int pins;                   //, вᱻ
+    int dirty;                  //޸Ĺ, ʱд뽻ļ
+    int spilled;                //ļ
+    int prev, next;             //LRU, prevΪʹ
+}BMPTile;
+
+struct BMPTiled
+{
+    int width, height, alpha;
+    int tilesize, tilesx, tilesy;
+    BMPTile *tile;
+    int resident, maxresident;  //ڴеĿ
+    int head, tail;             //LRUͷ(ʹ)/β
+    FILE *src;                  //ԴBMPļ, ûʱΪNULL
+    long long srcoffset;        //ʼλ
+    int srcperline, srctopdown;
+    FILE *spill;                //ļ, һλʱ
+    size_t tilebytes;           //ֽ, ҲǽļÿĲ۴С
+};
+
+/** ָƫƶд, Ӱõļλ **/
+static int bmp_tiled_io(FILE *fp, void *buf, size_t len, long long offset, int write)
+{
+#ifdef _WIN32
+    if (_fseeki64(fp, offset, SEEK_SET) != 0) return 0;
+    return (write ? fwrite(buf, 1, len, fp) : fread(buf, 1, len, fp)) == len;
+#else
+    ssize_t n = 0;
+
+    while (len > 0) {
+        n = write ? pwrite(fileno(fp), buf, len, (off_t)offset) : pread(fileno(fp), buf, len, (off_t)offset);
+        if (n <= 0) return 0;
+        buf = (unsigned char *)buf + n;
+        len -= n;
+        offset += n;
+    }
+    return 1;
+#endif
+}
+
+static BMPTiled *bmp_tiled_alloc(int width, int height, int alpha, int tilesize, size_t budget)
+{
+    BMPTiled *tiled = NULL;
+    BMP shape;
+    int i = 0;
+
+    if (width <= 0 || height <= 0) return NULL;
+    tilesize = tilesize < 16 ? BMP_TILE_SIZE : tilesize;
+
+    if ((tiled = (BMPTiled *)malloc(sizeof(BMPTiled))) == NULL) return NULL;
+    memset(tiled, 0, sizeof(BMPTiled));
+
+    tiled->width = width;
+    tiled->height = height;
+    tiled->alpha = alpha == 1 ? 1 : 0;
+    tiled->tilesize = tilesize;
+    tiled->tilesx = (width + tilesize - 1) / tilesize;
+    tiled->tilesy = (height + tilesize - 1) / tilesize;
+    tiled->head = tiled->tail = -1;
+
+    shape.width = tilesize;
+    shape.alpha = tiled->alpha;
+    tiled->tilebytes = (size_t)BMP_PERLINE_REALSIZE((&shape)) * tilesize;
+    tiled->maxresident = (int)(budget / tiled->tilebytes);
+    tiled->maxresident = tiled->maxresident < 2 ? 2 : tiled->maxresident;
+
+    if ((tiled->tile = (BMPTile *)malloc(sizeof(BMPTile) * tiled->tilesx * tiled->tilesy)) == NULL) {
+        free(tiled);
+        return NULL;
+    }
+    memset(tiled->tile, 0, sizeof(BMPTile) * tiled->tilesx * tiled->tilesy);
+    for (i = 0; i < tiled->tilesx * tiled->tilesy; i++)
+        tiled->tile[i].prev = tiled->tile[i].next = -1;
+    return tiled;
+}
+
+/** հ׷ֿͼ, ڽļ, budgetΪڴпֽ **/
+BMPTiled *bmp_tiled_create(int width, int height, int alpha, int tilesize, size_t budget)
+{
+    return bmp_tiled_alloc(width, height, alpha, tilesize, budget);
+}
+
+/** Էֿ鷽ʽBMPļ, , Դļᱻ޸ **/
+BMPTiled *bmp_tiled_open(const char *file, int tilesize, size_t budget)
+{
+    unsigned char header[BMP_HEADER_SIZE + BMP_MASKS_SIZE];
+    BMPTiled *tiled = NULL;
+    BMP shape;
+    FILE *fp = NULL;
+    unsigned long long length = 0;
+    unsigned long offbits = 0;
+    size_t len = 0;
+    int topdown = 0;
+
+    if (STRNULL(file) || (fp = fopen(file, "rb")) == NULL) return NULL;
+
+    memset(&shape, 0, sizeof(BMP));
+    len = fread(header, 1, sizeof(header), fp);
+    if (len < BMP_HEADER_SIZE || !bmp_parse_header(header, len, &shape, &topdown, &offbits) ||
+        !bmp_file_length(fp, &length) || length < offbits || length - offbits < (unsigned long long)shape.size ||
+        (tiled = bmp_tiled_alloc(shape.width, shape.height, shape.alpha, tilesize, budget)) == NULL) {
+        fclose(fp);
+        return NULL;
+    }
+
+    tiled->src = fp;
+    tiled->srcoffset = offbits;
+    tiled->srcperline = BMP_PERLINE_REALSIZE((&shape));
+    tiled->srctopdown = topdown;
+    return tiled;
+}
+
+/** Ƿalpha **/
+void bmp_tiled_info(BMPTiled *tiled, int *width, int *height, int *alpha)
+{
+    if (tiled == NULL) return;
+    if (width) *width = tiled->width;
+    if (height) *height = tiled->height;
+    if (alpha) *alpha = tiled->alpha;
+}
+
+static void bmp_tiled_unlink(BMPTiled *tiled, int i)
+{
+    BMPTile *t = tiled->tile + i;
+
+    if (t->prev >= 0) tiled->tile[t->prev].next = t->next; else tiled->head = t->next;
+    if (t->next >= 0) tiled->tile[t->next].prev = t->prev; else tiled->tail = t->prev;
+    t->prev = t->next = -1;
+}
+
+static void bmp_tiled_push(BMPTiled *tiled, int i)
+{
+    BMPTile *t = tiled->tile + i;
+
+    t->prev = -1;
+    t->next = tiled->head;
+    if (tiled->head >= 0) tiled->tile[tiled->head].prev = i; else tiled->tail = i;
+    tiled->head = i;
+}
+
+/** һ, д뽻ļ **/
+static int bmp_tiled_evict(BMPTiled *tiled, int i)
+{
+    BMPTile *t = tiled->tile + i;
+
+    if (t->dirty) {
+        if (tiled->spill == NULL && (tiled->spill = tmpfile()) == NULL) return 0;
+        if (!bmp_tiled_io(tiled->spill, t->bmp->data, t->bmp->size, (long long)i * tiled->tilebytes, 1)) return 0;
+        t->spilled = 1;
+        t->dirty = 0;
+    }
+
+    bmp_tiled_unlink(tiled, i);
+    bmp_destroy(&t->bmp);
+    tiled->resident--;
+    return 1;
+}
+
+/** һ: ļ > Դļ > ȫ0 **/
+static int bmp_tiled_fill(BMPTiled *tiled, int i, BMP *bmp)
+{
+    int tx = i % tiled->tilesx, ty = i / tiled->tilesx, y = 0, row = 0, perline = 0;
+    long long offset = 0;
+
+    if (tiled->tile[i].spilled)
+        return bmp_tiled_io(tiled->spill, bmp->data, bmp->size, (long long)i * tiled->tilebytes, 0);
+
+    if (tiled->src == NULL) {
+        memset(bmp->data, 0, bmp->size);
+        return 1;
+    }
+
+    perline = BMP_PERLINE_REALSIZE(bmp);
+    for (y = 0; y < bmp->height; y++) {
+        row = ty * tiled->tilesize + y;
+        row = tiled->srctopdown ? row : tiled->height - 1 - row;
+        offset = tiled->srcoffset + (long long)row * tiled->srcperline + (long long)tx * tiled->tilesize * (tiled->alpha == 1 ? 4 : 3);
+        if (!bmp_tiled_io(tiled->src, bmp->data + (size_t)y * perline, bmp->width * (tiled->alpha == 1 ? 4 : 3), offset, 0))
+            return 0;
+    }
+    return 1;
+}
+
+/** (tx, ty)鲢, bmp_tiled_unlock, صBMPͷ **/
+BMP *bmp_tiled_lock(BMPTiled *tiled, int tx, int ty)
+{
+    BMPTile *t = NULL;
+    BMP *bmp = NULL;
+    int i = 0, victim = 0;
+
+    if (tiled == NULL || tx < 0 || ty < 0 || tx >= tiled->tilesx || ty >= tiled->tilesy) return NULL;
+    i = ty * tiled->tilesx + tx;
+    t = tiled->tile + i;
+
+    if (t->bmp == NULL) {
+        //Ԥʱδõһ˻, ȫʱ
+        for (victim = tiled->tail; tiled->resident >= tiled->maxresident && victim >= 0; ) {
+            if (tiled->tile[victim].pins > 0) {
+                victim = tiled->tile[victim].prev;
+                continue;
+            }
+            if (!bmp_tiled_evict(tiled, victim)) return NULL;
+            victim = tiled->tail;
+        }
+
+        if ((bmp = (BMP *)malloc(sizeof(BMP))) == NULL) return NULL;
+        bmp->width = tx == tiled->tilesx - 1 ? tiled->width - tx * tiled->tilesize : tiled->tilesize;
+        bmp->height = ty == tiled->tilesy - 1 ? tiled->height - ty * tiled->tilesize : tiled->tilesize;
+        bmp->alpha = tiled->alpha;
+        bmp->size = (size_t)BMP_PERLINE_REALSIZE(bmp) * bmp->height;
+        if ((bmp->data = (unsigned char *)malloc(bmp->size)) == NULL || !bmp_tiled_fill(tiled, i, bmp)) {
+            bmp_destroy(&bmp);
+            return NULL;
+        }
+        t->bmp = bmp;
+        tiled->resident++;
+    }
+    else {
+        bmp_tiled_unlink(tiled, i);
+    }
+
+    bmp_tiled_push(tiled, i);
+    t->pins++;
+    return t->bmp;
+}
+
+/** , dirty == 1 ʾݱ޸ **/
+void bmp_tiled_unlock(BMPTiled *tiled, int tx, int ty, int dirty)
+{
+    BMPTile *t = NULL;
+
+    if (tiled == NULL || tx < 0 || ty < 0 || tx >= tiled->tilesx || ty >= tiled->tilesy) return;
+    t = tiled->tile + ty * tiled->tilesx + tx;
+    if (t->pins > 0) t->pins--;
+    if (dirty) t->dirty = 1;
+}
+
+/** ƻдؾ, write == 1 ʱbmpдֿͼ **/
+static int bmp_tiled_rect(BMPTiled *tiled, int left, int top, BMP *bmp, int write)
+{
+    BMP *tile = NULL;
+    unsigned char *a = NULL, *b = NULL;
+    int tx = 0, ty = 0, x0 = 0, y0 = 0, x1 = 0, y1 = 0, y = 0;
+    int bytepix = tiled->alpha == 1 ? 4 : 3, ts = tiled->tilesize;
+
+    for (ty = top / ts; ty <= (top + bmp->height - 1) / ts; ty++) {
+        for (tx = left / ts; tx <= (left + bmp->width - 1) / ts; tx++) {
+            if ((tile = bmp_tiled_lock(tiled, tx, ty)) == NULL) return 0;
+
+            //Ľ, 
+            x0 = left > tx * ts ? left - tx * ts : 0;
+            y0 = top > ty * ts ? top - ty * ts : 0;
+            x1 = left + bmp->width < tx * ts + tile->width ? left + bmp->width - tx * ts : tile->width;
+            y1 = top + bmp->height < ty * ts + tile->height ? top + bmp->height - ty * ts : tile->height;
+            for (y = y0; y < y1; y++) {
+                a = tile->data + (size_t)y * BMP_PERLINE_REALSIZE(tile) + x0 * bytepix;
+                b = bmp->data + (size_t)(ty * ts + y - top) * BMP_PERLINE_REALSIZE(bmp) + (tx * ts + x0 - left) * bytepix;
+                if (write) memcpy(a, b, (size_t)(x1 - x0) * bytepix);
+                else memcpy(b, a, (size_t)(x1 - x0) * bytepix);
+            }
+
+            bmp_tiled_unlock(tiled, tx, ty, write);
+        }
+    }
+    return 1;
+}
+
+/** һֵڴ(alpha), ͼĲֱõ **/
+BMP *bmp_tiled_copy_rect(BMPTiled *tiled, int left, int top, int right, int bottom)
+{
+    BMP *bmp = NULL;
+
+    if (tiled == NULL) return NULL;
+    left = left < 0 ? 0 : left;
+    top = top < 0 ? 0 : top;
+    right = right > tiled->width ? tiled->width : right;
+    bottom = bottom > tiled->height ? tiled->height : bottom;
+    if (right <= left || bottom <= top) return NULL;
+
+    if ((bmp = (BMP *)malloc(sizeof(BMP))) == NULL) return NULL;
+    bmp->width = right - left;
+    bmp->height = bottom - top;
+    bmp->alpha = tiled->alpha;
+    bmp->size = (size_t)BMP_PERLINE_REALSIZE(bmp) * bmp->height;
+    if ((bmp->data = (unsigned char *)malloc(bmp->size)) == NULL) {
+        free(bmp);
+        return NULL;
+    }
+    memset(bmp->data, 0, bmp->size);
+
+    if (!bmp_tiled_rect(tiled, left, top, bmp, 0))
+        bmp_destroy(&bmp);
+    return bmp;
+}
+
+/** ڴеͼд(left, top), bmpλֿͼһ **/
+int bmp_tiled_paste(BMPTiled *tiled, BMP *bmp, int left, int top)
+{
+    if (tiled == NULL || BMPNULL(bmp) || bmp->alpha != tiled->alpha) return 0;
+    if (left < 0 || top < 0 || left + bmp->width > tiled->width || top + bmp->height > tiled->height) return 0;
+    return bmp_tiled_rect(tiled, left, top, bmp, 1);
+}
+
+/** üΪµķֿͼ **/
+BMPTiled *bmp_tiled_crop(BMPTiled *tiled, int left, int top, int right, int bottom)
+{
+    BMPTiled *dst = NULL;
+    BMP *part = NULL;
+    int tx = 0, ty = 0, ts = 0;
+
+    if (tiled == NULL) return NULL;
+    left = left < 0 ? 0 : left;
+    top = top < 0 ? 0 : top;
+    right = right > tiled->width ? tiled->width : right;
+    bottom = bottom > tiled->height ? tiled->height : bottom;
+    if (right <= left || bottom <= top) return NULL;
+
+    ts = tiled->tilesize;
+    dst = bmp_tiled_alloc(right - left, bottom - top, tiled->alpha, ts, (size_t)tiled->maxresident * tiled->tilebytes);
+    if (dst == NULL) return NULL;
+
+    for (ty = 0; ty < dst->tilesy; ty++) for (tx = 0; tx < dst->tilesx; tx++) {
+        part = bmp_tiled_copy_rect(tiled, left + tx * ts, top + ty * ts,
+            left + (tx + 1) * ts < right ? left + (tx + 1) * ts : right,
+            top + (ty + 1) * ts < bottom ? top + (ty + 1) * ts : bottom);
+        if (part == NULL || !bmp_tiled_paste(dst, part, tx * ts, ty * ts)) {
+            bmp_destroy(&part);
+            bmp_tiled_close(&dst);
+            return NULL;
+        }
+        bmp_destroy(&part);
+    }
+    return dst;
+}
+
+/** ֱͼ(ͳ), offsetΪͨ, 256, free **/
+unsigned long long *bmp_tiled_histogram(BMPTiled *tiled, int offset)
+{
+    unsigned long long *histogram = NULL;
+    BMP *tile = NULL;
+    const unsigned char *s = NULL;
+    int tx = 0, ty = 0, w = 0, h = 0, bytepix = 0;
+
+    if (tiled == NULL || offset < 0 || offset > 3) return NULL;
+    if ((histogram = (unsigned long long *)malloc(sizeof(unsigned long long) * 256)) == NULL) return NULL;
+    memset(histogram, 0, sizeof(unsigned long long) * 256);
+
+    bytepix = tiled->alpha == 1 ? 4 : 3;
+    for (ty = 0; ty < tiled->tilesy; ty++) for (tx = 0; tx < tiled->tilesx; tx++) {
+        if ((tile = bmp_tiled_lock(tiled, tx, ty)) == NULL) {
+            free(histogram);
+            return NULL;
+        }
+        for (h = 0; h < tile->height; h++) {
+            s = tile->data + (size_t)h * BMP_PERLINE_REALSIZE(tile) + offset;
+            for (w = 0; w < tile->width; w++, s += bytepix)
+                histogram[*s]++;
+        }
+        bmp_tiled_unlock(tiled, tx, ty, 0);
+    }
+    return histogram;
+}
+
+/** ˲µķֿͼ, ÿȡhalo, haloС˲뾶ʱͼ˲һ **/
+BMPTiled *bmp_tiled_filter(BMPTiled *tiled, int halo, BMPTileFilter filter, void *userdata)
+{
+    BMPTiled *dst = NULL;
+    BMP *part = NULL, *tile = NULL;
+    int tx = 0, ty = 0, ts = 0, left = 0, top = 0, y = 0, bytepix = 0;
+
+    if (tiled == NULL || filter == NULL) return NULL;
+    halo = halo < 0 ? 0 : halo;
+
+    ts = tiled->tilesize;
+    dst = bmp_tiled_alloc(tiled->width, tiled->height, tiled->alpha, ts, (size_t)tiled->maxresident * tiled->tilebytes);
+    if (dst == NULL) return NULL;
+
+    bytepix = tiled->alpha == 1 ? 4 : 3;
+    for (ty = 0; ty < tiled->tilesy; ty++) for (tx = 0; tx < tiled->tilesx; tx++) {
+        left = tx * ts - halo < 0 ? 0 : tx * ts - halo;
+        top = ty * ts - halo < 0 ? 0 : ty * ts - halo;
+        part = bmp_tiled_copy_rect(tiled, left, top, (tx + 1) * ts + halo, (ty + 1) * ts + halo);
+        if (part == NULL || (tile = bmp_tiled_lock(dst, tx, ty)) == NULL) {
+            bmp_destroy(&part);
+            bmp_tiled_close(&dst);
+            return NULL;
+        }
+
+        filter(part, userdata);
+        for (y = 0; y < tile->height; y++) {
+            memcpy(tile->data + (size_t)y * BMP_PERLINE_REALSIZE(tile),
+                part->data + (size_t)(ty * ts + y - top) * BMP_PERLINE_REALSIZE(part) + (tx * ts - left) * bytepix,
+                (size_t)tile->width * bytepix);
+        }
+
+        bmp_tiled_unlock(dst, tx, ty, 1);
+        bmp_destroy(&part);
+    }
+    return dst;
+}
+
+/** תµķֿͼ, ͬbmp_rotate; ÿĿֻӦԴ **/
+BMPTiled *bmp_tiled_rotate(BMPTiled *tiled, double angle, int flag, BMPBGR fillclr)
+{
+    BMPTiled *dst = NULL;
+    BMP *part = NULL, *tile = NULL;
+    double routeangle = 0, cos_angle = 0, sin_angle = 0, fx = 0, fy = 0;
+    int after_mid_x = 0, after_mid_y = 0, before_mid_x = 0, before_mid_y = 0;
+    int tx = 0, ty = 0, ts = 0, w = 0, h = 0, x = 0, y = 0, i = 0, bytepix = 0;
+    int left = 0, top = 0, right = 0, bottom = 0, before_x = 0, before_y = 0;
+    unsigned char *d = NULL;
+    const unsigned char *s = NULL;
+
+    if (tiled == NULL) return NULL;
+
+    routeangle = 1.0 * angle * PI / 180;
+    cos_angle = cos(routeangle);
+    sin_angle = sin(routeangle);
+    before_mid_x = tiled->width / 2;
+    before_mid_y = tiled->height / 2;
+    after_mid_x = flag == 0 ? before_mid_x : tiled->width;
+    after_mid_y = flag == 0 ? before_mid_y : tiled->height;
+
+    ts = tiled->tilesize;
+    dst = bmp_tiled_alloc(flag == 0 ? tiled->width : tiled->width * 2, flag == 0 ? tiled->height : tiled->height * 2,
+        tiled->alpha, ts, (size_t)tiled->maxresident * tiled->tilebytes);
+    if (dst == NULL) return NULL;
+
+    bytepix = tiled->alpha == 1 ? 4 : 3;
+    for (ty = 0; ty < dst->tilesy; ty++) for (tx = 0; tx < dst->tilesx; tx++) {
+        if ((tile = bmp_tiled_lock(dst, tx, ty)) == NULL) {
+            bmp_tiled_close(&dst);
+            return NULL;
+        }
+
+        //ĿĽӳԴͼӾ
+        left = top = INT_MAX;
+        right = bottom = INT_MIN;
+        for (i = 0; i < 4; i++) {
+            y = ty * ts + (i / 2) * tile->height - after_mid_y;
+            x = tx * ts + (i % 2) * tile->width - after_mid_x;
+            fy = cos_angle * y - sin_angle * x + before_mid_y;
+            fx = sin_angle * y + cos_angle * x + before_mid_x;
+            top = (int)floor(fy) - 1 < top ? (int)floor(fy) - 1 : top;
+            bottom = (int)ceil(fy) + 2 > bottom ? (int)ceil(fy) + 2 : bottom;
+            left = (int)floor(fx) - 1 < left ? (int)floor(fx) - 1 : left;
+            right = (int)ceil(fx) + 2 > right ? (int)ceil(fx) + 2 : right;
+        }
+        part = bmp_tiled_copy_rect(tiled, left, top, right, bottom);
+        left = left < 0 ? 0 : left;
+        top = top < 0 ? 0 : top;
+
+        for (h = 0; h < tile->height; h++) {
+            d = tile->data + (size_t)h * BMP_PERLINE_REALSIZE(tile);
+            for (w = 0; w < tile->width; w++, d += bytepix) {
+                y = ty * ts + h - after_mid_y;
+                x = tx * ts + w - after_mid_x;
+                before_y = (int)(cos_angle * y - sin_angle * x) + before_mid_y;
+                before_x = (int)(sin_angle * y + cos_angle * x) + before_mid_x;
+                d[0] = fillclr.b;
+                d[1] = fillclr.g;
+                d[2] = fillclr.r;
+                if (part && before_y >= top && before_y < top + part->height && before_x >= left && before_x < left + part->width) {
+                    s = part->data + (size_t)(before_y - top) * BMP_PERLINE_REALSIZE(part) + (before_x - left) * bytepix;
+                    memcpy(d, s, bytepix);
+                }
+            }
+        }
+
+        bmp_destroy(&part);
+        bmp_tiled_unlock(dst, tx, ty, 1);
+    }
+    return dst;
+}
+
+/** ΪBMPļ, ÿֻһߵл **/
+int bmp_tiled_save(BMPTiled *tiled, const char *file)
+{
+    unsigned char header[BMP_HEADER_SIZE];
+    BMP shape, *band = NULL;
+    FILE *fp = NULL;
+    int ty = 0, y = 0, recode = 0, perline = 0;
+
+    if (tiled == NULL || STRNULL(file)) return 0;
+
+    memset(&shape, 0, sizeof(BMP));
+    shape.width = tiled->width;
+    shape.height = tiled->height;
+    shape.alpha = tiled->alpha;
+    perline = BMP_PERLINE_REALSIZE((&shape));
+    bmp_make_header(&shape, 0, header);
+
+    if ((fp = fopen(file, "wb")) == NULL) return 0;
+    recode = fwrite(header, 1, BMP_HEADER_SIZE, fp) == BMP_HEADER_SIZE;
+
+    //¶д
+    for (ty = tiled->tilesy - 1; ty >= 0 && recode; ty--) {
+        band = bmp_tiled_copy_rect(tiled, 0, ty * tiled->tilesize, tiled->width, (ty + 1) * tiled->tilesize);
+        if (band == NULL) {
+            recode = 0;
+            break;
+        }
+        for (y = band->height - 1; y >= 0 && recode; y--)
+            recode = fwrite(band->data + (size_t)y * perline, 1, perline, fp) == (size_t)perline;
+        bmp_destroy(&band);
+    }
+
+    if (fclose(fp) != 0)
+        recode = 0;
+    return recode;
+}
+
+/** رշֿͼ, δ޸Ļᶪʧ **/
+void bmp_tiled_close(BMPTiled **tiled)
+{
+    int i = 0;
+
+    if (tiled == NULL || *tiled == NULL)
+        return;
+
+    for (i = 0; i < (*tiled)->tilesx * (*tiled)->tilesy; i++)
+        bmp_destroy(&(*tiled)->tile[i].bmp);
+    if ((*tiled)->src) fclose((*tiled)->src);
+    if ((*tiled)->spill) fclose((*tiled)->spill);
+    free((*tiled)->tile);
+    free(*tiled);
+    *tiled = NULL;
+}
+
+// +---------------------------------------------------------
+// | 
+// +---------------------------------------------------------
+
+/** ʼΪӳ **/
+void bmp_lut_init(BMPLut *lut, int mode)
+{
+    int c = 0, i = 0;
+
+    if (lut == NULL) return;
+    for (c = 0; c < 3; c++) for (i = 0; i < 256; i++)
+        lut->table[c][i] = (unsigned char)i;
+    lut->mode = mode;
+}
+
+/** ӳ֮׷table, channelΪ-1ʱȫͨ **/
+void bmp_lut_map(BMPLut *lut, int channel, const unsigned char *table)
+{
+    int c = 0, i = 0;
+
+    if (lut == NULL || table == NULL) return;
+    for (c = 0; c < 3; c++) {
+        if (channel >= 0 && channel != c) continue;
+        for (i = 0; i < 256; i++)
+            lut->table[c][i] = table[lut->table[c][i]];
+    }
+}
+
+static unsigned char bmp_lut_clamp(double v)
+{
+    return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : (int)(v + 0.5)));
+}
+
+/** : delta **/
+void bmp_lut_brightness(BMPLut *lut, int delta)
+{
+    unsigned char table[256];
+    int i = 0;
+
+    for (i = 0; i < 256; i++)
+        table[i] = bmp_lut_clamp(i + delta);
+    bmp_lut_map(lut, -1, table);
+}
+
+/** Աȶ: 128ΪķŴk **/
+void bmp_lut_contrast(BMPLut *lut, double k)
+{
+    unsigned char table[256];
+    int i = 0;
+
+    for (i = 0; i < 256; i++)
+        table[i] = bmp_lut_clamp((i - 128) * k + 128);
+    bmp_lut_map(lut, -1, table);
+}
+
+/** gammaУ: 255 * (i / 255) ^ (1 / gamma) **/
+void bmp_lut_gamma(BMPLut *lut, double gamma)
+{
+    unsigned char table[256];
+    int i = 0;
+
+    if (gamma <= 0) return;
+    for (i = 0; i < 256; i++)
+        table[i] = bmp_lut_clamp(255 * pow(i / 255.0, 1 / gamma));
+    bmp_lut_map(lut, -1, table);
+}
+
+/** ɫ **/
+void bmp_lut_invert(BMPLut *lut)
+{
+    unsigned char table[256];
+    int i = 0;
+
+    for (i = 0; i < 256; i++)
+        table[i] = (unsigned char)(255 - i);
+    bmp_lut_map(lut, -1, table);
+}
+
+/** ɫ: [inblack, inwhite] ӳ䵽 [outblack, outwhite] **/
+void bmp_lut_levels(BMPLut *lut, int inblack, int inwhite, int outblack, int outwhite)
+{
+    unsigned char table[256];
+    int i = 0;
+
+    if (inwhite <= inblack) return;
+    for (i = 0; i < 256; i++) {
+        if (i <= inblack) table[i] = bmp_lut_clamp(outblack);
+        else if (i >= inwhite) table[i] = bmp_lut_clamp(outwhite);
+        else table[i] = bmp_lut_clamp(outblack + (double)(i - inblack) * (outwhite - outblack) / (inwhite - inblack));
+    }
+    bmp_lut_map(lut, -1, table);
+}
+
+/** ֵ: СkΪ255, Ϊ0 **/
+void bmp_lut_threshold(BMPLut *lut, int k)
+{
+    unsigned char table[256];
+    int i = 0;
+
+    for (i = 0; i < 256; i++)
+        table[i] = i >= k ? 0xff : 0x00;
+    bmp_lut_map(lut, -1, table);
+}
+
+#ifdef __AVX2__
+/** 2561616ֽڵСpshufb:
+    idx = (x - 16k) + 0x70, ֻи4λΪkֽλΪ0, Ϊ0 **/
+static __m256i bmp_lut_shuffle(__m256i x, const __m256i *t)
+{
+    __m256i r = _mm256_setzero_si256(), k70 = _mm256_set1_epi8(0x70), k16 = _mm256_set1_epi8(16);
+    int k = 0;
+
+    for (k = 0; k < 16; k++) {
+        r = _mm256_or_si256(r, _mm256_shuffle_epi8(t[k], _mm256_adds_epu8(x, k70)));
+        x = _mm256_sub_epi8(x, k16);
+    }
+    return r;
+}
+
+static void bmp_lut_load(const unsigned char *table, __m256i *t)
+{
+    int k = 0;
+
+    for (k = 0; k < 16; k++)
+        t[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(table + k * 16)));
+}
+
+/** ͨͬһűʱһ: 24λͼȫֱֽӲ, 32λͼalpha; شλ **/
+static int bmp_lut_row_avx2(const __m256i *t, int bytepix, unsigned char *p, int len)
+{
+    __m256i x, v, alpha = _mm256_set1_epi32((int)0xFF000000);
+    int i = 0;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        x = _mm256_loadu_si256((const __m256i *)(p + i));
+        v = bmp_lut_shuffle(x, t);
+        if (bytepix == 4) v = _mm256_blendv_epi8(v, x, alpha);
+        _mm256_storeu_si256((__m256i *)(p + i), v);
+    }
+    return i;
+}
+#endif
+
+/** 任ÿ(alpha), ֻдһڴ **/
+void bmp_apply_lut(BMP *bmp, const BMPLut *lut)
+{
+    double weight[3][256];
+    unsigned char *p = NULL, fused[3][766];
+    int w = 0, h = 0, c = 0, i = 0, v = 0, same = 0, done = 0;
+    int bytepix = 0, perline = 0, len = 0;
+#ifdef __AVX2__
+    __m256i t[16];
+#endif
+
+    if (BMPNULL(bmp) || lut == NULL) return;
+
+    BMP_STAT_BEGIN(BMP_STAT_APPLY_LUT);
+    perline = BMP_PERLINE_REALSIZE(bmp);
+    bytepix = bmp->alpha == 1 ? 4 : 3;
+    len = bmp->width * bytepix;
+
+    if (lut->mode == BMP_LUT_GRAY) {
+        //bmp_convert_grayͬĸ˳, λһ
+        for (i = 0; i < 256; i++) {
+            weight[2][i] = i * 0.3;
+            weight[1][i] = i * 0.59;
+            weight[0][i] = i * 0.11;
+        }
+        for (h = 0; h < bmp->height; h++) {
+            p = bmp->data + (size_t)h * perline;
+            for (w = 0; w < bmp->width; w++, p += bytepix) {
+                v = (int)(weight[2][p[2]] + weight[1][p[1]] + weight[0][p[0]]);
+                v = v > 255 ? 255 : v;
+                p[0] = lut->table[0][v];
+                p[1] = lut->table[1][v];
+                p[2] = lut->table[2][v];
+            }
+        }
+    }
+    else if (lut->mode == BMP_LUT_AVERAGE) {
+        //3ϲ
+        for (c = 0; c < 3; c++) for (i = 0; i < 766; i++)
+            fused[c][i] = lut->table[c][i / 3];
+        for (h = 0; h < bmp->height; h++) {
+            p = bmp->data + (size_t)h * perline;
+            for (w = 0; w < bmp->width; w++, p += bytepix) {
+                v = p[0] + p[1] + p[2];
+                p[0] = fused[0][v];
+                p[1] = fused[1][v];
+                p[2] = fused[2][v];
+            }
+        }
+    }
+    else {
+        same = !memcmp(lut->table[0], lut->table[1], 256) && !memcmp(lut->table[0], lut->table[2], 256);
+#ifdef __AVX2__
+        if (same) bmp_lut_load(lut->table[0], t);
+#endif
+        for (h = 0; h < bmp->height; h++) {
+            p = bmp->data + (size_t)h * perline;
+            done = 0;
+#ifdef __AVX2__
+            //űͬʱλûβȱ, ֻͬһűʱʹ
+            if (same) done = bmp_lut_row_avx2(t, bytepix, p, len);
+#endif
+            if (same && bytepix == 3) {
+                for (i = done; i < len; i++)
+                    p[i] = lut->table[0][p[i]];
+                continue;
+            }
+            for (i = done; i < len; i += bytepix) {
+                p[i] = lut->table[0][p[i]];
+                p[i + 1] = lut->table[1][p[i + 1]];
+                p[i + 2] = lut->table[2][p[i + 2]];
+            }
+        }
+    }
+
+    BMP_STAT_END(BMP_STAT_APPLY_LUT, (double)bmp->width * bmp->height);
+}
+
+// +---------------------------------------------------------
+// | 
+// +---------------------------------------------------------
+
+//[begin, end)Χ
+typedef void (*BMPParallelFn)(void *arg, int begin, int end);
+
+#define BMP_PARALLEL_MAX 64
+
+#ifndef BMP_NO_THREAD
+
+/** CPU **/
+static int bmp_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+typedef struct BMPParallelRange
+{
+    BMPParallelFn fn;
+    void *arg;
+    int begin, end;
+    bmp_thread_t thread;
+    int started;
+}BMPParallelRange;
+
+BMP_THREAD_PROC(bmp_parallel_worker, arg)
+{
+    BMPParallelRange *range = (BMPParallelRange *)arg;
+
+    range->fn(range->arg, range->begin, range->end);
+    BMP_THREAD_RETURN;
+}
+
+#endif
+
+/** bmp_parallel_forcountֳɵĶ, iδ count * i /  ʼ **/
+static int bmp_parallel_threads(int count)
+{
+#ifndef BMP_NO_THREAD
+    int threads = BMP_PARALLEL_THREADS > 0 ? BMP_PARALLEL_THREADS : bmp_cpu_count();
+
+    threads = threads > count ? count : threads;
+    threads = threads > BMP_PARALLEL_MAX ? BMP_PARALLEL_MAX : threads;
+    return threads > 1 ? threads : 1;
+#else
+    (void)count;
+    return 1;
+#endif
+}
+
+/** ɶεκ, ÿԤȷ仺ʹ **/
+static int bmp_parallel_slot(int count, int begin)
+{
+    int threads = bmp_parallel_threads(count);
+
+    //begin = floor(count * i / threads), threads <= count ʱȡi
+    return (int)(((long long)begin * threads + count - 1) / count);
+}
+
+/** [0, count)ָ߳, ̴߳һ, ȫɺ󷵻 **/
+static void bmp_parallel_for(int count, BMPParallelFn fn, void *arg)
+{
+#ifndef BMP_NO_THREAD
+    BMPParallelRange range[BMP_PARALLEL_MAX];
+    int i = 0, threads = bmp_parallel_threads(count);
+
+    if (threads > 1) {
+        for (i = 0; i < threads; i++) {
+            range[i].fn = fn;
+            range[i].arg = arg;
+            range[i].begin = (int)((long long)count * i / threads);
+            range[i].end = (int)((long long)count * (i + 1) / threads);
+            //ʧʱɵ߳
+            range[i].started = i > 0 && bmp_thread_create(&range[i].thread, bmp_parallel_worker, &range[i]);
+        }
+        for (i = 0; i < threads; i++) {
+            if (!range[i].started) fn(arg, range[i].begin, range[i].end);
+        }
+        for (i = 1; i < threads; i++) {
+            if (range[i].started) bmp_thread_join(range[i].thread);
+        }
+        return;
+    }
+#endif
+    fn(arg, 0, count);
+}
+
+// +---------------------------------------------------------
+// | ֡
+// +---------------------------------------------------------
+
+typedef struct BMPDiffJob
+{
+    BMP *bmp1, *bmp2;
+    BMPDiff *diff;
+    int tolerance, flags;
+}BMPDiffJob;
+
+/** n(<=64)ֽǷtoleranceֽ, skipalphaʱÿ4ֽڵĵ4 **/
+static int bmp_diff_bytes(const unsigned char *a, const unsigned char *b, int n, int tolerance, int skipalpha)
+{
+    int i = 0, d = 0;
+#ifdef __AVX2__
+    __m256i va, vb, vt = _mm256_set1_epi8((char)(tolerance > 255 ? 255 : tolerance)), zero = _mm256_setzero_si256();
+    unsigned int m = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        va = _mm256_loadu_si256((const __m256i *)(a + i));
+        vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        if (tolerance == 0) {
+            m = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+        } else {
+            //|a - b| > t  sat(|a - b| - t) != 0
+            va = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+            m = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(va, vt), zero));
+        }
+        if (skipalpha) m &= 0x77777777u;
+        if (m) return 1;
+    }
+#else
+    //ûб仯, αȽ
+    if (memcmp(a, b, n) == 0) return 0;
+    if (tolerance == 0 && !skipalpha) return 1;
+#endif
+    for (; i < n; i++) {
+        if (skipalpha && (i & 3) == 3) continue;
+        d = a[i] - b[i];
+        if (d > tolerance || d < -tolerance) return 1;
+    }
+    return 0;
+}
+
+/** Ƿ仯 **/
+static int bmp_diff_pixel(const unsigned char *a, const unsigned char *b, int channels, int tolerance)
+{
+    int c = 0, d = 0;
+
+    for (c = 0; c < channels; c++) {
+        d = a[c] - b[c];
+        if (d > tolerance || d < -tolerance) return 1;
+    }
+    return 0;
+}
+
+/** Ƚϵ[begin, end) **/
+static void bmp_diff_rows(void *arg, int begin, int end)
+{
+    BMPDiffJob *job = (BMPDiffJob *)arg;
+    BMPDiff *diff = job->diff;
+    const unsigned char *a = NULL, *b = NULL;
+    unsigned char *bit = NULL;
+    int tx = 0, ty = 0, x = 0, y = 0, y1 = 0, x0 = 0, x1 = 0, off = 0, n = 0, len = 0, next = 0, px1 = 0;
+    int bytepix = job->bmp1->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(job->bmp1);
+    int count = job->flags & BMP_DIFF_COUNT, channels = 3, skipalpha = 0;
+
+    if (bytepix == 4) {
+        if (job->flags & BMP_DIFF_ALPHA) channels = 4;
+        else skipalpha = 1;
+    }
+
+    for (ty = begin; ty < end; ty++) {
+        y1 = (ty + 1) * diff->tile > job->bmp1->height ? job->bmp1->height : (ty + 1) * diff->tile;
+        for (y = ty * diff->tile; y < y1; y++) for (tx = 0; tx < diff->cols; tx++) {
+            bit = diff->bitmap + (size_t)ty * diff->stride + tx / 8;
+            //ֻҪǷ仯ʱ, ѱ仯Ŀ鲻ٱȽ
+            if (!count && (*bit >> (tx & 7) & 1)) continue;
+
+            x0 = tx * diff->tile;
+            x1 = x0 + diff->tile > job->bmp1->width ? job->bmp1->width : x0 + diff->tile;
+            a = job->bmp1->data + (size_t)y * perline + x0 * bytepix;
+            b = job->bmp2->data + (size_t)y * perline + x0 * bytepix;
+            len = (x1 - x0) * bytepix;
+            next = x0;
+
+            //ÿ64ֽ, вʱȷ
+            for (off = 0; off < len; off += 64) {
+                n = len - off > 64 ? 64 : len - off;
+                if (!bmp_diff_bytes(a + off, b + off, n, job->tolerance, skipalpha)) continue;
+                *bit |= (unsigned char)(1 << (tx & 7));
+                if (!count) break;
+
+                //εֻһ
+                x = x0 + off / bytepix;
+                x = x < next ? next : x;
+                px1 = x0 + (off + n + bytepix - 1) / bytepix;
+                for (; x < px1; x++) {
+                    if (bmp_diff_pixel(a + (x - x0) * bytepix, b + (x - x0) * bytepix, channels, job->tolerance))
+                        diff->counts[(size_t)ty * diff->cols + tx]++;
+                }
+                next = px1;
+            }
+        }
+    }
+}
+
+/** ı仯ϲΪ(8) **/
+static int bmp_diff_rects(BMPDiff *diff, int width, int height)
+{
+    unsigned char *seen = NULL;
+    int *stack = NULL, top = 0, i = 0, k = 0, tx = 0, ty = 0, nx = 0, ny = 0, d = 0;
+    int minx = 0, miny = 0, maxx = 0, maxy = 0;
+    BMPRect *rect = NULL;
+
+    if (diff->tiles == 0) return 1;
+    seen = (unsigned char *)malloc((size_t)diff->cols * diff->rows);
+    stack = (int *)malloc(sizeof(int) * diff->tiles);
+    diff->rects = (BMPRect *)malloc(sizeof(BMPRect) * diff->tiles);
+    if (seen == NULL || stack == NULL || diff->rects == NULL) {
+        free(seen);
+        free(stack);
+        return 0;
+    }
+    memset(seen, 0, (size_t)diff->cols * diff->rows);
+
+    for (i = 0; i < diff->cols * diff->rows; i++) {
+        if (seen[i] || !bmp_diff_tile(diff, i % diff->cols, i / diff->cols)) continue;
+        seen[i] = 1;
+        stack[top++] = i;
+        minx = maxx = i % diff->cols;
+        miny = maxy = i / diff->cols;
+        while (top > 0) {
+            k = stack[--top];
+            tx = k % diff->cols;
+            ty = k / diff->cols;
+            if (tx < minx) minx = tx;
+            if (tx > maxx) maxx = tx;
+            if (ty < miny) miny = ty;
+            if (ty > maxy) maxy = ty;
+            for (d = 0; d < 9; d++) {
+                nx = tx + d % 3 - 1;
+                ny = ty + d / 3 - 1;
+                if (nx < 0 || ny < 0 || nx >= diff->cols || ny >= diff->rows) continue;
+                if (seen[ny * diff->cols + nx] || !bmp_diff_tile(diff, nx, ny)) continue;
+                seen[ny * diff->cols + nx] = 1;
+                stack[top++] = ny * diff->cols + nx;
+            }
+        }
+
+        rect = &diff->rects[diff->rectcount++];
+        rect->left = minx * diff->tile;
+        rect->top = miny * diff->tile;
+        rect->right = (maxx + 1) * diff->tile > width ? width : (maxx + 1) * diff->tile;
+        rect->bottom = (maxy + 1) * diff->tile > height ? height : (maxy + 1) * diff->tile;
+    }
+
+    free(seen);
+    free(stack);
+    return 1;
+}
+
+BMPDiff *bmp_diff(BMP *bmp1, BMP *bmp2, int tile, int tolerance, int flags)
+{
+    BMPDiff *diff = NULL;
+    BMPDiffJob job;
+    int i = 0, ok = 0;
+
+    if (BMPNULL(bmp1) || BMPNULL(bmp2)) return NULL;
+    if (bmp1->width != bmp2->width || bmp1->height != bmp2->height || bmp1->alpha != bmp2->alpha) return NULL;
+    tile = tile <= 0 ? 32 : tile;
+    tolerance = tolerance < 0 ? 0 : tolerance;
+
+    BMP_STAT_BEGIN(BMP_STAT_DIFF);
+    if ((diff = (BMPDiff *)malloc(sizeof(BMPDiff))) == NULL) {
+        BMP_STAT_END(BMP_STAT_DIFF, 0);
+        return NULL;
+    }
+    memset(diff, 0, sizeof(BMPDiff));
+    diff->tile = tile;
+    diff->cols = (bmp1->width + tile - 1) / tile;
+    diff->rows = (bmp1->height + tile - 1) / tile;
+    diff->stride = (diff->cols + 7) / 8;
+    diff->pixels = -1;
+
+    diff->bitmap = (unsigned char *)malloc((size_t)diff->stride * diff->rows);
+    if (flags & BMP_DIFF_COUNT)
+        diff->counts = (int *)malloc(sizeof(int) * diff->cols * diff->rows);
+    if (diff->bitmap && (diff->counts || !(flags & BMP_DIFF_COUNT))) {
+        memset(diff->bitmap, 0, (size_t)diff->stride * diff->rows);
+        if (diff->counts)
+            memset(diff->counts, 0, sizeof(int) * diff->cols * diff->rows);
+
+        job.bmp1 = bmp1;
+        job.bmp2 = bmp2;
+        job.diff = diff;
+        job.tolerance = tolerance;
+        job.flags = flags;
+        if (flags & BMP_DIFF_PARALLEL)
+            bmp_parallel_for(diff->rows, bmp_diff_rows, &job);
+        else
+            bmp_diff_rows(&job, 0, diff->rows);
+
+        for (i = 0; i < diff->cols * diff->rows; i++)
+            diff->tiles += bmp_diff_tile(diff, i % diff->cols, i / diff->cols);
+        if (diff->counts) {
+            diff->pixels = 0;
+            for (i = 0; i < diff->cols * diff->rows; i++)
+                diff->pixels += diff->counts[i];
+        }
+        ok = bmp_diff_rects(diff, bmp1->width, bmp1->height);
+    }
+
+    if (!ok) {
+        bmp_diff_destroy(&diff);
+        BMP_STAT_END(BMP_STAT_DIFF, 0);
+        return NULL;
+    }
+    BMP_STAT_END(BMP_STAT_DIFF, (double)bmp1->width * bmp1->height);
+    return diff;
+}
+
+int bmp_diff_tile(BMPDiff *diff, int tx, int ty)
+{
+    if (diff == NULL || tx < 0 || ty < 0 || tx >= diff->cols || ty >= diff->rows) return 0;
+    return diff->bitmap[(size_t)ty * diff->stride + tx / 8] >> (tx & 7) & 1;
+}
+
+void bmp_diff_destroy(BMPDiff **diff)
+{
+    if (diff == NULL || *diff == NULL) return;
+    free((*diff)->bitmap);
+    free((*diff)->counts);
+    free((*diff)->rects);
+    SAFE_FREE(*diff);
+}
+
+// +---------------------------------------------------------
+// | ֱͼ⻯
+// +---------------------------------------------------------
+
+/** ۼƷֲɾ⻯, countΪ **/
+static void bmp_equalize_table(const int *histogram, long long count, unsigned char *table)
+{
+    long long cdf = 0, cdfmin = 0;
+    int i = 0;
+
+    for (i = 0; i < 256 && histogram[i] == 0; i++);
+    cdfmin = i < 256 ? histogram[i] : 0;
+
+    //ֻһֵʱֲ
+    if (count <= cdfmin) {
+        for (i = 0; i < 256; i++) table[i] = (unsigned char)i;
+        return;
+    }
+    for (i = 0; i < 256; i++) {
+        cdf += histogram[i];
+        table[i] = (unsigned char)(cdf <= cdfmin ? 0 : ((cdf - cdfmin) * 255 * 2 + (count - cdfmin)) / ((count - cdfmin) * 2));
+    }
+}
+
+/** һͳɫֱͨͼ **/
+static void bmp_color_histogram(BMP *bmp, int histogram[3][256])
+{
+    const unsigned char *p = NULL;
+    int w = 0, h = 0;
+    int bytepix = bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(bmp);
+
+    memset(histogram, 0, sizeof(int) * 3 * 256);
+    for (h = 0; h < bmp->height; h++) {
+        p = bmp->data + (size_t)h * perline;
+        for (w = 0; w < bmp->width; w++, p += bytepix) {
+            histogram[0][p[0]]++;
+            histogram[1][p[1]]++;
+            histogram[2][p[2]]++;
+        }
+    }
+}
+
+/** Ҷֱֵͼ, bmp_convert_grayһ, ޸ͼ **/
+static void bmp_luma_histogram(BMP *bmp, int *histogram)
+{
+    double weight[3][256];
+    const unsigned char *p = NULL;
+    int w = 0, h = 0, i = 0, v = 0;
+    int bytepix = bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(bmp);
+
+    for (i = 0; i < 256; i++) {
+        weight[2][i] = i * 0.3;
+        weight[1][i] = i * 0.59;
+        weight[0][i] = i * 0.11;
+    }
+    memset(histogram, 0, sizeof(int) * 256);
+    for (h = 0; h < bmp->height; h++) {
+        p = bmp->data + (size_t)h * perline;
+        for (w = 0; w < bmp->width; w++, p += bytepix) {
+            v = (int)(weight[2][p[2]] + weight[1][p[1]] + weight[0][p[0]]);
+            histogram[v > 255 ? 255 : v]++;
+        }
+    }
+}
+
+void bmp_equalize_hist(BMP *bmp, int gray)
+{
+    unsigned char table[256];
+    int histogram[3][256];
+    BMPLut lut;
+    int c = 0;
+
+    if (BMPNULL(bmp)) return;
+
+    BMP_STAT_BEGIN(BMP_STAT_EQUALIZE_HIST);
+    if (gray) {
+        //תҶͬһ
+        bmp_luma_histogram(bmp, histogram[0]);
+        bmp_equalize_table(histogram[0], (long long)bmp->width * bmp->height, table);
+        bmp_lut_init(&lut, BMP_LUT_GRAY);
+        bmp_lut_map(&lut, -1, table);
+    } else {
+        bmp_lut_init(&lut, BMP_LUT_COLOR);
+        bmp_color_histogram(bmp, histogram);
+        for (c = 0; c < 3; c++) {
+            bmp_equalize_table(histogram[c], (long long)bmp->width * bmp->height, table);
+            bmp_lut_map(&lut, c, table);
+        }
+    }
+    bmp_apply_lut(bmp, &lut);
+    BMP_STAT_END(BMP_STAT_EQUALIZE_HIST, (double)bmp->width * bmp->height);
+}
+
+typedef struct BMPClahe
+{
+    BMP *bmp;
+    int tilesx, tilesy, channels;
+    double clip;
+    int *xedge, *yedge;         //iΪ[edge[i], edge[i + 1])
+    unsigned char *lut;         //[][ͨ][256]
+    int *column;                //θwidth: ƫ, ҿƫ, ҿȨ(0~256)
+    unsigned short *rowlut;     //ÿжһлϱ, Ԥȷ, ĩβ2gatherԽ
+}BMPClahe;
+
+/** [begin, end)Ĳüֱͼӳ **/
+static void bmp_clahe_tiles(void *arg, int begin, int end)
+{
+    BMPClahe *job = (BMPClahe *)arg;
+    const unsigned char *p = NULL;
+    unsigned char *lut = NULL;
+    int histogram[3][256];
+    int t = 0, c = 0, i = 0, x = 0, y = 0, tx = 0, ty = 0, limit = 0, excess = 0, step = 0;
+    int bytepix = job->bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(job->bmp);
+    long long area = 0, sum = 0;
+
+    for (t = begin; t < end; t++) {
+        tx = t % job->tilesx;
+        ty = t / job->tilesx;
+        area = (long long)(job->xedge[tx + 1] - job->xedge[tx]) * (job->yedge[ty + 1] - job->yedge[ty]);
+        memset(histogram, 0, sizeof(histogram));
+        for (y = job->yedge[ty]; y < job->yedge[ty + 1]; y++) {
+            p = job->bmp->data + (size_t)y * perline + job->xedge[tx] * bytepix;
+            if (job->channels == 1) {
+                for (x = job->xedge[tx]; x < job->xedge[tx + 1]; x++, p += bytepix)
+                    histogram[0][p[0]]++;
+                continue;
+            }
+            for (x = job->xedge[tx]; x < job->xedge[tx + 1]; x++, p += bytepix) {
+                histogram[0][p[0]]++;
+                histogram[1][p[1]]++;
+                histogram[2][p[2]]++;
+            }
+        }
+
+        limit = job->clip > 0 ? (int)(job->clip * area / 256) : 0;
+        limit = job->clip > 0 && limit < 1 ? 1 : limit;
+        for (c = 0; c < job->channels; c++) {
+            //޵Ĳƽָ, stepһ
+            if (limit > 0) {
+                excess = 0;
+                for (i = 0; i < 256; i++) {
+                    if (histogram[c][i] > limit) {
+                        excess += histogram[c][i] - limit;
+                        histogram[c][i] = limit;
+                    }
+                }
+                for (i = 0; i < 256; i++)
+                    histogram[c][i] += excess / 256;
+                excess %= 256;
+                step = excess > 0 ? 256 / excess : 0;
+                for (i = 0; i < 256 && excess > 0; i += step, excess--)
+                    histogram[c][i]++;
+            }
+
+            lut = job->lut + ((size_t)t * job->channels + c) * 256;
+            sum = 0;
+            for (i = 0; i < 256; i++) {
+                sum += histogram[c][i];
+                lut[i] = (unsigned char)((sum * 255 * 2 + area) / (area * 2));
+            }
+        }
+    }
+}
+
+/** ֮Բֵλ: ҿҿȨ **/
+static void bmp_clahe_weight(const int *edge, int tiles, int pos, int *t1, int *t2, int *weight)
+{
+    int i = 0;
+    double p = pos + 0.5, c1 = 0, c2 = 0;
+
+    if (p <= (edge[0] + edge[1]) / 2.0) {
+        *t1 = *t2 = 0;
+        *weight = 0;
+        return;
+    }
+    if (p >= (edge[tiles - 1] + edge[tiles]) / 2.0) {
+        *t1 = *t2 = tiles - 1;
+        *weight = 0;
+        return;
+    }
+    for (i = 0; i < tiles - 1 && p >= (edge[i + 1] + edge[i + 2]) / 2.0; i++);
+    c1 = (edge[i] + edge[i + 1]) / 2.0;
+    c2 = (edge[i + 1] + edge[i + 2]) / 2.0;
+    *t1 = i;
+    *t2 = i + 1;
+    *weight = (int)((p - c1) / (c2 - c1) * 256 + 0.5);
+}
+
+#ifdef __AVX2__
+/** 8һͨ: ƫƼֵֽgatherı(16λ, 32λ)һ **/
+static __m256i bmp_clahe_mix8(const unsigned short *rowlut, __m256i l1, __m256i l2, __m256i wx, __m256i v)
+{
+    __m256i mask = _mm256_set1_epi32(0xFFFF);
+    __m256i e1 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)rowlut, _mm256_add_epi32(l1, v), 2), mask);
+    __m256i e2 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)rowlut, _mm256_add_epi32(l2, v), 2), mask);
+
+    e1 = _mm256_add_epi32(_mm256_mullo_epi32(e1, _mm256_sub_epi32(_mm256_set1_epi32(256), wx)), _mm256_mullo_epi32(e2, wx));
+    return _mm256_srli_epi32(_mm256_add_epi32(e1, _mm256_set1_epi32(32768)), 16);
+}
+
+/** һе, ÿչһdword; ش **/
+static int bmp_clahe_row_avx2(const BMPClahe *job, const unsigned short *rowlut, unsigned char *p, int bytepix)
+{
+    const int *col1 = job->column, *col2 = job->column + job->bmp->width, *weight = job->column + job->bmp->width * 2;
+    //24λʱÿ128λͨȡ4(12ֽ), 32ֽ豣֤Խβ
+    int x = 0, width = job->bmp->width - (bytepix == 3 ? 3 : 0);
+    __m256i spread = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6), unspread = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    __m256i expand = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m256i pick = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    __m256i mask = _mm256_set1_epi32(0xFF), alpha = _mm256_set1_epi32((int)0xFF000000);
+    __m256i px, l1, l2, vw, b, g, r;
+
+    for (x = 0; x + 8 <= width; x += 8, p += bytepix * 8) {
+        px = _mm256_loadu_si256((const __m256i *)p);
+        if (bytepix == 3)
+            px = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(px, spread), expand);
+        l1 = _mm256_loadu_si256((const __m256i *)(col1 + x));
+        l2 = _mm256_loadu_si256((const __m256i *)(col2 + x));
+        vw = _mm256_loadu_si256((const __m256i *)(weight + x));
+        b = bmp_clahe_mix8(rowlut, l1, l2, vw, _mm256_and_si256(px, mask));
+        if (job->channels == 1) {
+            g = r = b;
+        } else {
+            l1 = _mm256_add_epi32(l1, _mm256_set1_epi32(256));
+            l2 = _mm256_add_epi32(l2, _mm256_set1_epi32(256));
+            g = bmp_clahe_mix8(rowlut, l1, l2, vw, _mm256_and_si256(_mm256_srli_epi32(px, 8), mask));
+            l1 = _mm256_add_epi32(l1, _mm256_set1_epi32(256));
+            l2 = _mm256_add_epi32(l2, _mm256_set1_epi32(256));
+            r = bmp_clahe_mix8(rowlut, l1, l2, vw, _mm256_and_si256(_mm256_srli_epi32(px, 16), mask));
+        }
+        b = _mm256_or_si256(b, _mm256_or_si256(_mm256_slli_epi32(g, 8), _mm256_slli_epi32(r, 16)));
+        if (bytepix == 4) {
+            _mm256_storeu_si256((__m256i *)p, _mm256_or_si256(b, _mm256_and_si256(px, alpha)));
+            continue;
+        }
+        //£ÿ3ֽ, д24ֽ
+        b = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(b, pick), unspread);
+        _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(b));
+        _mm_storel_epi64((__m128i *)(p + 16), _mm256_extracti128_si256(b, 1));
+    }
+    return x;
+}
+#endif
+
+/** д[begin, end): ÿȰȨػſı, ÿֻβ **/
+static void bmp_clahe_rows(void *arg, int begin, int end)
+{
+    BMPClahe *job = (BMPClahe *)arg;
+    unsigned short *rowlut = NULL;
+    const unsigned char *top = NULL, *bottom = NULL;
+    const unsigned short *l1 = NULL, *l2 = NULL;
+    const int *col1 = NULL, *col2 = NULL, *weight = NULL;
+    unsigned char *p = NULL;
+    int x = 0, y = 0, i = 0, t1 = 0, t2 = 0, wy = 0, wx = 0, n = 0;
+    int bytepix = job->bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(job->bmp);
+
+    n = job->tilesx * job->channels * 256;
+    rowlut = job->rowlut + (size_t)bmp_parallel_slot(job->bmp->height, begin) * (n + 2);
+
+    for (y = begin; y < end; y++) {
+        bmp_clahe_weight(job->yedge, job->tilesy, y, &t1, &t2, &wy);
+        top = job->lut + (size_t)t1 * n;
+        bottom = job->lut + (size_t)t2 * n;
+        for (i = 0; i < n; i++)
+            rowlut[i] = (unsigned short)(top[i] * (256 - wy) + bottom[i] * wy);
+
+        p = job->bmp->data + (size_t)y * perline;
+        x = 0;
+#ifdef __AVX2__
+        x = bmp_clahe_row_avx2(job, rowlut, p, bytepix);
+        p += (size_t)x * bytepix;
+#endif
+        col1 = job->column + x;
+        col2 = job->column + job->bmp->width + x;
+        weight = job->column + job->bmp->width * 2 + x;
+        for (; x < job->bmp->width; x++, p += bytepix) {
+            l1 = rowlut + *col1++;
+            l2 = rowlut + *col2++;
+            wx = *weight++;
+            //Ҷʱͨͬ
+            if (job->channels == 1) {
+                p[0] = p[1] = p[2] = (unsigned char)((l1[p[0]] * (256 - wx) + l2[p[0]] * wx + 32768) >> 16);
+                continue;
+            }
+            p[0] = (unsigned char)((l1[p[0]] * (256 - wx) + l2[p[0]] * wx + 32768) >> 16);
+            p[1] = (unsigned char)((l1[256 + p[1]] * (256 - wx) + l2[256 + p[1]] * wx + 32768) >> 16);
+            p[2] = (unsigned char)((l1[512 + p[2]] * (256 - wx) + l2[512 + p[2]] * wx + 32768) >> 16);
+        }
+    }
+}
+
+int bmp_clahe(BMP *bmp, int tilesx, int tilesy, double clip, int gray)
+{
+    BMPClahe job;
+    int i = 0, t1 = 0, t2 = 0;
+
+    if (BMPNULL(bmp)) return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_CLAHE);
+    memset(&job, 0, sizeof(job));
+    job.bmp = bmp;
+    job.tilesx = tilesx < 1 ? 1 : (tilesx > bmp->width ? bmp->width : tilesx);
+    job.tilesy = tilesy < 1 ? 1 : (tilesy > bmp->height ? bmp->height : tilesy);
+    job.channels = gray ? 1 : 3;
+    job.clip = clip;
+    job.xedge = (int *)malloc(sizeof(int) * (job.tilesx + 1));
+    job.yedge = (int *)malloc(sizeof(int) * (job.tilesy + 1));
+    job.lut = (unsigned char *)malloc((size_t)job.tilesx * job.tilesy * job.channels * 256);
+    job.column = (int *)malloc(sizeof(int) * 3 * bmp->width);
+    job.rowlut = (unsigned short *)malloc(sizeof(unsigned short) * (job.tilesx * job.channels * 256 + 2) *
+        (size_t)bmp_parallel_threads(bmp->height));
+
+    //ȫ޸ͼ֮ǰ, ʧʱͼ񲻱
+    if (job.xedge == NULL || job.yedge == NULL || job.lut == NULL || job.column == NULL || job.rowlut == NULL) {
+        free(job.xedge);
+        free(job.yedge);
+        free(job.lut);
+        free(job.column);
+        free(job.rowlut);
+        BMP_STAT_END(BMP_STAT_CLAHE, 0);
+        return 0;
+    }
+    if (gray) bmp_convert_gray(bmp);
+
+    for (i = 0; i <= job.tilesx; i++)
+        job.xedge[i] = (int)((long long)bmp->width * i / job.tilesx);
+    for (i = 0; i <= job.tilesy; i++)
+        job.yedge[i] = (int)((long long)bmp->height * i / job.tilesy);
+
+    //ҿֱӴΪлϱеƫ
+    for (i = 0; i < bmp->width; i++) {
+        bmp_clahe_weight(job.xedge, job.tilesx, i, &t1, &t2, &job.column[bmp->width * 2 + i]);
+        job.column[i] = t1 * job.channels * 256;
+        job.column[bmp->width + i] = t2 * job.channels * 256;
+    }
+
+    bmp_parallel_for(job.tilesx * job.tilesy, bmp_clahe_tiles, &job);
+    bmp_parallel_for(bmp->height, bmp_clahe_rows, &job);
+
+    free(job.xedge);
+    free(job.yedge);
+    free(job.lut);
+    free(job.column);
+    free(job.rowlut);
+    BMP_STAT_END(BMP_STAT_CLAHE, (double)bmp->width * bmp->height);
+    return 1;
+}
+
+// +---------------------------------------------------------
+// | ̬ѧ
+// | van Herk/Gil-Werman: аṹԪسkֿ, ǰ׺ͺ׺ֵ,
+// | һΪkĴǡÿ, Ϊ max(׺[x], ǰ׺[x+k-1]), k޹.
+// | ʴ 255-(255-f) , ֻʵȡֵһں.
+// +---------------------------------------------------------
+
+#define BMP_MORPH_CHUNK 64      //ֱзֶβ, ÿֽ(4ı)
+
+typedef struct BMPMorph
+{
+    BMP *bmp;
+    int left, right, up, down;  //ڷΧ [x-left, x+right] x [y-up, y+down]
+    unsigned char inv;          //ʴʱΪ0xff, ȡ
+    int k, rows;                //ֱ鳤, 
+    unsigned char *g, *h;       //ֱǰ׺/׺
+    unsigned long long *bits;   //ڰͼλ, xλΪx, 1Ϊ
+    unsigned long long *gb, *hb;
+    int words;                  //ÿе64λ
+    unsigned char *line;        //ˮƽÿжεĻ, linesizeֽ
+    size_t linesize;
+}BMPMorph;
+
+//лڵһ֮ǰ, ;ʧ
+
+/** ˮƽ: ÿвߺֿǰ׺/׺ֵ **/
+static void bmp_morph_gray_rows(void *arg, int begin, int end)
+{
+    BMPMorph *job = (BMPMorph *)arg;
+    unsigned char *pad = NULL, *g = NULL, *h = NULL, *p = NULL;
+    int y = 0, i = 0, s = 0, e = 0, n = 0, len = 0;
+    int bytepix = job->bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(job->bmp);
+    int k = job->left + job->right + 1, width = job->bmp->width;
+
+    //ߺ󳤶 width+k-1, Ϊkı
+    len = (width + 2 * k - 2) / k * k * bytepix;
+    pad = job->line + job->linesize * bmp_parallel_slot(job->bmp->height, begin);
+    g = pad + len;
+    h = g + len;
+
+    n = width * bytepix;
+    for (y = begin; y < end; y++) {
+        p = job->bmp->data + (size_t)y * perline;
+        //ȡ0(ȡΪֵĵλԪ)
+        memset(pad, 0, job->left * bytepix);
+        memset(pad + job->left * bytepix + n, 0, len - job->left * bytepix - n);
+        for (i = 0; i < n; i++)
+            pad[job->left * bytepix + i] = p[i] ^ job->inv;
+
+        for (s = 0; s < len; s += k * bytepix) {
+            e = s + k * bytepix;
+            memcpy(g + s, pad + s, bytepix);
+            for (i = s + bytepix; i < e; i++)
+                g[i] = g[i - bytepix] > pad[i] ? g[i - bytepix] : pad[i];
+            memcpy(h + e - bytepix, pad + e - bytepix, bytepix);
+            for (i = e - bytepix - 1; i >= s; i--)
+                h[i] = h[i + bytepix] > pad[i] ? h[i + bytepix] : pad[i];
+        }
+
+        //alpha
+        s = (k - 1) * bytepix;
+        for (i = 0; i < n; i++) {
+            if (bytepix == 4 && (i & 3) == 3) continue;
+            p[i] = (h[i] > g[i + s] ? h[i] : g[i + s]) ^ job->inv;
+        }
+    }
+}
+
+/** dst = max(prev, src ^ inv), prevsrcΪNULLʱΪ0 **/
+static void bmp_morph_max_row(unsigned char *dst, const unsigned char *prev, const unsigned char *src, unsigned char inv, int n)
+{
+    int i = 0;
+
+    if (src == NULL) {
+        if (prev) memcpy(dst, prev, n);
+        else memset(dst, 0, n);
+    }
+    else if (prev == NULL) {
+        for (i = 0; i < n; i++)
+            dst[i] = src[i] ^ inv;
+    }
+    else {
+        for (i = 0; i < n; i++) {
+            unsigned char v = src[i] ^ inv;
+            dst[i] = prev[i] > v ? prev[i] : v;
+        }
+    }
+}
+
+/** ֱ: ΪԪطֿ, ÿ̴߳һ **/
+static void bmp_morph_gray_cols(void *arg, int begin, int end)
+{
+    BMPMorph *job = (BMPMorph *)arg;
+    const unsigned char *r = NULL, *hr = NULL, *gr = NULL;
+    unsigned char *p = NULL;
+    int j = 0, i = 0, s = 0, y = 0, c0 = 0, c1 = 0;
+    int bytepix = job->bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(job->bmp);
+    int n = job->bmp->width * bytepix, k = job->k;
+
+    c0 = begin * BMP_MORPH_CHUNK;
+    c1 = end * BMP_MORPH_CHUNK > n ? n : end * BMP_MORPH_CHUNK;
+
+    for (s = 0; s < job->rows; s += k) {
+        for (j = s; j < s + k; j++) {
+            y = j - job->up;
+            r = y >= 0 && y < job->bmp->height ? job->bmp->data + (size_t)y * perline + c0 : NULL;
+            bmp_morph_max_row(job->g + (size_t)j * perline + c0, j == s ? NULL : job->g + (size_t)(j - 1) * perline + c0, r, job->inv, c1 - c0);
+        }
+        for (j = s + k - 1; j >= s; j--) {
+            y = j - job->up;
+            r = y >= 0 && y < job->bmp->height ? job->bmp->data + (size_t)y * perline + c0 : NULL;
+            bmp_morph_max_row(job->h + (size_t)j * perline + c0, j == s + k - 1 ? NULL : job->h + (size_t)(j + 1) * perline + c0, r, job->inv, c1 - c0);
+        }
+    }
+
+    //alpha, 4ı
+    for (y = 0; y < job->bmp->height; y++) {
+        p = job->bmp->data + (size_t)y * perline;
+        hr = job->h + (size_t)y * perline;
+        gr = job->g + (size_t)(y + k - 1) * perline;
+        for (i = c0; i < c1; i++) {
+            unsigned char v = (hr[i] > gr[i] ? hr[i] : gr[i]) ^ job->inv;
+            p[i] = bytepix == 4 && (i & 3) == 3 ? p[i] : v;
+        }
+    }
+}
+
+/** еλ: dstbit xȡsrcbit x+s, s<0ʱΪbit x-(-s), srcĲֲ0 **/
+static void bmp_morph_shift(unsigned long long *dst, int dwords, const unsigned long long *src, int swords, int s)
+{
+    int i = 0, j = 0, q = (s < 0 ? -s : s) >> 6, r = (s < 0 ? -s : s) & 63;
+
+    for (i = 0; i < dwords; i++) {
+        j = s >= 0 ? i + q : i - q;
+        dst[i] = j >= 0 && j < swords ? (s >= 0 ? src[j] >> r : src[j] << r) : 0;
+        if (r == 0) continue;
+        j = s >= 0 ? j + 1 : j - 1;
+        if (j >= 0 && j < swords) dst[i] |= s >= 0 ? src[j] << (64 - r) : src[j] >> (64 - r);
+    }
+}
+
+/** ˮƽ(ڰ): ڰ2ݱ, صƴk, O(log k) **/
+static void bmp_morph_bits_rows(void *arg, int begin, int end)
+{
+    BMPMorph *job = (BMPMorph *)arg;
+    unsigned long long *cur = NULL, *tmp = NULL, *p = NULL, inv = 0, tail = 0;
+    int y = 0, i = 0, span = 0, words = job->words, wide = 0;
+    int k = job->left + job->right + 1, rest = job->bmp->width & 63;
+
+    //leftλӿĻ, xλ[x, x+k-1]ԭͼ[x-left, x+right]
+    wide = (job->bmp->width + job->left + 63) / 64;
+    cur = (unsigned long long *)(job->line + job->linesize * bmp_parallel_slot(job->bmp->height, begin));
+    tmp = cur + wide;
+
+    inv = job->inv ? ~0ULL : 0;
+    tail = rest ? (1ULL << rest) - 1 : ~0ULL;
+    for (y = begin; y < end; y++) {
+        p = job->bits + (size_t)y * words;
+        //βλȡ0
+        for (i = 0; i < words; i++)
+            tmp[i] = (p[i] ^ inv) & (i == words - 1 ? tail : ~0ULL);
+        bmp_morph_shift(cur, wide, tmp, words, -job->left);
+
+        for (span = 1; span * 2 <= k; span *= 2) {
+            bmp_morph_shift(tmp, wide, cur, wide, span);
+            for (i = 0; i < wide; i++)
+                cur[i] |= tmp[i];
+        }
+        if (span < k) {
+            bmp_morph_shift(tmp, wide, cur, wide, k - span);
+            for (i = 0; i < wide; i++)
+                cur[i] |= tmp[i];
+        }
+
+        for (i = 0; i < words; i++)
+            p[i] = cur[i] ^ inv;
+    }
+}
+
+/** ֱ(ڰ): Ҷͬķֿǰ׺/׺, ԪΪ64λ **/
+static void bmp_morph_bits_cols(void *arg, int begin, int end)
+{
+    BMPMorph *job = (BMPMorph *)arg;
+    const unsigned long long *r = NULL, *hr = NULL, *gr = NULL;
+    unsigned long long *g = NULL, *h = NULL, *p = NULL, inv = 0, v = 0;
+    int j = 0, i = 0, s = 0, y = 0, words = job->words, k = job->k;
+
+    inv = job->inv ? ~0ULL : 0;
+    for (s = 0; s < job->rows; s += k) {
+        for (j = s; j < s + k; j++) {
+            y = j - job->up;
+            r = y >= 0 && y < job->bmp->height ? job->bits + (size_t)y * words : NULL;
+            g = job->gb + (size_t)j * words;
+            for (i = begin; i < end; i++) {
+                v = r ? r[i] ^ inv : 0;
+                g[i] = j == s ? v : g[i - words] | v;
+            }
+        }
+        for (j = s + k - 1; j >= s; j--) {
+            y = j - job->up;
+            r = y >= 0 && y < job->bmp->height ? job->bits + (size_t)y * words : NULL;
+            h = job->hb + (size_t)j * words;
+            for (i = begin; i < end; i++) {
+                v = r ? r[i] ^ inv : 0;
+                h[i] = j == s + k - 1 ? v : h[i + words] | v;
+            }
+        }
+    }
+
+    for (y = 0; y < job->bmp->height; y++) {
+        p = job->bits + (size_t)y * words;
+        hr = job->hb + (size_t)y * words;
+        gr = job->gb + (size_t)(y + k - 1) * words;
+        for (i = begin; i < end; i++)
+            p[i] = (hr[i] | gr[i]) ^ inv;
+    }
+}
+
+/** ֻͨͬ0/255ʱΪλͼ, 򷵻0 **/
+static int bmp_morph_pack(BMPMorph *job)
+{
+    BMP *bmp = job->bmp;
+    unsigned long long *row = NULL;
+    const unsigned char *p = NULL;
+    int x = 0, y = 0, bytepix = bmp->alpha == 1 ? 4 : 3;
+
+    job->words = (bmp->width + 63) / 64;
+    job->bits = (unsigned long long *)calloc((size_t)job->words * bmp->height, sizeof(unsigned long long));
+    if (job->bits == NULL) return 0;
+
+    for (y = 0; y < bmp->height; y++) {
+        p = bmp->data + (size_t)y * BMP_PERLINE_REALSIZE(bmp);
+        row = job->bits + (size_t)y * job->words;
+        for (x = 0; x < bmp->width; x++, p += bytepix) {
+            if ((p[0] != 0 && p[0] != 0xff) || p[1] != p[0] || p[2] != p[0]) {
+                free(job->bits);
+                job->bits = NULL;
+                return 0;
+            }
+            row[x >> 6] |= (unsigned long long)(p[0] & 1) << (x & 63);
+        }
+    }
+    return 1;
+}
+
+static void bmp_morph_unpack(BMPMorph *job)
+{
+    BMP *bmp = job->bmp;
+    const unsigned long long *row = NULL;
+    unsigned char *p = NULL;
+    int x = 0, y = 0, bytepix = bmp->alpha == 1 ? 4 : 3;
+
+    for (y = 0; y < bmp->height; y++) {
+        p = bmp->data + (size_t)y * BMP_PERLINE_REALSIZE(bmp);
+        row = job->bits + (size_t)y * job->words;
+        for (x = 0; x < bmp->width; x++, p += bytepix)
+            p[0] = p[1] = p[2] = (row[x >> 6] >> (x & 63)) & 1 ? 0xff : 0x00;
+    }
+}
+
+/** һθʴ, ڷΧΪ[x-left, x+right] x [y-up, y+down], ͼĲֲӰ **/
+static void bmp_morph_pass(BMPMorph *job, int dilate, int left, int right, int up, int down)
+{
+    BMP *bmp = job->bmp;
+
+    job->left = left < bmp->width - 1 ? left : bmp->width - 1;
+    job->right = right < bmp->width - 1 ? right : bmp->width - 1;
+    job->up = up < bmp->height - 1 ? up : bmp->height - 1;
+    job->down = down < bmp->height - 1 ? down : bmp->height - 1;
+    job->inv = dilate ? 0x00 : 0xff;
+
+    if (job->left + job->right > 0)
+        bmp_parallel_for(bmp->height, job->bits ? bmp_morph_bits_rows : bmp_morph_gray_rows, job);
+    if (job->up + job->down == 0) return;
+
+    job->k = job->up + job->down + 1;
+    job->rows = (bmp->height + 2 * job->k - 2) / job->k * job->k;
+    if (job->bits)
+        bmp_parallel_for(job->words, bmp_morph_bits_cols, job);
+    else
+        bmp_parallel_for((bmp->width * (bmp->alpha == 1 ? 4 : 3) + BMP_MORPH_CHUNK - 1) / BMP_MORPH_CHUNK, bmp_morph_gray_cols, job);
+}
+
+/** Ĵڷȫ, ɹ1 **/
+static int bmp_morph_alloc(BMPMorph *job, const BMPMorphStep *steps, int count)
+{
+    BMP *bmp = job->bmp;
+    int i = 0, kx = 1, ky = 1, side = 0, n = 0, rows = 0;
+    int bytepix = bmp->alpha == 1 ? 4 : 3;
+
+    for (i = 0; i < count; i++) {
+        if (steps[i].op < BMP_MORPH_ERODE || steps[i].op > BMP_MORPH_CLOSE) return 0;
+        n = steps[i].width < 1 ? 1 : steps[i].width;
+        kx = n > kx ? n : kx;
+        n = steps[i].height < 1 ? 1 : steps[i].height;
+        ky = n > ky ? n : ky;
+    }
+    //bmp_morph_passͬĽض: ÿ಻߳-1
+    side = kx / 2 < bmp->width - 1 ? kx / 2 : bmp->width - 1;
+    kx = side + ((kx - 1) / 2 < bmp->width - 1 ? (kx - 1) / 2 : bmp->width - 1) + 1;
+    side = ky / 2 < bmp->height - 1 ? ky / 2 : bmp->height - 1;
+    ky = side + ((ky - 1) / 2 < bmp->height - 1 ? (ky - 1) / 2 : bmp->height - 1) + 1;
+    //Ϊkıĳȶk, ȡϽ n + 2k - 2
+    rows = bmp->height + 2 * ky - 2;
+
+    if (job->bits) {
+        job->linesize = sizeof(unsigned long long) * 2 * ((bmp->width + kx / 2 + 63) / 64);
+        job->gb = (unsigned long long *)malloc(sizeof(unsigned long long) * job->words * rows);
+        job->hb = (unsigned long long *)malloc(sizeof(unsigned long long) * job->words * rows);
+    } else {
+        job->linesize = (size_t)3 * (bmp->width + 2 * kx - 2) * bytepix;
+        job->g = (unsigned char *)malloc((size_t)BMP_PERLINE_REALSIZE(bmp) * rows);
+        job->h = (unsigned char *)malloc((size_t)BMP_PERLINE_REALSIZE(bmp) * rows);
+    }
+    job->line = (unsigned char *)malloc(job->linesize * bmp_parallel_threads(bmp->height));
+    return job->line && (job->bits ? job->gb && job->hb : job->g && job->h);
+}
+
+int bmp_morphology_chain(BMP *bmp, const BMPMorphStep *steps, int count)
+{
+    BMPMorph job;
+    int i = 0, ok = 1, l = 0, r = 0, u = 0, d = 0;
+
+    if (BMPNULL(bmp) || steps == NULL || count < 1) return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_MORPHOLOGY);
+    memset(&job, 0, sizeof(job));
+    job.bmp = bmp;
+    bmp_morph_pack(&job);
+
+    //ṹԪB=[-l, r]: ʴȡ[x-l, x+r]Сֵ, Ͱ÷B, /ݵȵ
+    ok = bmp_morph_alloc(&job, steps, count);
+    for (i = 0; i < count && ok; i++) {
+        l = ((steps[i].width < 1 ? 1 : steps[i].width) - 1) / 2;
+        r = (steps[i].width < 1 ? 1 : steps[i].width) - 1 - l;
+        u = ((steps[i].height < 1 ? 1 : steps[i].height) - 1) / 2;
+        d = (steps[i].height < 1 ? 1 : steps[i].height) - 1 - u;
+        if (steps[i].op == BMP_MORPH_ERODE || steps[i].op == BMP_MORPH_OPEN)
+            bmp_morph_pass(&job, 0, l, r, u, d);
+        if (steps[i].op != BMP_MORPH_ERODE)
+            bmp_morph_pass(&job, 1, r, l, d, u);
+        if (steps[i].op == BMP_MORPH_CLOSE)
+            bmp_morph_pass(&job, 0, l, r, u, d);
+    }
+
+    if (job.bits && ok)
+        bmp_morph_unpack(&job);
+    free(job.bits);
+    free(job.line);
+    free(job.g);
+    free(job.h);
+    free(job.gb);
+    free(job.hb);
+    BMP_STAT_END(BMP_STAT_MORPHOLOGY, ok ? (double)bmp->width * bmp->height * count : 0);
+    return ok;
+}
+
+void bmp_morphology(BMP *bmp, int op, int width, int height)
+{
+    BMPMorphStep step;
+
+    step.op = op;
+    step.width = width;
+    step.height = height;
+    bmp_morphology_chain(bmp, &step, 1);
+}
+
+// +---------------------------------------------------------
+// | ɫռת
+// | ÿаBMP_CSC_BLOCKزB/G/Rint, .
+// | YCbCrϵΪQ14, HSVĳ鵹, Labgamma.
+// +---------------------------------------------------------
+
+#define BMP_CSC_BLOCK 64        //ÿβֵ, ż
+
+//Y/Cb/CrB/G/Rϵ, Q14, ÿ֮Ϊ163840
+static const int bmp_ycc_coef[3][3] = {
+    {1868, 9617, 4899},
+    {8192, -5427, -2765},
+    {-1332, -6860, 8192},
+};
+
+//sRGB(D65)ֵXYZ, , ΪR/G/B
+static const double bmp_xyz_matrix[3][3] = {
+    {0.412453, 0.357580, 0.180423},
+    {0.212671, 0.715160, 0.072169},
+    {0.019334, 0.119193, 0.950227},
+};
+static const double bmp_rgb_matrix[3][3] = {
+    {3.240479, -1.537150, -0.498535},
+    {-0.969256, 1.875991, 0.041556},
+    {0.055648, -0.204043, 1.057311},
+};
+static const double bmp_lab_white[3] = {0.950456, 1.0, 1.088754};
+
+typedef struct BMPCsc
+{
+    BMP *bmp;
+    int space;
+    const BMPPlanes *planes;
+    int sdiv[256], hdiv[256];   //HSV: 255*4096/v  30*4096/diff
+    int xyz[9], rgb[9];         //Lab: 󰴰׵źQ12ϵ
+    int linear[256];            //Lab: sRGB, Q15
+    int cbrt[4098];             //Lab: f(t), ±ΪQ15t3λ, ֵΪQ15
+    int lstar[256], astar[256], bstar[256];    //Lab任: ֽڵfķ, Q15
+    unsigned char gamma[8193];  //Lab任: Q152λsRGB
+}BMPCsc;
+
+/** һزͨ **/
+static void bmp_csc_load(const unsigned char *p, int bytepix, int n, int *b, int *g, int *r)
+{
+    int i = 0;
+
+    for (i = 0; i < n; i++, p += bytepix) {
+        b[i] = p[0];
+        g[i] = p[1];
+        r[i] = p[2];
+    }
+}
+
+#ifdef __AVX2__
+/** 8int͵0..255д8ֽ **/
+static void bmp_csc_store8(unsigned char *dst, __m256i v)
+{
+    v = _mm256_packus_epi32(v, v);
+    v = _mm256_packus_epi16(v, v);
+    v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+    _mm_storel_epi64((__m128i *)dst, _mm256_castsi256_si128(v));
+}
+
+static __m256i bmp_csc_dot8(const int *b, const int *g, const int *r, const int *coef)
+{
+    __m256i v = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)b), _mm256_set1_epi32(coef[0]));
+    v = _mm256_add_epi32(v, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)g), _mm256_set1_epi32(coef[1])));
+    return _mm256_add_epi32(v, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)r), _mm256_set1_epi32(coef[2])));
+}
+#endif
+
+/** c: cΪ0ʱY, Ǽ128ƫƵCb/Cr; Ϊ2^shift֮ **/
+static void bmp_ycc_component(const int *b, const int *g, const int *r, int n, int c, int shift, unsigned char *dst)
+{
+    const int *coef = bmp_ycc_coef[c];
+    int i = 0, v = 0, offset = 0;
+
+    offset = (c ? 128 << (14 + shift) : 0) + (1 << (13 + shift));
+#ifdef __AVX2__
+    for (; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_add_epi32(bmp_csc_dot8(b + i, g + i, r + i, coef), _mm256_set1_epi32(offset));
+        bmp_csc_store8(dst + i, _mm256_srai_epi32(s, 14 + shift));
+    }
+#endif
+    for (; i < n; i++) {
+        v = (coef[0] * b[i] + coef[1] * g[i] + coef[2] * r[i] + offset) >> (14 + shift);
+        dst[i] = (unsigned char)(v > 255 ? 255 : v);
+    }
+}
+
+/** YCbCrתBGR, Cb/CrѼȥ128, дֽ **/
+static void bmp_ycc_inverse(const int *y, const int *cb, const int *cr, int n, unsigned char *b, unsigned char *g, unsigned char *r)
+{
+    int i = 0, v = 0;
+
+#ifdef __AVX2__
+    for (; i + 8 <= n; i += 8) {
+        __m256i vy = _mm256_add_epi32(_mm256_slli_epi32(_mm256_loadu_si256((const __m256i *)(y + i)), 14), _mm256_set1_epi32(8192));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(cb + i));
+        __m256i vr = _mm256_loadu_si256((const __m256i *)(cr + i));
+        bmp_csc_store8(b + i, _mm256_srai_epi32(_mm256_add_epi32(vy, _mm256_mullo_epi32(vb, _mm256_set1_epi32(29032))), 14));
+        bmp_csc_store8(r + i, _mm256_srai_epi32(_mm256_add_epi32(vy, _mm256_mullo_epi32(vr, _mm256_set1_epi32(22970))), 14));
+        vy = _mm256_sub_epi32(vy, _mm256_mullo_epi32(vb, _mm256_set1_epi32(5638)));
+        bmp_csc_store8(g + i, _mm256_srai_epi32(_mm256_sub_epi32(vy, _mm256_mullo_epi32(vr, _mm256_set1_epi32(11700))), 14));
+    }
+#endif
+    for (; i < n; i++) {
+        v = (y[i] << 14) + 29032 * cb[i] + 8192;
+        b[i] = (unsigned char)(v < 0 ? 0 : (v >> 14 > 255 ? 255 : v >> 14));
+        v = (y[i] << 14) - 5638 * cb[i] - 11700 * cr[i] + 8192;
+        g[i] = (unsigned char)(v < 0 ? 0 : (v >> 14 > 255 ? 255 : v >> 14));
+        v = (y[i] << 14) + 22970 * cr[i] + 8192;
+        r[i] = (unsigned char)(v < 0 ? 0 : (v >> 14 > 255 ? 255 : v >> 14));
+    }
+}
+
+/** BGRתHSV: S = diff*255/V, Hȡ (ֵ/diff)*30, 鵹 **/
+static void bmp_hsv_block(const BMPCsc *job, const int *b, const int *g, const int *r, int n, unsigned char *hh, unsigned char *ss, unsigned char *vv)
+{
+    int i = 0, v = 0, d = 0, h = 0;
+
+#ifdef __AVX2__
+    for (; i + 8 <= n; i += 8) {
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        __m256i vg = _mm256_loadu_si256((const __m256i *)(g + i));
+        __m256i vr = _mm256_loadu_si256((const __m256i *)(r + i));
+        __m256i vmax = _mm256_max_epi32(_mm256_max_epi32(vb, vg), vr);
+        __m256i vd = _mm256_sub_epi32(vmax, _mm256_min_epi32(_mm256_min_epi32(vb, vg), vr));
+        __m256i vs = _mm256_mullo_epi32(vd, _mm256_i32gather_epi32(job->sdiv, vmax, 4));
+        __m256i vh = _mm256_add_epi32(_mm256_sub_epi32(vr, vg), _mm256_slli_epi32(vd, 2));
+        vh = _mm256_blendv_epi8(vh, _mm256_add_epi32(_mm256_sub_epi32(vb, vr), _mm256_slli_epi32(vd, 1)), _mm256_cmpeq_epi32(vmax, vg));
+        vh = _mm256_blendv_epi8(vh, _mm256_sub_epi32(vg, vb), _mm256_cmpeq_epi32(vmax, vr));
+        vh = _mm256_mullo_epi32(vh, _mm256_i32gather_epi32(job->hdiv, vd, 4));
+        vh = _mm256_srai_epi32(_mm256_add_epi32(vh, _mm256_set1_epi32(2048 + (180 << 12))), 12);
+        vh = _mm256_sub_epi32(vh, _mm256_and_si256(_mm256_cmpgt_epi32(vh, _mm256_set1_epi32(179)), _mm256_set1_epi32(180)));
+        bmp_csc_store8(hh + i, vh);
+        bmp_csc_store8(ss + i, _mm256_srai_epi32(_mm256_add_epi32(vs, _mm256_set1_epi32(2048)), 12));
+        bmp_csc_store8(vv + i, vmax);
+    }
+#endif
+    for (; i < n; i++) {
+        v = b[i] > g[i] ? b[i] : g[i];
+        v = v > r[i] ? v : r[i];
+        d = b[i] < g[i] ? b[i] : g[i];
+        d = v - (d < r[i] ? d : r[i]);
+        if (v == r[i]) h = g[i] - b[i];
+        else if (v == g[i]) h = b[i] - r[i] + 2 * d;
+        else h = r[i] - g[i] + 4 * d;
+        //ȼ180λ, H䵽150..179
+        h = (h * job->hdiv[d] + 2048 + (180 << 12)) >> 12;
+        hh[i] = (unsigned char)(h > 179 ? h - 180 : h);
+        ss[i] = (unsigned char)((d * job->sdiv[v] + 2048) >> 12);
+        vv[i] = (unsigned char)v;
+    }
+}
+
+/** Labf(t), tΪQ15, 󰴵3λԲֵ **/
+static int bmp_lab_f(const BMPCsc *job, int t)
+{
+    const int *p = job->cbrt + (t >> 3);
+
+    return p[0] + (((p[1] - p[0]) * (t & 7)) >> 3);
+}
+
+static unsigned char bmp_lab_clamp(int v, int shift)
+{
+    return (unsigned char)(v < 0 ? 0 : (v >> shift > 255 ? 255 : v >> shift));
+}
+
+static void bmp_lab_block(const BMPCsc *job, const int *b, const int *g, const int *r, int n, unsigned char *ll, unsigned char *aa, unsigned char *bb)
+{
+    const int *m = job->xyz;
+    int i = 0, c = 0, lin[3], f[3], t = 0;
+
+    for (i = 0; i < n; i++) {
+        lin[0] = job->linear[r[i]];
+        lin[1] = job->linear[g[i]];
+        lin[2] = job->linear[b[i]];
+        for (c = 0; c < 3; c++) {
+            t = (m[c * 3] * lin[0] + m[c * 3 + 1] * lin[1] + m[c * 3 + 2] * lin[2] + 2048) >> 12;
+            f[c] = bmp_lab_f(job, t > 32768 ? 32768 : t);
+        }
+        //L*2.55 = fy*295.8/32768 - 40.8, Q19
+        ll[i] = bmp_lab_clamp(f[1] * 4733 - 21390950 + (1 << 18), 19);
+        aa[i] = bmp_lab_clamp((f[0] - f[1]) * 500 + (128 << 15) + (1 << 14), 15);
+        bb[i] = bmp_lab_clamp((f[1] - f[2]) * 200 + (128 << 15) + (1 << 14), 15);
+    }
+}
+
+/** LabתBGR, дؽ **/
+static void bmp_lab_inverse(const BMPCsc *job, const unsigned char *ll, const unsigned char *aa, const unsigned char *bb, int n, unsigned char *p, int bytepix)
+{
+    const int *m = job->rgb;
+    long long t[3], v = 0;
+    int i = 0, c = 0, f[3];
+
+    for (i = 0; i < n; i++, p += bytepix) {
+        f[1] = job->lstar[ll[i]];
+        f[0] = f[1] + job->astar[aa[i]];
+        f[2] = f[1] - job->bstar[bb[i]];
+        //f > 6/29 ʱ t = f^3, ΪԶ, ɫʱΪ
+        for (c = 0; c < 3; c++) {
+            if (f[c] > 6780) t[c] = (long long)f[c] * f[c] * f[c] >> 30;
+            else t[c] = (long long)(f[c] - 4520) * 4208 / 32768;
+        }
+        for (c = 0; c < 3; c++) {
+            v = (m[c * 3] * t[0] + m[c * 3 + 1] * t[1] + m[c * 3 + 2] * t[2] + 2048) >> 12;
+            p[2 - c] = job->gamma[v < 0 ? 0 : (v > 32768 ? 32768 : v) >> 2];
+        }
+    }
+}
+
+/** HSVתBGR, 60ȡ v/p/q/t **/
+static void bmp_hsv_inverse(const unsigned char *hh, const unsigned char *ss, const unsigned char *vv, int n, unsigned char *p, int bytepix)
+{
+    int i = 0, h = 0, s = 0, v = 0, sector = 0, f = 0, a = 0, q = 0, t = 0;
+
+    for (i = 0; i < n; i++, p += bytepix) {
+        h = hh[i] >= 180 ? hh[i] - 180 : hh[i];
+        s = ss[i];
+        v = vv[i];
+        sector = h / 30;
+        f = h - sector * 30;
+        a = (v * (255 - s) + 127) / 255;
+        q = (v * (7650 - s * f) + 3825) / 7650;
+        t = (v * (7650 - s * (30 - f)) + 3825) / 7650;
+        switch (sector) {
+        case 0: p[2] = v; p[1] = t; p[0] = a; break;
+        case 1: p[2] = q; p[1] = v; p[0] = a; break;
+        case 2: p[2] = a; p[1] = v; p[0] = t; break;
+        case 3: p[2] = a; p[1] = q; p[0] = v; break;
+        case 4: p[2] = t; p[1] = a; p[0] = v; break;
+        default: p[2] = v; p[1] = a; p[0] = q; break;
+        }
+    }
+}
+
+/** תƽ: YCbCr420ʱÿΪ, Ϊһ **/
+static void bmp_csc_forward(void *arg, int begin, int end)
+{
+    BMPCsc *job = (BMPCsc *)arg;
+    const BMPPlanes *pl = job->planes;
+    const unsigned char *p0 = NULL, *p1 = NULL;
+    int b[2][BMP_CSC_BLOCK], g[2][BMP_CSC_BLOCK], r[2][BMP_CSC_BLOCK];
+    int i = 0, j = 0, x = 0, x1 = 0, n = 0, m = 0, y0 = 0, y1 = 0;
+    int bytepix = job->bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(job->bmp);
+    int shift = job->space == BMP_COLOR_YCBCR420 ? 1 : 0;
+
+    for (i = begin; i < end; i++) {
+        y0 = i << shift;
+        y1 = shift && y0 + 1 < job->bmp->height ? y0 + 1 : y0;
+        p0 = job->bmp->data + (size_t)y0 * perline;
+        p1 = job->bmp->data + (size_t)y1 * perline;
+
+        for (x = 0; x < job->bmp->width; x += BMP_CSC_BLOCK) {
+            n = job->bmp->width - x < BMP_CSC_BLOCK ? job->bmp->width - x : BMP_CSC_BLOCK;
+            bmp_csc_load(p0 + x * bytepix, bytepix, n, b[0], g[0], r[0]);
+
+            switch (job->space) {
+            case BMP_COLOR_YCBCR:
+                for (j = 0; j < 3; j++)
+                    bmp_ycc_component(b[0], g[0], r[0], n, j, 0, pl->data[j] + (size_t)y0 * pl->stride[j] + x);
+                break;
+            case BMP_COLOR_YCBCR420:
+                bmp_csc_load(p1 + x * bytepix, bytepix, n, b[1], g[1], r[1]);
+                bmp_ycc_component(b[0], g[0], r[0], n, 0, 0, pl->data[0] + (size_t)y0 * pl->stride[0] + x);
+                if (y1 != y0) bmp_ycc_component(b[1], g[1], r[1], n, 0, 0, pl->data[0] + (size_t)y1 * pl->stride[0] + x);
+                //2x2, ұԵ±Եظһ, Żصһ
+                m = (n + 1) / 2;
+                for (j = 0; j < m; j++) {
+                    x1 = 2 * j + 1 < n ? 2 * j + 1 : 2 * j;
+                    b[0][j] = b[0][2 * j] + b[0][x1] + b[1][2 * j] + b[1][x1];
+                    g[0][j] = g[0][2 * j] + g[0][x1] + g[1][2 * j] + g[1][x1];
+                    r[0][j] = r[0][2 * j] + r[0][x1] + r[1][2 * j] + r[1][x1];
+                }
+                for (j = 1; j < 3; j++)
+                    bmp_ycc_component(b[0], g[0], r[0], m, j, 2, pl->data[j] + (size_t)i * pl->stride[j] + x / 2);
+                break;
+            case BMP_COLOR_HSV:
+                bmp_hsv_block(job, b[0], g[0], r[0], n, pl->data[0] + (size_t)y0 * pl->stride[0] + x,
+                    pl->data[1] + (size_t)y0 * pl->stride[1] + x, pl->data[2] + (size_t)y0 * pl->stride[2] + x);
+                break;
+            default:
+                bmp_lab_block(job, b[0], g[0], r[0], n, pl->data[0] + (size_t)y0 * pl->stride[0] + x,
+                    pl->data[1] + (size_t)y0 * pl->stride[1] + x, pl->data[2] + (size_t)y0 * pl->stride[2] + x);
+            }
+        }
+    }
+}
+
+static void bmp_csc_inverse(void *arg, int begin, int end)
+{
+    BMPCsc *job = (BMPCsc *)arg;
+    const BMPPlanes *pl = job->planes;
+    const unsigned char *src[3];
+    unsigned char *p = NULL, ob[BMP_CSC_BLOCK], og[BMP_CSC_BLOCK], orr[BMP_CSC_BLOCK];
+    int yy[BMP_CSC_BLOCK], cb[BMP_CSC_BLOCK], cr[BMP_CSC_BLOCK];
+    int y = 0, x = 0, i = 0, n = 0, cy = 0, half = 0;
+    int bytepix = job->bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(job->bmp);
+
+    half = job->space == BMP_COLOR_YCBCR420;
+    for (y = begin; y < end; y++) {
+        p = job->bmp->data + (size_t)y * perline;
+        cy = half ? y / 2 : y;
+        src[0] = pl->data[0] + (size_t)y * pl->stride[0];
+        src[1] = pl->data[1] + (size_t)cy * pl->stride[1];
+        src[2] = pl->data[2] + (size_t)cy * pl->stride[2];
+
+        for (x = 0; x < job->bmp->width; x += BMP_CSC_BLOCK, p += BMP_CSC_BLOCK * bytepix) {
+            n = job->bmp->width - x < BMP_CSC_BLOCK ? job->bmp->width - x : BMP_CSC_BLOCK;
+            if (job->space == BMP_COLOR_HSV) {
+                bmp_hsv_inverse(src[0] + x, src[1] + x, src[2] + x, n, p, bytepix);
+                continue;
+            }
+            if (job->space == BMP_COLOR_LAB) {
+                bmp_lab_inverse(job, src[0] + x, src[1] + x, src[2] + x, n, p, bytepix);
+                continue;
+            }
+
+            for (i = 0; i < n; i++) {
+                yy[i] = src[0][x + i];
+                cb[i] = src[1][(x + i) >> half] - 128;
+                cr[i] = src[2][(x + i) >> half] - 128;
+            }
+            bmp_ycc_inverse(yy, cb, cr, n, ob, og, orr);
+            for (i = 0; i < n; i++) {
+                p[i * bytepix] = ob[i];
+                p[i * bytepix + 1] = og[i];
+                p[i * bytepix + 2] = orr[i];
+            }
+        }
+    }
+}
+
+/** ƽ, ֻɫռõı **/
+static int bmp_csc_init(BMPCsc *job, BMP *bmp, int space, const BMPPlanes *planes, int inverse)
+{
+    double s = 0, t = 0;
+    int i = 0, j = 0, w = 0;
+
+    if (BMPNULL(bmp) || planes == NULL || space < BMP_COLOR_YCBCR || space > BMP_COLOR_LAB) return 0;
+    for (i = 0; i < 3; i++) {
+        w = i && space == BMP_COLOR_YCBCR420 ? (bmp->width + 1) / 2 : bmp->width;
+        if (planes->data[i] == NULL || planes->stride[i] < w) return 0;
+    }
+
+    job->bmp = bmp;
+    job->space = space;
+    job->planes = planes;
+
+    if (space == BMP_COLOR_HSV) {
+        job->sdiv[0] = job->hdiv[0] = 0;
+        for (i = 1; i < 256; i++) {
+            job->sdiv[i] = (255 * 4096 + i / 2) / i;
+            job->hdiv[i] = (30 * 4096 + i / 2) / i;
+        }
+    }
+    if (space != BMP_COLOR_LAB) return 1;
+
+    for (i = 0; i < 3; i++) for (j = 0; j < 3; j++) {
+        job->xyz[i * 3 + j] = (int)floor(bmp_xyz_matrix[i][j] / bmp_lab_white[i] * 4096 + 0.5);
+        job->rgb[i * 3 + j] = (int)floor(bmp_rgb_matrix[i][j] * bmp_lab_white[j] * 4096 + 0.5);
+    }
+    if (!inverse) {
+        for (i = 0; i < 256; i++) {
+            s = i / 255.0;
+            s = s <= 0.04045 ? s / 12.92 : pow((s + 0.055) / 1.055, 2.4);
+            job->linear[i] = (int)floor(s * 32768 + 0.5);
+        }
+        for (i = 0; i < 4098; i++) {
+            t = i / 4096.0;
+            t = t > 0.008856 ? pow(t, 1 / 3.0) : 7.787 * t + 16 / 116.0;
+            job->cbrt[i] = (int)floor(t * 32768 + 0.5);
+        }
+        return 1;
+    }
+    for (i = 0; i < 256; i++) {
+        job->lstar[i] = (int)floor((i * 100 / 255.0 + 16) / 116 * 32768 + 0.5);
+        job->astar[i] = (int)floor((i - 128) / 500.0 * 32768 + 0.5);
+        job->bstar[i] = (int)floor((i - 128) / 200.0 * 32768 + 0.5);
+    }
+    for (i = 0; i < 8193; i++) {
+        t = i / 8192.0;
+        t = t <= 0.0031308 ? 12.92 * t : 1.055 * pow(t, 1 / 2.4) - 0.055;
+        job->gamma[i] = (unsigned char)floor(t * 255 + 0.5);
+    }
+    return 1;
+}
+
+int bmp_plane_stride(int width)
+{
+    return (width + BMP_PLANE_ALIGN - 1) / BMP_PLANE_ALIGN * BMP_PLANE_ALIGN;
+}
+
+size_t bmp_planes_size(int space, int width, int height)
+{
+    if (space == BMP_COLOR_YCBCR420)
+        return (size_t)bmp_plane_stride(width) * height + (size_t)bmp_plane_stride((width + 1) / 2) * ((height + 1) / 2) * 2;
+    return (size_t)bmp_plane_stride(width) * height * 3;
+}
+
+void bmp_planes_init(BMPPlanes *planes, int space, int width, int height, unsigned char *buffer)
+{
+    int i = 0;
+
+    for (i = 0; i < 3; i++) {
+        planes->stride[i] = bmp_plane_stride(i && space == BMP_COLOR_YCBCR420 ? (width + 1) / 2 : width);
+        planes->data[i] = buffer;
+        buffer += (size_t)planes->stride[i] * (i && space == BMP_COLOR_YCBCR420 ? (height + 1) / 2 : height);
+    }
+}
+
+int bmp_to_planes(const BMP *bmp, int space, const BMPPlanes *planes)
+{
+    BMPCsc job;
+
+    if (!bmp_csc_init(&job, (BMP *)bmp, space, planes, 0)) return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_TO_PLANES);
+    bmp_parallel_for(space == BMP_COLOR_YCBCR420 ? (bmp->height + 1) / 2 : bmp->height, bmp_csc_forward, &job);
+    BMP_STAT_END(BMP_STAT_TO_PLANES, (double)bmp->width * bmp->height);
+    return 1;
+}
+
+int bmp_from_planes(BMP *bmp, int space, const BMPPlanes *planes)
+{
+    BMPCsc job;
+
+    if (!bmp_csc_init(&job, bmp, space, planes, 1)) return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_FROM_PLANES);
+    bmp_parallel_for(bmp->height, bmp_csc_inverse, &job);
+    BMP_STAT_END(BMP_STAT_FROM_PLANES, (double)bmp->width * bmp->height);
+    return 1;
+}
+
+// +---------------------------------------------------------
+// | 
+// +---------------------------------------------------------
+
+struct BMPDirty
+{
+    int width, height;
+    int count;
+    BMPRect rect[BMP_DIRTY_MAX];
+};
+
+/** ཻһ **/
+static int bmp_rect_touch(const BMPRect *a, const BMPRect *b)
+{
+    if (a->left <= b->right && b->left <= a->right && a->top < b->bottom && b->top < a->bottom) return 1;
+    if (a->left < b->right && b->left < a->right && a->top <= b->bottom && b->top <= a->bottom) return 1;
+    return 0;
+}
+
+static void bmp_rect_union(BMPRect *a, const BMPRect *b)
+{
+    if (b->left < a->left) a->left = b->left;
+    if (b->top < a->top) a->top = b->top;
+    if (b->right > a->right) a->right = b->right;
+    if (b->bottom > a->bottom) a->bottom = b->bottom;
+}
+
+static double bmp_rect_area(const BMPRect *rect)
+{
+    return (double)(rect->right - rect->left) * (rect->bottom - rect->top);
+}
+
+BMPDirty *bmp_dirty_create(int width, int height)
+{
+    BMPDirty *dirty = NULL;
+
+    if (width <= 0 || height <= 0) return NULL;
+    if ((dirty = (BMPDirty *)malloc(sizeof(BMPDirty))) == NULL) return NULL;
+    dirty->width = width;
+    dirty->height = height;
+    dirty->count = 0;
+    return dirty;
+}
+
+void bmp_dirty_mark(BMPDirty *dirty, const BMPRect *rect)
+{
+    BMPRect r, u;
+    int i = 0, best = 0;
+    double cost = 0, mincost = 0;
+
+    if (dirty == NULL || rect == NULL) return;
+    r.left = rect->left < 0 ? 0 : rect->left;
+    r.top = rect->top < 0 ? 0 : rect->top;
+    r.right = rect->right > dirty->width ? dirty->width : rect->right;
+    r.bottom = rect->bottom > dirty->height ? dirty->height : rect->bottom;
+    if (r.right <= r.left || r.bottom <= r.top) return;
+
+    for (;;) {
+        //ཻڵľ, ϲµ, ɨ
+        for (i = 0; i < dirty->count; i++) {
+            if (bmp_rect_touch(&dirty->rect[i], &r)) break;
+        }
+        if (i < dirty->count) {
+            bmp_rect_union(&r, &dirty->rect[i]);
+            dirty->rect[i] = dirty->rect[--dirty->count];
+            continue;
+        }
+        if (dirty->count < BMP_DIRTY_MAX) break;
+
+        //: ϲٵľκϲ
+        for (i = 0; i < dirty->count; i++) {
+            u = dirty->rect[i];
+            bmp_rect_union(&u, &r);
+            cost = bmp_rect_area(&u) - bmp_rect_area(&dirty->rect[i]);
+            if (i == 0 || cost < mincost) {
+                mincost = cost;
+                best = i;
+            }
+        }
+        bmp_rect_union(&r, &dirty->rect[best]);
+        dirty->rect[best] = dirty->rect[--dirty->count];
+    }
+    dirty->rect[dirty->count++] = r;
+}
+
+void bmp_dirty_mark_all(BMPDirty *dirty)
+{
+    if (dirty == NULL) return;
+    dirty->count = 1;
+    dirty->rect[0].left = dirty->rect[0].top = 0;
+    dirty->rect[0].right = dirty->width;
+    dirty->rect[0].bottom = dirty->height;
+}
+
+int bmp_dirty_diff(BMPDirty *dirty, BMP *prev, BMP *cur)
+{
+    BMPDiff *diff = NULL;
+    int i = 0;
+
+    if (dirty == NULL || BMPNULL(prev) || BMPNULL(cur)) return -1;
+    if (prev->width != dirty->width || prev->height != dirty->height ||
+        cur->width != dirty->width || cur->height != dirty->height) return -1;
+
+    //λͬ޷ֽڱȽ
+    if (prev->alpha != cur->alpha) {
+        bmp_dirty_mark_all(dirty);
+        return dirty->count;
+    }
+
+    BMP_STAT_BEGIN(BMP_STAT_DIRTY_DIFF);
+    if ((diff = bmp_diff(prev, cur, BMP_DIRTY_TILE, 0, BMP_DIFF_ALPHA)) == NULL) {
+        BMP_STAT_END(BMP_STAT_DIRTY_DIFF, 0);
+        return -1;
+    }
+    for (i = 0; i < diff->rectcount; i++)
+        bmp_dirty_mark(dirty, &diff->rects[i]);
+    bmp_diff_destroy(&diff);
+    BMP_STAT_END(BMP_STAT_DIRTY_DIFF, (double)cur->width * cur->height);
+    return dirty->count;
+}
+
+int bmp_dirty_count(BMPDirty *dirty)
+{
+    return dirty ? dirty->count : 0;
+}
+
+int bmp_dirty_rect(BMPDirty *dirty, int i, BMPRect *rect)
+{
+    if (dirty == NULL || rect == NULL || i < 0 || i >= dirty->count) return 0;
+    *rect = dirty->rect[i];
+    return 1;
+}
+
+void bmp_dirty_clear(BMPDirty *dirty)
+{
+    if (dirty) dirty->count = 0;
+}
+
+void bmp_dirty_destroy(BMPDirty **dirty)
+{
+    if (dirty == NULL) return;
+    SAFE_FREE(*dirty);
+}
+
+/** Ƿڸͼ **/
+static int bmp_dirty_match(BMPDirty *dirty, BMP *bmp)
+{
+    return dirty->width == bmp->width && dirty->height == bmp->height;
+}
+
+/** չüͼ **/
+static void bmp_rect_expand(BMPRect *rect, int rx, int ry, int width, int height)
+{
+    rect->left = rect->left - rx < 0 ? 0 : rect->left - rx;
+    rect->top = rect->top - ry < 0 ? 0 : rect->top - ry;
+    rect->right = rect->right + rx > width ? width : rect->right + rx;
+    rect->bottom = rect->bottom + ry > height ? height : rect->bottom + ry;
+}
+
+int bmp_convolve_update(BMP *src, BMP *dst, BMPKernel *kernel, int border, BMPBGR fillclr, BMPDirty *dirty)
+{
+    BMP *part = NULL;
+    BMPRect out, in;
+    const unsigned char *s = NULL, *a = NULL;
+    unsigned char *d = NULL;
+    int i = 0, x = 0, y = 0, rx = 0, ry = 0, ok = 1;
+    int bytepix = 0, perline = 0, perline2 = 0;
+    double area = 0;
+
+    if (BMPNULL(src) || BMPNULL(dst) || kernel == NULL) return 0;
+    if (src->width != dst->width || src->height != dst->height || src->alpha != dst->alpha) return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_CONVOLVE_UPDATE);
+    rx = kernel->width / 2;
+    ry = kernel->height / 2;
+    if (dirty) {
+        if (!bmp_dirty_match(dirty, src)) {
+            BMP_STAT_END(BMP_STAT_CONVOLVE_UPDATE, 0);
+            return 0;
+        }
+        for (i = 0; i < dirty->count; i++) {
+            out = dirty->rect[i];
+            bmp_rect_expand(&out, 2 * rx, 2 * ry, src->width, src->height);
+            area += bmp_rect_area(&out);
+        }
+    }
+
+    //ûϢһʱ
+    if (dirty == NULL || area * 2 >= (double)src->width * src->height) {
+        memcpy(dst->data, src->data, src->size < dst->size ? src->size : dst->size);
+        bmp_convolve(dst, kernel, border, fillclr);
+        BMP_STAT_END(BMP_STAT_CONVOLVE_UPDATE, (double)src->width * src->height);
+        return 1;
+    }
+
+    bytepix = src->alpha == 1 ? 4 : 3;
+    perline = BMP_PERLINE_REALSIZE(src);
+    for (i = 0; i < dirty->count && ok; i++) {
+        //Ϊ˰뾶, һ; óͼֻԭͼԵõ߽
+        out = dirty->rect[i];
+        bmp_rect_expand(&out, rx, ry, src->width, src->height);
+        in = out;
+        bmp_rect_expand(&in, rx, ry, src->width, src->height);
+
+        if ((part = bmp_copy_rect(src, in.left, in.top, in.right, in.bottom)) == NULL) {
+            ok = 0;
+            break;
+        }
+        bmp_convolve(part, kernel, border, fillclr);
+
+        //ͼΪ24λ, alphaȡsrc
+        perline2 = BMP_PERLINE_REALSIZE(part);
+        for (y = out.top; y < out.bottom; y++) {
+            s = part->data + (size_t)(y - in.top) * perline2 + (out.left - in.left) * 3;
+            d = dst->data + (size_t)y * perline + out.left * bytepix;
+            if (bytepix == 3) {
+                memcpy(d, s, (size_t)(out.right - out.left) * 3);
+                continue;
+            }
+            a = src->data + (size_t)y * perline + out.left * 4 + 3;
+            for (x = out.left; x < out.right; x++, s += 3, d += 4, a += 4) {
+                d[0] = s[0];
+                d[1] = s[1];
+                d[2] = s[2];
+                d[3] = *a;
+            }
+        }
+        bmp_destroy(&part);
+    }
+    BMP_STAT_END(BMP_STAT_CONVOLVE_UPDATE, ok ? area : 0);
+    return ok;
+}
+
+int bmp_gaussblur_update(BMP *src, BMP *dst, double sigma, BMPDirty *dirty)
+{
+    BMPKernel *kernel = NULL;
+    BMPBGR fillclr = {0, 0, 0};
+    double **kern = NULL;
+    int i = 0, winsize = 0, recode = 0;
+
+    if (BMPNULL(src) || BMPNULL(dst)) return 0;
+    if (src->width != dst->width || src->height != dst->height || src->alpha != dst->alpha) return 0;
+
+    if (sigma >= BMP_GAUSS_IIR_SIGMA) {
+        memcpy(dst->data, src->data, src->size < dst->size ? src->size : dst->size);
+        bmp_gaussblur_iir(dst, sigma);
+        return 1;
+    }
+
+    //bmp_gaussblur_filterͬĺ
+    winsize = (1 + (((int)ceil(3 * sigma)) * 2));
+    if ((kern = bmp_gaussblur(sigma)) == NULL) return 0;
+    kernel = bmp_kernel_from_matrix(kern, winsize);
+    for (i = 0; i < winsize; i++)
+        free(kern[i]);
+    free(kern);
+    if (kernel == NULL) return 0;
+
+    recode = bmp_convolve_update(src, dst, kernel, BMP_BORDER_MIRROR, fillclr, dirty);
+    bmp_kernel_destroy(&kernel);
+    return recode;
+}
+
+struct BMPHistCache
+{
+    int width, height, offset;
+    int histogram[256];
+    unsigned char *plane;       //ϴμʱֵͨ
+};
+
+BMPHistCache *bmp_histcache_create(BMP *bmp, int offset)
+{
+    BMPHistCache *cache = NULL;
+
+    if (BMPNULL(bmp) || offset < 0 || offset > (bmp->alpha == 1 ? 3 : 2)) return NULL;
+    if ((cache = (BMPHistCache *)malloc(sizeof(BMPHistCache))) == NULL) return NULL;
+    if ((cache->plane = (unsigned char *)malloc((size_t)bmp->width * bmp->height)) == NULL) {
+        free(cache);
+        return NULL;
+    }
+    cache->width = bmp->width;
+    cache->height = bmp->height;
+    cache->offset = offset;
+    memset(cache->histogram, 0, sizeof(cache->histogram));
+    memset(cache->plane, 0, (size_t)bmp->width * bmp->height);
+    cache->histogram[0] = bmp->width * bmp->height;
+
+    //ȫ0ʼ
+    bmp_histcache_update(cache, bmp, NULL);
+    return cache;
+}
+
+/** һ, صظʱֵֵ,  **/
+static void bmp_histcache_rect(BMPHistCache *cache, BMP *bmp, const BMPRect *rect)
+{
+    const unsigned char *s = NULL;
+    unsigned char *p = NULL;
+    int x = 0, y = 0, bytepix = bmp->alpha == 1 ? 4 : 3, perline = BMP_PERLINE_REALSIZE(bmp);
+
+    for (y = rect->top; y < rect->bottom; y++) {
+        s = bmp->data + (size_t)y * perline + rect->left * bytepix + cache->offset;
+        p = cache->plane + (size_t)y * cache->width + rect->left;
+        for (x = rect->left; x < rect->right; x++, s += bytepix, p++) {
+            if (*p == *s) continue;
+            cache->histogram[*p]--;
+            cache->histogram[*s]++;
+            *p = *s;
+        }
+    }
+}
+
+const int *bmp_histcache_update(BMPHistCache *cache, BMP *bmp, BMPDirty *dirty)
+{
+    BMPRect all;
+    int i = 0;
+    double pixels = 0;
+
+    if (cache == NULL || BMPNULL(bmp)) return NULL;
+    if (bmp->width != cache->width || bmp->height != cache->height) return NULL;
+    if (cache->offset > (bmp->alpha == 1 ? 3 : 2)) return NULL;
+    if (dirty && !bmp_dirty_match(dirty, bmp)) return NULL;
+
+    BMP_STAT_BEGIN(BMP_STAT_HISTCACHE_UPDATE);
+    if (dirty == NULL) {
+        all.left = all.top = 0;
+        all.right = bmp->width;
+        all.bottom = bmp->height;
+        bmp_histcache_rect(cache, bmp, &all);
+        pixels = (double)bmp->width * bmp->height;
+    } else {
+        for (i = 0; i < dirty->count; i++) {
+            bmp_histcache_rect(cache, bmp, &dirty->rect[i]);
+            pixels += bmp_rect_area(&dirty->rect[i]);
+        }
+    }
+    BMP_STAT_END(BMP_STAT_HISTCACHE_UPDATE, pixels);
+    return cache->histogram;
+}
+
+void bmp_histcache_destroy(BMPHistCache **cache)
+{
+    if (cache == NULL || *cache == NULL) return;
+    free((*cache)->plane);
+    SAFE_FREE(*cache);
+}
+
+struct BMPSearchCache
+{
+    BMP *tpl;
+    int width, height;          //ͼС
+    int cols, rows;             //ѡλ, ͬbmp_search
+    int count;
+    unsigned char *match;       //ÿѡλһλ
+};
+
+/** ¼һѡλ **/
+static void bmp_searchcache_check(BMPSearchCache *cache, BMP *bmp, int x0, int y0, int x1, int y1)
+{
+    size_t i = 0;
+    int x = 0, y = 0, hit = 0, old = 0;
+
+    for (y = y0; y < y1; y++) for (x = x0; x < x1; x++) {
+        i = (size_t)y * cache->cols + x;
+        hit = bmp_search_verify(bmp, cache->tpl, x, y, 0);
+        old = (cache->match[i >> 3] >> (i & 7)) & 1;
+        if (hit == old) continue;
+        cache->match[i >> 3] ^= (unsigned char)(1 << (i & 7));
+        cache->count += hit ? 1 : -1;
+    }
+}
+
+BMPSearchCache *bmp_searchcache_create(BMP *bmp, BMP *bmp2)
+{
+    BMPSearchCache *cache = NULL;
+    size_t bytes = 0;
+
+    if (BMPNULL(bmp) || BMPNULL(bmp2)) return NULL;
+    if (bmp->width < bmp2->width || bmp->height < bmp2->height) return NULL;
+    if ((cache = (BMPSearchCache *)malloc(sizeof(BMPSearchCache))) == NULL) return NULL;
+    memset(cache, 0, sizeof(BMPSearchCache));
+
+    cache->width = bmp->width;
+    cache->height = bmp->height;
+    cache->cols = bmp->width - bmp2->width;
+    cache->rows = bmp->height - bmp2->height;
+    bytes = ((size_t)cache->cols * cache->rows + 7) / 8;
+    cache->tpl = bmp_copy(bmp2);
+    cache->match = (unsigned char *)malloc(bytes ? bytes : 1);
+    if (cache->tpl == NULL || cache->match == NULL) {
+        bmp_searchcache_destroy(&cache);
+        return NULL;
+    }
+    memset(cache->match, 0, bytes ? bytes : 1);
+    bmp_searchcache_check(cache, bmp, 0, 0, cache->cols, cache->rows);
+    return cache;
+}
+
+int bmp_searchcache_update(BMPSearchCache *cache, BMP *bmp, BMPDirty *dirty, int *x, int *y)
+{
+    const BMPRect *rect = NULL;
+    size_t i = 0, n = 0;
+    int k = 0, x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    double pixels = 0;
+
+    if (cache == NULL || BMPNULL(bmp)) return 0;
+    if (bmp->width != cache->width || bmp->height != cache->height) return 0;
+    if (dirty && !bmp_dirty_match(dirty, bmp)) return 0;
+
+    BMP_STAT_BEGIN(BMP_STAT_SEARCHCACHE_UPDATE);
+    if (dirty == NULL) {
+        bmp_searchcache_check(cache, bmp, 0, 0, cache->cols, cache->rows);
+        pixels = (double)bmp->width * bmp->height;
+    } else {
+        //ģ帲ǵλ: [left - tw + 1, right) x [top - th + 1, bottom)
+        for (k = 0; k < dirty->count; k++) {
+            rect = &dirty->rect[k];
+            x0 = rect->left - cache->tpl->width + 1;
+            y0 = rect->top - cache->tpl->height + 1;
+            x0 = x0 < 0 ? 0 : x0;
+            y0 = y0 < 0 ? 0 : y0;
+            x1 = rect->right > cache->cols ? cache->cols : rect->right;
+            y1 = rect->bottom > cache->rows ? cache->rows : rect->bottom;
+            if (x1 <= x0 || y1 <= y0) continue;
+            bmp_searchcache_check(cache, bmp, x0, y0, x1, y1);
+            pixels += bmp_rect_area(rect);
+        }
+    }
+    BMP_STAT_END(BMP_STAT_SEARCHCACHE_UPDATE, pixels);
+
+    if (cache->count == 0) return 0;
+
+    //ȡһ, bmp_searchһ
+    n = ((size_t)cache->cols * cache->rows + 7) / 8;
+    for (i = 0; i < n && cache->match[i] == 0; i++);
+    for (i *= 8; !((cache->match[i >> 3] >> (i & 7)) & 1); i++);
+    if (x) *x = (int)(i % cache->cols);
+    if (y) *y = (int)(i / cache->cols);
+    return 1;
+}
+
+int bmp_searchcache_count(BMPSearchCache *cache)
+{
+    return cache ? cache->count : 0;
+}
+
+void bmp_searchcache_destroy(BMPSearchCache **cache)
+{
+    if (cache == NULL || *cache == NULL) return;
+    bmp_destroy(&(*cache)->tpl);
+    free((*cache)->match);
+    SAFE_FREE(*cache);
+}
+
+/*
+void function(BMP *bmp)
+{
+    int w = 0, h = 0;
+    size_t speed = 0;
     int bytepix = 0, perline = 0;
 
     if (BMPNULL(bmp)) return;
@@ -1,6 +1,8 @@
 #ifndef LIB_BMP_H
 #define LIB_BMP_H
 
+#include <stddef.h>
+
 #ifndef CAPI
 #define CAPI extern
 #endif
@@ -20,7 +22,8 @@ extern "C" {
 typedef struct BMP
 {
     unsigned char *data;
-    int size, width, height;
+    size_t size;                //ֽ, 64λƽ̨ɳ2G
+    int width, height;
     int alpha;
 }BMP;
 
@@ -38,8 +41,34 @@ CAPI BMP *bmp_load(const char *file);
 
 CAPI void bmp_save(BMP *bmp, const char *file);
 
+//bmp_save_exѡ
+#define BMP_SAVE_TOPDOWN 0x01   //϶´洢(߶Ϊ), 赹ת
+#define BMP_SAVE_DIRECT  0x02   //O_DIRECTд(֧ʱ)
+#define BMP_SAVE_SYNC    0x04   //дfdatasync
+
+/** ͼ, ɹ1 **/
+CAPI int bmp_save_ex(BMP *bmp, const char *file, int flags);
+
 CAPI void bmp_destroy(BMP **bmp);
 
+/** ڴȡͼ **/
+CAPI BMP *bmp_load_mem(const void *buf, size_t len);
+
+/** ֱڴеͼ(϶´洢), ֻ, bmp_unwrapͷ **/
+CAPI BMP *bmp_wrap_mem(const void *buf, size_t len);
+
+/** ͷbmp_wrap_memĽ, ͷ **/
+CAPI void bmp_unwrap(BMP **bmp);
+
+/** ֽ **/
+CAPI size_t bmp_encoded_size(BMP *bmp);
+
+/** 뵽·ڴ, free **/
+CAPI void *bmp_save_mem(BMP *bmp, size_t *len);
+
+/** 뵽ָڴ, дֽ, ռ䲻㷵0 **/
+CAPI size_t bmp_save_mem_to(BMP *bmp, void *buf, size_t len);
+
 // +---------------------------------------------------------
 // | ͼ 
 // +---------------------------------------------------------
@@ -127,18 +156,556 @@ CAPI void bmp_box_filter(BMP *bmp, int box);
 /** ֵ˲ **/
 CAPI void bmp_middle_filter(BMP *bmp, int box);
 
+//sigmaСڸֵʱ˹˲õݹʵ
+#ifndef BMP_GAUSS_IIR_SIGMA
+#define BMP_GAUSS_IIR_SIGMA 8.0
+#endif
+
 /** ˹˲ **/
 CAPI void bmp_gaussblur_filter(BMP *bmp, double sigma);
 
+/** ݹ˹˲, ÿغʱsigma޹, ߽簴ظԵش; sigmaС0.5ʱ **/
+CAPI void bmp_gaussblur_iir(BMP *bmp, double sigma);
+
 /**  **/
 CAPI void bmp_convolution_filter(BMP *bmp, double **convolu, int size);
 
+// +---------------------------------------------------------
+// | 
+// +---------------------------------------------------------
+
+//߽紦ʽ
+#define BMP_BORDER_MIRROR    0  //(ظԵ)
+#define BMP_BORDER_REPLICATE 1  //ظԵ
+#define BMP_BORDER_CONSTANT  2  //
+
+//Ԥþ
+#define BMP_KERNEL_SOBEL_X 0
+#define BMP_KERNEL_SOBEL_Y 1
+#define BMP_KERNEL_SHARPEN 2
+#define BMP_KERNEL_EMBOSS  3
+
+typedef struct BMPKernel BMPKernel;
+
+/** (ϵ, д, Ϊ) **/
+CAPI BMPKernel *bmp_kernel_create(const float *taps, int width, int height);
+
+/** (int16ϵ, ʵֵΪ taps / 2^shift) **/
+CAPI BMPKernel *bmp_kernel_create_fixed(const short *taps, int width, int height, int shift);
+
+/** Ԥþ **/
+CAPI BMPKernel *bmp_kernel_preset(int type);
+
+/** Ƿ񰴿ɷ **/
+CAPI int bmp_kernel_separable(BMPKernel *kernel);
+
+/** ͷž **/
+CAPI void bmp_kernel_destroy(BMPKernel **kernel);
+
+/** , borderΪBMP_BORDER_*, ʱʹfillclr **/
+CAPI void bmp_convolve(BMP *bmp, BMPKernel *kernel, int border, BMPBGR fillclr);
+
 /** Աbmp1, bmp2 **/
 CAPI int bmp_contrast(BMP *bmp1, BMP *bmp2);
 
 /** bmpѰbmp2 **/
 CAPI int bmp_search(BMP *bmp, BMP *bmp2, int *x, int *y);
 
+// +---------------------------------------------------------
+// | 첽д
+// +---------------------------------------------------------
+
+//첽߳
+#ifndef BMP_ASYNC_THREADS
+#define BMP_ASYNC_THREADS 4
+#endif
+
+typedef struct BMPAsync BMPAsync;
+
+/** 첽ɻص, result == 1 ɹ, loadʱbmp_async_waitȡ **/
+typedef void (*BMPAsyncCallback)(BMPAsync *req, int result, void *userdata);
+
+/** 첽ȡͼ **/
+CAPI BMPAsync *bmp_load_async(const char *file, BMPAsyncCallback callback, void *userdata);
+
+/** 첽ͼ, ǰbmp޸Ļͷ **/
+CAPI BMPAsync *bmp_save_async(BMP *bmp, const char *file, BMPAsyncCallback callback, void *userdata);
+
+/** ѯǷ, ɷ1 **/
+CAPI int bmp_async_poll(BMPAsync *req);
+
+/** ȴɲؽ, loadʱbmp **/
+CAPI int bmp_async_wait(BMPAsync *req, BMP **bmp);
+
+/** ͷ(ȴ), ڻصе **/
+CAPI void bmp_async_destroy(BMPAsync **req);
+
+/** رչ߳, ȶе; رڼͶݵڵ߳ͬ **/
+CAPI void bmp_async_shutdown(void);
+
+// +---------------------------------------------------------
+// | ͳ (ʱ BMP_ENABLE_STATS , Ϊղ)
+// +---------------------------------------------------------
+
+enum
+{
+    BMP_STAT_LOAD, BMP_STAT_LOAD_MEM, BMP_STAT_SAVE, BMP_STAT_SAVE_MEM, BMP_STAT_COPY, BMP_STAT_COPY_RECT,
+    BMP_STAT_ADD_ALPHA, BMP_STAT_REVERSE, BMP_STAT_HORIZONTAL_FLIP, BMP_STAT_ROTATE, BMP_STAT_RESIZE_BY_CLR,
+    BMP_STAT_HISTOGRAM, BMP_STAT_CONVERT_GRAY, BMP_STAT_BINARYZATION, BMP_STAT_OTSU, BMP_STAT_AVERAGE_FILTER,
+    BMP_STAT_BOX_FILTER, BMP_STAT_MIDDLE_FILTER, BMP_STAT_GAUSSBLUR_FILTER, BMP_STAT_CONVOLUTION_FILTER,
+    BMP_STAT_CONTRAST, BMP_STAT_SEARCH, BMP_STAT_CONVOLVE, BMP_STAT_GAUSSBLUR_IIR,
+    BMP_STAT_THRESHOLD_LOCAL, BMP_STAT_SEARCH_PYRAMID,
+    BMP_STAT_TPLSET_SEARCH, BMP_STAT_HASH, BMP_STAT_PHASH,
+    BMP_STAT_APPLY_LUT, BMP_STAT_DIRTY_DIFF, BMP_STAT_CONVOLVE_UPDATE,
+    BMP_STAT_HISTCACHE_UPDATE, BMP_STAT_SEARCHCACHE_UPDATE, BMP_STAT_DIFF,
+    BMP_STAT_EQUALIZE_HIST, BMP_STAT_CLAHE, BMP_STAT_MORPHOLOGY,
+    BMP_STAT_TO_PLANES, BMP_STAT_FROM_PLANES,
+    BMP_STAT_COUNT
+};
+
+typedef struct BMPStatEntry
+{
+    const char *name;
+    unsigned long long calls;
+    unsigned long long ns;              //ۼƺʱ(ڲ)
+    unsigned long long pixels;          //
+    unsigned long long alloc_bytes;     //ۼƷֽ
+    unsigned long long max_alloc;       //εۼƷֽڵֵ(۳ͷ, פֵ)
+}BMPStatEntry;
+
+typedef struct BMPStats
+{
+    BMPStatEntry func[BMP_STAT_COUNT];
+    unsigned long long allocs, alloc_bytes;
+}BMPStats;
+
+/** ȡ߳ۼƵͳ **/
+CAPI void bmp_stats_snapshot(BMPStats *stats);
+
+/** ̵߳ͳ **/
+CAPI void bmp_stats_reset(void);
+
+/** ʼChrome trace-event JSON, ɹ1 **/
+CAPI int bmp_trace_open(const char *file);
+
+/** trace **/
+CAPI void bmp_trace_close(void);
+
+// +---------------------------------------------------------
+// | ͼ
+// +---------------------------------------------------------
+
+typedef struct BMPIntegral
+{
+    int width, height;
+    int channels;               //3: BGR, 1: Ҷ
+    unsigned long long *sum;    //(width + 1) * (height + 1) * channels
+    unsigned long long *sqsum;
+}BMPIntegral;
+
+/** ͼ(ƽ), gray == 1 ʱ (b + g + r) / 3 ͨ **/
+CAPI BMPIntegral *bmp_integral_create(BMP *bmp, int gray);
+
+/** ͷŻͼ **/
+CAPI void bmp_integral_destroy(BMPIntegral **integral);
+
+/** ֵ(right/bottom), meanͨ, ɹ1 **/
+CAPI int bmp_rect_mean(BMPIntegral *integral, BMPRect *rect, double *mean);
+
+/** 򷽲, ɹ1 **/
+CAPI int bmp_rect_variance(BMPIntegral *integral, BMPRect *rect, double *variance);
+
+/** SauvolaӦֵ, windowΪڱ߳, kһȡ0.2~0.5 **/
+CAPI void bmp_threshold_sauvola(BMP *bmp, int window, double k);
+
+/** BradleyӦֵ, ھֲֵ (1 - t) Ϊ, tһȡ0.15 **/
+CAPI void bmp_threshold_bradley(BMP *bmp, int window, double t);
+
+// +---------------------------------------------------------
+// | 
+// +---------------------------------------------------------
+
+//
+#ifndef BMP_PYRAMID_MAX
+#define BMP_PYRAMID_MAX 8
+#endif
+
+typedef struct BMPPyramid
+{
+    int levels;
+    BMP *level[BMP_PYRAMID_MAX];    //level[0]Ϊԭͼ, ֮ÿ2x2ƽСһ
+}BMPPyramid;
+
+/** , 0ԭͼ(ԭͼȽͷ) **/
+CAPI BMPPyramid *bmp_pyramid_create(BMP *bmp, int levels);
+
+/** ͷŽ(ͷԭͼ) **/
+CAPI void bmp_pyramid_destroy(BMPPyramid **pyramid);
+
+//ֻҪƥλþһ1: ѡƥʱȡsadС(ͬȡϿ),
+//ѡƥʱԭͼУ鲢ȡϿλ, ʱʱӽ
+/** , ҵ1, ÿtoleranceΪͬ, maxcandΪÿ㱣ĺѡ **/
+CAPI int bmp_search_pyramid(BMP *bmp, BMP *bmp2, int levels, int tolerance, int maxcand, int *x, int *y);
+
+/** ѽ(ɻ)Ľ **/
+CAPI int bmp_search_pyramid_ex(BMPPyramid *pyramid, BMPPyramid *pyramid2, int tolerance, int maxcand, int *x, int *y);
+
+// +---------------------------------------------------------
+// | ģ
+// +---------------------------------------------------------
+
+typedef struct BMPTemplateSet BMPTemplateSet;
+
+//ҵģʱص, 0ֹͣ
+typedef int (*BMPTemplateCallback)(int index, int x, int y, void *userdata);
+
+/** ģ弯 **/
+CAPI BMPTemplateSet *bmp_tplset_create(void);
+
+/** ģ(һ), ģ, ʧܷ-1 **/
+CAPI int bmp_tplset_add(BMPTemplateSet *set, BMP *bmp);
+
+/** ê(ʱδԶ) **/
+CAPI int bmp_tplset_compile(BMPTemplateSet *set);
+
+/** ɨһbmpģλ(ȷƥ), ҵ **/
+CAPI int bmp_tplset_search(BMPTemplateSet *set, BMP *bmp, BMPTemplateCallback callback, void *userdata);
+
+/** ͷģ弯 **/
+CAPI void bmp_tplset_destroy(BMPTemplateSet **set);
+
+// +---------------------------------------------------------
+// | ͼָ
+// +---------------------------------------------------------
+
+/** ݹϣ(64λ), βֽ, ߺλͬϣͬ **/
+CAPI unsigned long long bmp_hash(BMP *bmp);
+
+/** ֵϣ(8x8Ҷ) **/
+CAPI unsigned long long bmp_ahash(BMP *bmp);
+
+/** ֵϣ(9x8Ҷ, رȽ) **/
+CAPI unsigned long long bmp_dhash(BMP *bmp);
+
+/** ֪ϣ(32x32ҶDCTƵ8x8) **/
+CAPI unsigned long long bmp_phash(BMP *bmp);
+
+/** ϣĺ **/
+CAPI int bmp_hamming(unsigned long long hash, unsigned long long hash2);
+
+// +---------------------------------------------------------
+// | ָ(BK)
+// +---------------------------------------------------------
+
+typedef struct BMPHashIndex BMPHashIndex;
+
+typedef struct BMPHashMatch
+{
+    int id;
+    int distance;
+}BMPHashMatch;
+
+/**  **/
+CAPI BMPHashIndex *bmp_hashindex_create(void);
+
+/** һϣ, idɵ߶ **/
+CAPI int bmp_hashindex_add(BMPHashIndex *index, unsigned long long hash, int id);
+
+/** Ҿ벻maxdistȫϣ(maxdistΪ0ȷ), дmax, ƥ **/
+CAPI int bmp_hashindex_find(BMPHashIndex *index, unsigned long long hash, int maxdist, BMPHashMatch *matches, int max);
+
+/** Ĺϣ, Ϊշ0 **/
+CAPI int bmp_hashindex_nearest(BMPHashIndex *index, unsigned long long hash, BMPHashMatch *match);
+
+/** еĹϣ **/
+CAPI int bmp_hashindex_count(BMPHashIndex *index);
+
+/** ͷ **/
+CAPI void bmp_hashindex_destroy(BMPHashIndex **index);
+
+// +---------------------------------------------------------
+// | ֿͼ(ڴĴͼ)
+// +---------------------------------------------------------
+
+//ĬϿС()
+#ifndef BMP_TILE_SIZE
+#define BMP_TILE_SIZE 256
+#endif
+
+//ֿͼ, 鰴LRUڴ, ޸ĹĿ黻ʱļ; ֶ֧߳ͬʱʹ
+typedef struct BMPTiled BMPTiled;
+
+//˲ص, bmpΪ鼰Χhalo
+typedef void (*BMPTileFilter)(BMP *bmp, void *userdata);
+
+/** հ׷ֿͼ, budgetΪڴпֽ **/
+CAPI BMPTiled *bmp_tiled_create(int width, int height, int alpha, int tilesize, size_t budget);
+
+/** Էֿ鷽ʽBMPļ, , Դļᱻ޸ **/
+CAPI BMPTiled *bmp_tiled_open(const char *file, int tilesize, size_t budget);
+
+/** Ƿalpha **/
+CAPI void bmp_tiled_info(BMPTiled *tiled, int *width, int *height, int *alpha);
+
+/** (tx, ty)鲢, bmp_tiled_unlock, صBMPͷ **/
+CAPI BMP *bmp_tiled_lock(BMPTiled *tiled, int tx, int ty);
+
+/** , dirty == 1 ʾݱ޸ **/
+CAPI void bmp_tiled_unlock(BMPTiled *tiled, int tx, int ty, int dirty);
+
+/** һֵڴ(alpha), ͼĲֱõ **/
+CAPI BMP *bmp_tiled_copy_rect(BMPTiled *tiled, int left, int top, int right, int bottom);
+
+/** ڴеͼд(left, top), bmpλֿͼһ **/
+CAPI int bmp_tiled_paste(BMPTiled *tiled, BMP *bmp, int left, int top);
+
+/** üΪµķֿͼ **/
+CAPI BMPTiled *bmp_tiled_crop(BMPTiled *tiled, int left, int top, int right, int bottom);
+
+/** ֱͼ(ͳ), offsetΪͨ, 256, free **/
+CAPI unsigned long long *bmp_tiled_histogram(BMPTiled *tiled, int offset);
+
+/** ˲µķֿͼ, haloС˲뾶ʱͼ˲һ **/
+CAPI BMPTiled *bmp_tiled_filter(BMPTiled *tiled, int halo, BMPTileFilter filter, void *userdata);
+
+/** תµķֿͼ, ͬbmp_rotate **/
+CAPI BMPTiled *bmp_tiled_rotate(BMPTiled *tiled, double angle, int flag, BMPBGR fillclr);
+
+/** ΪBMPļ **/
+CAPI int bmp_tiled_save(BMPTiled *tiled, const char *file);
+
+/** رշֿͼ, δ޸Ļᶪʧ **/
+CAPI void bmp_tiled_close(BMPTiled **tiled);
+
+// +---------------------------------------------------------
+// | 
+// +---------------------------------------------------------
+
+//ǰĻҶȷʽ
+#define BMP_LUT_COLOR   0   //ÿͨԼֵ
+#define BMP_LUT_GRAY    1   //Ȱ 0.3r + 0.59g + 0.11b תҶ(ͬbmp_convert_gray)
+#define BMP_LUT_AVERAGE 2   //Ȱ (b + g + r) / 3 תҶ(ͬbmp_binaryzation)
+
+typedef struct BMPLut
+{
+    unsigned char table[3][256];    //b, g, r
+    int mode;
+}BMPLut;
+
+/** ʼΪӳ **/
+CAPI void bmp_lut_init(BMPLut *lut, int mode);
+
+/** ӳ֮׷table, channelΪ-1ʱȫͨ **/
+CAPI void bmp_lut_map(BMPLut *lut, int channel, const unsigned char *table);
+
+/** : delta **/
+CAPI void bmp_lut_brightness(BMPLut *lut, int delta);
+
+/** Աȶ: 128ΪķŴk **/
+CAPI void bmp_lut_contrast(BMPLut *lut, double k);
+
+/** gammaУ **/
+CAPI void bmp_lut_gamma(BMPLut *lut, double gamma);
+
+/** ɫ **/
+CAPI void bmp_lut_invert(BMPLut *lut);
+
+/** ɫ: [inblack, inwhite] ӳ䵽 [outblack, outwhite] **/
+CAPI void bmp_lut_levels(BMPLut *lut, int inblack, int inwhite, int outblack, int outwhite);
+
+/** ֵ: СkΪ255, Ϊ0 **/
+CAPI void bmp_lut_threshold(BMPLut *lut, int k);
+
+/** 任ÿ(alpha), ֻдһڴ **/
+CAPI void bmp_apply_lut(BMP *bmp, const BMPLut *lut);
+
+// +---------------------------------------------------------
+// | ֡
+// +---------------------------------------------------------
+
+//м߳, 0ΪCPU
+#ifndef BMP_PARALLEL_THREADS
+#define BMP_PARALLEL_THREADS 0
+#endif
+
+//bmp_diffѡ
+#define BMP_DIFF_COUNT    0x01  //ͳÿ仯
+#define BMP_DIFF_PARALLEL 0x02  //зָ߳
+#define BMP_DIFF_ALPHA    0x04  //alphaͨҲȽ
+
+typedef struct BMPDiff
+{
+    int tile;                   //߳
+    int cols, rows;             //
+    int stride;                 //bitmapÿֽ
+    unsigned char *bitmap;      //ÿһλ, tyеtxΪ bitmap[ty * stride + tx / 8] >> (tx % 8) & 1
+    int *counts;                //ÿ仯, δָBMP_DIFF_COUNTʱΪNULL
+    int tiles;                  //仯Ŀ
+    long long pixels;           //仯, δָBMP_DIFF_COUNTʱΪ-1
+    int rectcount;
+    BMPRect *rects;             //(Խ)ı仯ϲӾ, right/bottom
+}BMPDiff;
+
+/** ȽͬСλͼ, ĳͨtoleranceΪ仯, tileΪ0ʱȡ32 **/
+CAPI BMPDiff *bmp_diff(BMP *bmp1, BMP *bmp2, int tile, int tolerance, int flags);
+
+/** (tx, ty)Ƿ仯 **/
+CAPI int bmp_diff_tile(BMPDiff *diff, int tx, int ty);
+
+CAPI void bmp_diff_destroy(BMPDiff **diff);
+
+// +---------------------------------------------------------
+// | ֱͼ⻯
+// +---------------------------------------------------------
+
+/** ȫֱͼ⻯, gray == 1 ʱתҶ(ͬbmp_convert_gray), ֱͨ **/
+CAPI void bmp_equalize_hist(BMP *bmp, int gray);
+
+/** CLAHE: ֳtilesx x tilesyԾ, ˫Բֵ; clipΪÿƽֵ, һȡ2~4, 0ʱü; ɹ1, ڴ治ʱ0ͼ񲻱 **/
+CAPI int bmp_clahe(BMP *bmp, int tilesx, int tilesy, double clip, int gray);
+
+// +---------------------------------------------------------
+// | ̬ѧ
+// +---------------------------------------------------------
+
+#define BMP_MORPH_ERODE  0      //ʴ: ȡСֵ
+#define BMP_MORPH_DILATE 1      //: ȡֵ
+#define BMP_MORPH_OPEN   2      //: ȸʴ
+#define BMP_MORPH_CLOSE  3      //: ͺʴ
+
+typedef struct BMPMorphStep
+{
+    int op;                     //BMP_MORPH_*
+    int width, height;          //νṹԪشС, ê
+}BMPMorphStep;
+
+/** νṹԪص̬ѧ, ÿغʱԪشС޹; ڰͼ(ֻͨͬ0/255)λ **/
+CAPI void bmp_morphology(BMP *bmp, int op, int width, int height);
+
+/** ִcount, ڰͼֻ/һ, ɹ1; Чڴ治ʱ0ͼ񲻱 **/
+CAPI int bmp_morphology_chain(BMP *bmp, const BMPMorphStep *steps, int count);
+
+// +---------------------------------------------------------
+// | ɫռת
+// +---------------------------------------------------------
+
+#define BMP_COLOR_YCBCR    0    //BT.601ȫΧ(JPEG), Y/Cb/CrƽͬС
+#define BMP_COLOR_YCBCR420 1    //ͬ, Cb/Crͬһа2x2ƽ, ƽΪ (w+1)/2 x (h+1)/2
+#define BMP_COLOR_HSV      2    //HΪ0..179(Ƕ/2), S/VΪ0..255
+#define BMP_COLOR_LAB      3    //sRGB D65, LΪ0..255(L*2.55), a/b128
+
+#ifndef BMP_PLANE_ALIGN
+#define BMP_PLANE_ALIGN 32      //ƽʼַоĶֽ
+#endif
+
+typedef struct BMPPlanes
+{
+    unsigned char *data[3];     //ƽ, ɵ߷
+    int stride[3];              //ÿƽо(ֽ)
+}BMPPlanes;
+
+/** BMP_PLANE_ALIGNо **/
+CAPI int bmp_plane_stride(int width);
+
+/** ƽ湲ֽ(bufferĶ) **/
+CAPI size_t bmp_planes_size(int space, int width, int height);
+
+/** һ鰴BMP_PLANE_ALIGNbufferƽ **/
+CAPI void bmp_planes_init(BMPPlanes *planes, int space, int width, int height, unsigned char *buffer);
+
+/** BGR(A)תΪƽʽ, , ڴ, ɹ1 **/
+CAPI int bmp_to_planes(const BMP *bmp, int space, const BMPPlanes *planes);
+
+/** ƽʽתbmp(Сͬ), alpha, ɹ1 **/
+CAPI int bmp_from_planes(BMP *bmp, int space, const BMPPlanes *planes);
+
+// +---------------------------------------------------------
+// | 
+// +---------------------------------------------------------
+
+#ifndef BMP_DIRTY_MAX
+#define BMP_DIRTY_MAX 64        //, ʱϲ
+#endif
+
+#ifndef BMP_DIRTY_TILE
+#define BMP_DIRTY_TILE 32       //bmp_dirty_diffȽϵĿ߳
+#endif
+
+typedef struct BMPDirty BMPDirty;
+
+/** width x heightͼ¼ **/
+CAPI BMPDirty *bmp_dirty_create(int width, int height);
+
+/** ޸Ĺ(right/bottom), ཻڵľκϲ **/
+CAPI void bmp_dirty_mark(BMPDirty *dirty, const BMPRect *rect);
+
+/** ͼ **/
+CAPI void bmp_dirty_mark_all(BMPDirty *dirty);
+
+/** һ֡Ƚ, б仯Ŀ, ؾ, ʧܷ-1 **/
+CAPI int bmp_dirty_diff(BMPDirty *dirty, BMP *prev, BMP *cur);
+
+/**  **/
+CAPI int bmp_dirty_count(BMPDirty *dirty);
+
+/** ȡi, ɹ1 **/
+CAPI int bmp_dirty_rect(BMPDirty *dirty, int i, BMPRect *rect);
+
+/** , ÿ֡ **/
+CAPI void bmp_dirty_clear(BMPDirty *dirty);
+
+CAPI void bmp_dirty_destroy(BMPDirty **dirty);
+
+/** : dstΪsrcһ֡ľ, ֻչ˰뾶Ĳ, dirtyΪNULLʱȫ **/
+CAPI int bmp_convolve_update(BMP *src, BMP *dst, BMPKernel *kernel, int border, BMPBGR fillclr, BMPDirty *dirty);
+
+/** ˹˲, srcƺbmp_gaussblur_filterͬ; ݹ˹ûް뾶, ȫ **/
+CAPI int bmp_gaussblur_update(BMP *src, BMP *dst, double sigma, BMPDirty *dirty);
+
+typedef struct BMPHistCache BMPHistCache;
+
+/** offsetֱͨͼ(ͨĸ) **/
+CAPI BMPHistCache *bmp_histcache_create(BMP *bmp, int offset);
+
+/** ֻȥֵֵ, ڲ256ֱͼ, dirtyΪNULLʱȫ **/
+CAPI const int *bmp_histcache_update(BMPHistCache *cache, BMP *bmp, BMPDirty *dirty);
+
+CAPI void bmp_histcache_destroy(BMPHistCache **cache);
+
+typedef struct BMPSearchCache BMPSearchCache;
+
+/** bmpҳbmp2λò(bmp2), ҷΧͬbmp_search **/
+CAPI BMPSearchCache *bmp_searchcache_create(BMP *bmp, BMP *bmp2);
+
+/** ֻ¼صλ, ֵx, yͬbmp_search **/
+CAPI int bmp_searchcache_update(BMPSearchCache *cache, BMP *bmp, BMPDirty *dirty, int *x, int *y);
+
+/** ǰƥλ **/
+CAPI int bmp_searchcache_count(BMPSearchCache *cache);
+
+CAPI void bmp_searchcache_destroy(BMPSearchCache **cache);
+
+// +---------------------------------------------------------
+// | C++ģں (libBMP.hpp / libBMP_kernels.cpp)
+// | libBMP.cʱ BMP_USE_CXX_KERNELS, кCʵ,
+// | Ҫ libBMP_kernels.o. ɹ1, 0ʱ˻Cʵ
+// +---------------------------------------------------------
+
+/** תҶͼ, ͬbmp_convert_gray **/
+CAPI int bmp_cxx_convert_gray(BMP *bmp);
+
+/** ֵ, ͬbmp_binaryzation **/
+CAPI int bmp_cxx_binaryzation(BMP *bmp, int k);
+
+/** ˮƽת, ͬbmp_horizontal_flip **/
+CAPI int bmp_cxx_horizontal_flip(BMP *bmp);
+
+/** ˲, ͬbmp_box_filter **/
+CAPI int bmp_cxx_box_filter(BMP *bmp, int box);
+
+/** ֵ˲, ͬbmp_middle_filter, alphaֲͨ **/
+CAPI int bmp_cxx_middle_filter(BMP *bmp, int box);
+
 #ifdef __cplusplus
 }
 #endif
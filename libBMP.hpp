@@ -0,0 +1,206 @@
+#ifndef LIB_BMP_HPP
+#define LIB_BMP_HPP
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "libBMP.h"
+
+// +---------------------------------------------------------
+// | C++ģں
+// | ظʽ߽緽ʽΪģ, ѭǱڳ,
+// | չԶ. ÿεðbmp->alphaѡһʵ.
+// +---------------------------------------------------------
+
+namespace bmp {
+
+//ظʽ: ÿֽɫͨ
+template <int BytePix, int Channels = 3>
+struct Format
+{
+    enum { bytepix = BytePix, channels = Channels };
+};
+
+typedef Format<3> BGR24;
+typedef Format<4> BGRA32;
+
+//Ͼ, ȡԵ(bmp_box_filterbmp_middle_filterԭеķʽ)
+struct BorderLegacy
+{
+    static int map(int i, int n)
+    {
+        i = i < 0 ? -i : i;
+        return i >= n ? n - 1 : i;
+    }
+};
+
+/** yʼַ **/
+inline unsigned char *row(const BMP *bmp, int y)
+{
+    return bmp->data + (size_t)y * BMP_PERLINE_REALSIZE(bmp);
+}
+
+/** תҶͼ, Ȩرbmp_apply_lut(BMP_LUT_GRAY)ͬ, λһ **/
+template <class F>
+void convert_gray(BMP *bmp)
+{
+    double weight[3][256];
+    for (int i = 0; i < 256; i++) {
+        weight[2][i] = i * 0.3;
+        weight[1][i] = i * 0.59;
+        weight[0][i] = i * 0.11;
+    }
+    for (int h = 0; h < bmp->height; h++) {
+        unsigned char *p = row(bmp, h);
+        for (int w = 0; w < bmp->width; w++, p += F::bytepix) {
+            int v = (int)(weight[2][p[2]] + weight[1][p[1]] + weight[0][p[0]]);
+            p[0] = p[1] = p[2] = (unsigned char)(v > 255 ? 255 : v);
+        }
+    }
+}
+
+/** ֵ: ͨ >= 3k  (b+g+r)/3 >= k **/
+template <class F>
+void binaryzation(BMP *bmp, int k)
+{
+    unsigned char fused[766];
+    for (int i = 0; i < 766; i++)
+        fused[i] = i / 3 >= k ? 0xff : 0x00;
+    for (int h = 0; h < bmp->height; h++) {
+        unsigned char *p = row(bmp, h);
+        for (int w = 0; w < bmp->width; w++, p += F::bytepix)
+            p[0] = p[1] = p[2] = fused[p[0] + p[1] + p[2]];
+    }
+}
+
+/** ˮƽת, ֻɫͨ **/
+template <class F>
+void horizontal_flip(BMP *bmp)
+{
+    for (int h = 0; h < bmp->height; h++) {
+        unsigned char *left = row(bmp, h), *right = left + (bmp->width - 1) * F::bytepix;
+        for (int w = 0; w < bmp->width / 2; w++, left += F::bytepix, right -= F::bytepix) {
+            for (int c = 0; c < F::channels; c++)
+                std::swap(left[c], right[c]);
+        }
+    }
+}
+
+//sum / area
+struct DivPlain
+{
+    static unsigned int div(unsigned int n, int area, unsigned long long) { return n / area; }
+};
+
+// 2^40/area + 1 , n * area < 2^40 ʱͬ
+struct DivMagic
+{
+    static unsigned int div(unsigned int n, int, unsigned long long magic) { return (unsigned int)((n * magic) >> 40); }
+};
+
+/** ˲: кͻ, дdst(bmpͬС), DΪʽ **/
+template <class F, class B, class D>
+bool box_filter_div(const BMP *bmp, int box, unsigned char *dst)
+{
+    const int C = F::channels, pw = bmp->width + 2 * box, area = (2 * box + 1) * (2 * box + 1);
+    const int perline = BMP_PERLINE_REALSIZE(bmp);
+    const unsigned long long magic = (1ULL << 40) / area + 1;
+    std::vector<int> xmapbuf(pw);
+    std::vector<unsigned int> colsumbuf((size_t)pw * C, 0);
+    int *xmap = &xmapbuf[0];
+    unsigned int *colsum = &colsumbuf[0];
+
+    for (int i = 0; i < pw; i++)
+        xmap[i] = B::map(i - box, bmp->width) * F::bytepix;
+
+    for (int i = -box; i <= box; i++) {
+        const unsigned char *add = row(bmp, B::map(i, bmp->height));
+        for (int x = 0; x < pw; x++) for (int c = 0; c < C; c++)
+            colsum[x * C + c] += add[xmap[x] + c];
+    }
+
+    for (int y = 0; y < bmp->height; y++) {
+        if (y > 0) {
+            const unsigned char *add = row(bmp, B::map(y + box, bmp->height));
+            const unsigned char *sub = row(bmp, B::map(y - box - 1, bmp->height));
+            for (int x = 0; x < pw; x++) for (int c = 0; c < C; c++)
+                colsum[x * C + c] += add[xmap[x] + c] - sub[xmap[x] + c];
+        }
+
+        //ںͷھֲ, дֽڲᱻܸдcolsum
+        unsigned int sum[C];
+        const unsigned int *head = colsum + (2 * box + 1) * C, *tail = colsum;
+        unsigned char *out = dst + (size_t)y * perline;
+        for (int c = 0; c < C; c++) {
+            sum[c] = 0;
+            for (int x = 0; x < 2 * box + 1; x++)
+                sum[c] += colsum[x * C + c];
+        }
+        for (int c = 0; c < C; c++)
+            out[c] = (unsigned char)D::div(sum[c], area, magic);
+        for (int x = 1; x < bmp->width; x++, head += C, tail += C) {
+            out += F::bytepix;
+            for (int c = 0; c < C; c++) {
+                sum[c] += head[c] - tail[c];
+                out[c] = (unsigned char)D::div(sum[c], area, magic);
+            }
+        }
+    }
+    return true;
+}
+
+/** ˲, ڲ255x255ʱó˷ **/
+template <class F, class B>
+bool box_filter(const BMP *bmp, int box, unsigned char *dst)
+{
+    return box <= 127 ? box_filter_div<F, B, DivMagic>(bmp, box, dst) : box_filter_div<F, B, DivPlain>(bmp, box, dst);
+}
+
+/** ֵ˲: ȡn/2Сֵ, дdst **/
+template <class F, class B>
+bool middle_filter(const BMP *bmp, int box, unsigned char *dst)
+{
+    const int size = 2 * box + 1, n = size * size;
+    const int perline = BMP_PERLINE_REALSIZE(bmp);
+    std::vector<int> xmap(bmp->width + 2 * box);
+    std::vector<const unsigned char *> rows(size);
+    std::vector<unsigned char> value((size_t)n * F::channels);
+
+    for (int i = 0; i < bmp->width + 2 * box; i++)
+        xmap[i] = B::map(i - box, bmp->width) * F::bytepix;
+
+    for (int y = 0; y < bmp->height; y++) {
+        for (int i = 0; i < size; i++)
+            rows[i] = row(bmp, B::map(y + i - box, bmp->height));
+
+        unsigned char *out = dst + (size_t)y * perline;
+        for (int x = 0; x < bmp->width; x++, out += F::bytepix) {
+            //ֿͨ, ÿͨһ
+            for (int i = 0, k = 0; i < size; i++) for (int j = 0; j < size; j++, k++) {
+                const unsigned char *p = rows[i] + xmap[x + j];
+                for (int c = 0; c < F::channels; c++)
+                    value[c * n + k] = p[c];
+            }
+            for (int c = 0; c < F::channels; c++) {
+                unsigned char *v = &value[(size_t)c * n];
+                std::nth_element(v, v + n / 2, v + n);
+                out[c] = v[n / 2];
+            }
+        }
+    }
+    return true;
+}
+
+/** bmp->alphaѡʽʵ, Opṩ template <class F> bool run(BMP *) **/
+template <class Op>
+bool dispatch(BMP *bmp, Op op)
+{
+    if (BMPNULL(bmp)) return false;
+    return bmp->alpha == 1 ? op.template run<BGRA32>(bmp) : op.template run<BGR24>(bmp);
+}
+
+}
+
+#endif
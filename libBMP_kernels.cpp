@@ -0,0 +1,84 @@
+/**
+ * C++ģں˵C, libBMP.cʱBMP_USE_CXX_KERNELS
+ * bmp_convert_grayȺת. ɹ1, 0ʱCд.
+ */
+#include "libBMP.hpp"
+
+namespace {
+
+struct GrayOp
+{
+    template <class F> bool run(BMP *bmp) { bmp::convert_gray<F>(bmp); return true; }
+};
+
+struct BinaryzationOp
+{
+    int k;
+    template <class F> bool run(BMP *bmp) { bmp::binaryzation<F>(bmp, k); return true; }
+};
+
+struct FlipOp
+{
+    template <class F> bool run(BMP *bmp) { bmp::horizontal_flip<F>(bmp); return true; }
+};
+
+//ȸһΪ, alphaβֽ
+struct BoxOp
+{
+    int box;
+    template <class F> bool run(BMP *bmp)
+    {
+        unsigned char *tmp = (unsigned char *)malloc(bmp->size);
+        if (tmp == NULL) return false;
+        memcpy(tmp, bmp->data, bmp->size);
+        bmp::box_filter<F, bmp::BorderLegacy>(bmp, box, tmp);
+        free(bmp->data);
+        bmp->data = tmp;
+        return true;
+    }
+};
+
+struct MiddleOp
+{
+    int box;
+    template <class F> bool run(BMP *bmp)
+    {
+        unsigned char *tmp = (unsigned char *)malloc(bmp->size);
+        if (tmp == NULL) return false;
+        memcpy(tmp, bmp->data, bmp->size);
+        bmp::middle_filter<F, bmp::BorderLegacy>(bmp, box, tmp);
+        free(bmp->data);
+        bmp->data = tmp;
+        return true;
+    }
+};
+
+}
+
+int bmp_cxx_convert_gray(BMP *bmp)
+{
+    return bmp::dispatch(bmp, GrayOp());
+}
+
+int bmp_cxx_binaryzation(BMP *bmp, int k)
+{
+    BinaryzationOp op = {k};
+    return bmp::dispatch(bmp, op);
+}
+
+int bmp_cxx_horizontal_flip(BMP *bmp)
+{
+    return bmp::dispatch(bmp, FlipOp());
+}
+
+int bmp_cxx_box_filter(BMP *bmp, int box)
+{
+    BoxOp op = {box < 0 ? 0 : box};
+    return bmp::dispatch(bmp, op);
+}
+
+int bmp_cxx_middle_filter(BMP *bmp, int box)
+{
+    MiddleOp op = {box < 0 ? 0 : box};
+    return bmp::dispatch(bmp, op);
+}